@@ -97,6 +97,16 @@
  */
 - (NSUInteger)totalSize;
 
+@optional
+/**
+ Removes the expired data in a bounded time slice, continuing from where the last slice stopped. The cache should keep the cursor, so a slice does not need to scan all the data.
+ This is used by `SDImageCache` when `diskCacheExpirationSliceDuration` is set, each slice is a separate block on the IO queue, so the disk queries can run between the slices.
+ 
+ @param timeLimit The maximum time of the slice, in seconds.
+ @return YES if a full pass finished, NO if there are more data to check.
+ */
+- (BOOL)removeExpiredDataWithTimeLimit:(NSTimeInterval)timeLimit;
+
 @end
 
 /**
@@ -123,6 +133,7 @@
  If the new location does not exist, only do a movement of directory.
  If the new location does exist, will move and merge the files from old location.
  If the new location does exist, but is not a directory, will remove it and do a movement of directory.
+ If `shouldUseDiskCacheDirectoryFanOut` is enabled, the files of the flat layout in the new location are moved into the subdirectories. This also works when the old location is equal to the new location.
 
  @param srcPath old location of cache directory
  @param dstPath new location of cache directory
@@ -8,9 +8,40 @@
 
 #import "SDDiskCache.h"
 #import "SDImageCacheConfig.h"
+#import "SDDiskCacheIndex.h"
+#import "SDInternalMacros.h"
 #import <CommonCrypto/CommonDigest.h>
+#import <fcntl.h>
+#import <stdatomic.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <unistd.h>
 
-@interface SDDiskCache ()
+#define SD_MAX_FILE_EXTENSION_LENGTH (NAME_MAX - CC_MD5_DIGEST_LENGTH * 2 - 1)
+
+// The maximum number of the oldest files kept by a sliced expiration pass for the size-based cleanup
+static const NSUInteger kSDDiskCacheExpirationCandidateCount = 1000;
+
+@interface SDDiskCache () {
+    SDDiskCacheIndex *_index;
+    BOOL _usesIndex;
+    SDImageCacheConfigFileNameHashType _fileNameHashType;
+    BOOL _usesFanOut;
+    BOOL _hasFlatFiles; // The files of the flat layout may not be moved into the subdirectories yet
+    dispatch_semaphore_t _indexLock;
+    NSMutableSet<NSString *> *_legacyFileNames; // The MD5 file names not migrated yet, nil if not loaded
+    atomic_bool _legacyFileNamesLoaded; // Whether `loadLegacyFileNames` finished, so the write path only checks this flag
+    dispatch_semaphore_t _legacyLock;
+    // The cursor of the sliced expiration
+    NSDirectoryEnumerator<NSURL *> *_expirationEnumerator;
+    NSUInteger _expirationTotalSize; // The allocated size found by this pass
+    NSMutableDictionary<NSURL *, NSDictionary<NSString *, id> *> *_expirationCandidates; // The oldest files found by this pass, bounded
+    NSArray<NSURL *> *_expirationTrimmingFiles; // The sorted candidates to remove when the pass found the cache exceeds the maximum size
+    NSUInteger _expirationTrimmingIndex;
+    NSData *_expirationEntries; // The sorted index entries of this pass
+    NSUInteger _expirationEntryIndex;
+    BOOL _expirationTrimmingSize;
+}
 
 @property (nonatomic, copy) NSString *diskCachePath;
 @property (nonatomic, strong, nonnull) NSFileManager *fileManager;
@@ -43,36 +74,81 @@
     } else {
         self.fileManager = [NSFileManager new];
     }
+    _usesIndex = self.config.shouldUseDiskCacheIndex;
+    _fileNameHashType = self.config.diskCacheFileNameHashType;
+    _usesFanOut = self.config.shouldUseDiskCacheDirectoryFanOut;
+    _hasFlatFiles = _usesFanOut;
+    _indexLock = dispatch_semaphore_create(1);
+    _legacyLock = dispatch_semaphore_create(1);
 }
 
 - (BOOL)containsDataForKey:(NSString *)key {
     NSParameterAssert(key);
+    SDDiskCacheIndex *index = [self loadedIndex];
+    if (index) {
+        uint8_t digest[SD_DISK_CACHE_INDEX_DIGEST_LENGTH];
+        [self getDigest:digest forKey:key hashType:_fileNameHashType];
+        if ([index getEntry:NULL forDigest:digest]) {
+            return YES;
+        }
+        return [self migrateLegacyFileForKey:key];
+    }
     NSString *filePath = [self cachePathForKey:key];
     BOOL exists = [self.fileManager fileExistsAtPath:filePath];
     
     // fallback because of https://github.com/rs/SDWebImage/pull/976 that added the extension to the disk file name
     // checking the key with and without the extension
-    if (!exists) {
+    if (!exists && _fileNameHashType == SDImageCacheConfigFileNameHashTypeMD5) {
         exists = [self.fileManager fileExistsAtPath:filePath.stringByDeletingPathExtension];
     }
     
+    if (!exists) {
+        exists = [self migrateLegacyFileForKey:key];
+    }
+    
     return exists;
 }
 
 // 取 key 就是图片的url
 - (NSData *)dataForKey:(NSString *)key {
     NSParameterAssert(key);
+    SDDiskCacheIndex *index = [self loadedIndex];
+    if (index) {
+        // The index knows the file name on disk, with or without extension, so only one read is needed
+        uint8_t digest[SD_DISK_CACHE_INDEX_DIGEST_LENGTH];
+        [self getDigest:digest forKey:key hashType:_fileNameHashType];
+        SDDiskCacheIndexEntry entry;
+        if (![index getEntry:&entry forDigest:digest]) {
+            if (![self migrateLegacyFileForKey:key] || ![index getEntry:&entry forDigest:digest]) {
+                return nil;
+            }
+        }
+        NSData *data = [self dataWithContentsOfFile:[self cachePathForIndexEntry:&entry]];
+        if (data) {
+            [index updateAccessDate:[NSDate timeIntervalSinceReferenceDate] forDigest:digest];
+        } else {
+            // The file was removed outside, keep the index in sync
+            [index removeEntry:NULL forDigest:digest];
+        }
+        return data;
+    }
     NSString *filePath = [self cachePathForKey:key];
-    NSData *data = [NSData dataWithContentsOfFile:filePath options:self.config.diskCacheReadingOptions error:nil];
+    NSData *data = [self dataWithContentsOfFile:filePath];
     if (data) {
         return data;
     }
     
     // fallback because of https://github.com/rs/SDWebImage/pull/976 that added the extension to the disk file name
     // checking the key with and without the extension
-    data = [NSData dataWithContentsOfFile:filePath.stringByDeletingPathExtension options:self.config.diskCacheReadingOptions error:nil];
-    if (data) {
-        return data;
+    if (_fileNameHashType == SDImageCacheConfigFileNameHashTypeMD5) {
+        data = [self dataWithContentsOfFile:filePath.stringByDeletingPathExtension];
+        if (data) {
+            return data;
+        }
+    }
+    
+    if ([self migrateLegacyFileForKey:key]) {
+        return [self dataWithContentsOfFile:filePath];
     }
     
     return nil;
@@ -82,42 +158,113 @@
 - (void)setData:(NSData *)data forKey:(NSString *)key {
     NSParameterAssert(data);
     NSParameterAssert(key);
-    // 判断将要缓存的路径是否存在，如果不存在，则创建一个
-    if (![self.fileManager fileExistsAtPath:self.diskCachePath]) {
-        [self.fileManager createDirectoryAtPath:self.diskCachePath withIntermediateDirectories:YES attributes:nil error:NULL];
+    // The files on disk before the first write are the legacy ones
+    if (!atomic_load_explicit(&_legacyFileNamesLoaded, memory_order_acquire)) {
+        [self loadLegacyFileNames];
     }
-    
     // get cache Path for image key
     // 使用 CC_MD5 生成一个 新的 Key
     NSString *cachePathForKey = [self cachePathForKey:key];
+    // 判断将要缓存的路径是否存在，如果不存在，则创建一个
+    // The directory is the subdirectory when fan-out is enabled
+    NSString *directory = cachePathForKey.stringByDeletingLastPathComponent;
+    if (![self.fileManager fileExistsAtPath:directory]) {
+        [self.fileManager createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+    }
+    
     // transform to NSUrl  转换成 url
     NSURL *fileURL = [NSURL fileURLWithPath:cachePathForKey];
     // CC_MD5 生成的KEY 转换为 URL 后存放对应的数据
-    [data writeToURL:fileURL options:self.config.diskCacheWritingOptions error:nil];
+    NSDataWritingOptions writingOptions = self.config.diskCacheWritingOptions;
+    // The mapped reader crashes (SIGBUS) if the file is truncated in place, so replace the file atomically, the old mapping keeps the old file
+    if (self.config.diskCacheMappedReadingThreshold > 0 && !(writingOptions & NSDataWritingWithoutOverwriting)) {
+        writingOptions |= NSDataWritingAtomic;
+    }
+    SDDiskCacheIndex *index = [self loadedIndex];
+    BOOL success = [data writeToURL:fileURL options:writingOptions error:nil];
     
     // disable iCloud backup  默认禁用 icloud 备份
     if (self.config.shouldDisableiCloud) {
         // ignore iCloud backup resource value error
         [fileURL setResourceValue:@YES forKey:NSURLIsExcludedFromBackupKey error:nil];
     }
+    
+    if (index && success) {
+        NSTimeInterval date = [NSDate timeIntervalSinceReferenceDate];
+        SDDiskCacheIndexEntry entry = {0};
+        SDDiskCacheIndexEntryFromFileName(cachePathForKey.lastPathComponent, &entry);
+        entry.size = data.length;
+        entry.modificationDate = date;
+        entry.accessDate = date;
+        // A legacy file without extension may be indexed for the same key
+        SDDiskCacheIndexEntry oldEntry;
+        if ([index getEntry:&oldEntry forDigest:entry.digest] && strcmp(oldEntry.extension, entry.extension) != 0) {
+            [self.fileManager removeItemAtPath:[self cachePathForIndexEntry:&oldEntry] error:nil];
+        }
+        // The index is dropped if it can not grow, the file is still found by the expiration of the non-index path
+        [index setEntry:&entry];
+    }
 }
 
 - (void)removeDataForKey:(NSString *)key {
     NSParameterAssert(key);
+    // Move the legacy file to the current name, so it's removed as well
+    [self migrateLegacyFileForKey:key];
     NSString *filePath = [self cachePathForKey:key];
+    SDDiskCacheIndex *index = [self loadedIndex];
+    if (index) {
+        uint8_t digest[SD_DISK_CACHE_INDEX_DIGEST_LENGTH];
+        [self getDigest:digest forKey:key hashType:_fileNameHashType];
+        SDDiskCacheIndexEntry entry;
+        if ([index removeEntry:&entry forDigest:digest]) {
+            NSString *indexedPath = [self cachePathForIndexEntry:&entry];
+            if (![indexedPath isEqualToString:filePath]) {
+                [self.fileManager removeItemAtPath:indexedPath error:nil];
+            }
+        }
+        [self.fileManager removeItemAtPath:filePath error:nil];
+        return;
+    }
     [self.fileManager removeItemAtPath:filePath error:nil];
 }
 
 - (void)removeAllData {
+    if (_usesFanOut) {
+        // Remove the subdirectories concurrently, instead of one deep recursive removal
+        NSString *diskCachePath = self.diskCachePath;
+        NSArray<NSString *> *fileNames = [self.fileManager contentsOfDirectoryAtPath:diskCachePath error:nil];
+        dispatch_apply(fileNames.count, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^(size_t iteration) {
+            [self.fileManager removeItemAtPath:[diskCachePath stringByAppendingPathComponent:fileNames[iteration]] error:nil];
+        });
+        _hasFlatFiles = NO;
+    }
     [self.fileManager removeItemAtPath:self.diskCachePath error:nil];
     [self.fileManager createDirectoryAtPath:self.diskCachePath
             withIntermediateDirectories:YES
                              attributes:nil
                                   error:NULL];
+    [[self loadedIndex] removeAllEntries];
+    // Start a new expiration pass
+    _expirationEnumerator = nil;
+    _expirationCandidates = nil;
+    _expirationTrimmingFiles = nil;
+    SD_LOCK(_legacyLock);
+    if (_legacyFileNames.count > 0) {
+        [_legacyFileNames removeAllObjects];
+        [self saveLegacyFileNames];
+    }
+    SD_UNLOCK(_legacyLock);
 }
 
 // 移除过期的缓存
 - (void)removeExpiredData {
+    SDDiskCacheIndex *index = [self loadedIndex];
+    if (index) {
+        // Start a new pass, and finish it without time limit
+        _expirationEntries = nil;
+        [self removeExpiredDataWithIndex:index timeLimit:DBL_MAX];
+        return;
+    }
     // diskCache 路径
     NSURL *diskCacheURL = [NSURL fileURLWithPath:self.diskCachePath isDirectory:YES];
     
@@ -138,16 +285,10 @@
     
     NSArray<NSString *> *resourceKeys = @[NSURLIsDirectoryKey, cacheContentDateKey, NSURLTotalFileAllocatedSizeKey];
     
-    // This enumerator prefetches useful properties for our cache files.
-    // 获取缓存文件的属性
-    NSDirectoryEnumerator *fileEnumerator = [self.fileManager enumeratorAtURL:diskCacheURL
-                                               includingPropertiesForKeys:resourceKeys
-                                                                  options:NSDirectoryEnumerationSkipsHiddenFiles
-                                                             errorHandler:NULL];
     // 最早的有效缓存的时间，小于这个时间的缓存都失效了
     NSDate *expirationDate = (self.config.maxDiskAge < 0) ? nil: [NSDate dateWithTimeIntervalSinceNow:-self.config.maxDiskAge];
     NSMutableDictionary<NSURL *, NSDictionary<NSString *, id> *> *cacheFiles = [NSMutableDictionary dictionary];
-    NSUInteger currentCacheSize = 0;  // 当前缓存的大小
+    __block NSUInteger currentCacheSize = 0;  // 当前缓存的大小
     
     // Enumerate all of the files in the cache directory.  This loop has two purposes:
     // 枚举缓存目录中的所有文件。这个循环有两个目的:
@@ -156,29 +297,27 @@
     //  2. Storing file attributes for the size-based cleanup pass.
     // 存储需要移除的缓存图片的路径
     NSMutableArray<NSURL *> *urlsToDelete = [[NSMutableArray alloc] init];
-    for (NSURL *fileURL in fileEnumerator) {
-        NSError *error;
-        NSDictionary<NSString *, id> *resourceValues = [fileURL resourceValuesForKeys:resourceKeys error:&error];
-        
-        // Skip directories and errors.
-        if (error || !resourceValues || [resourceValues[NSURLIsDirectoryKey] boolValue]) {
-            continue;
-        }
-        
+    // The block is called concurrently when fan-out is enabled
+    dispatch_semaphore_t lock = dispatch_semaphore_create(1);
+    [self enumerateFilesAtURL:diskCacheURL resourceKeys:resourceKeys usingBlock:^(NSURL *fileURL, NSDictionary<NSURLResourceKey, id> *resourceValues) {
         // Remove files that are older than the expiration date;
         // 通过时间来判断出需要移除的缓存
         NSDate *modifiedDate = resourceValues[cacheContentDateKey];
         if (expirationDate && [[modifiedDate laterDate:expirationDate] isEqualToDate:expirationDate]) {
+            SD_LOCK(lock);
             [urlsToDelete addObject:fileURL];
-            continue;
+            SD_UNLOCK(lock);
+            return;
         }
         
         // 计算有效缓存大小
         // Store a reference to this file and account for its total size.
         NSNumber *totalAllocatedSize = resourceValues[NSURLTotalFileAllocatedSizeKey];
+        SD_LOCK(lock);
         currentCacheSize += totalAllocatedSize.unsignedIntegerValue;
         cacheFiles[fileURL] = resourceValues;
-    }
+        SD_UNLOCK(lock);
+    }];
     
     // 移除缓存
     for (NSURL *fileURL in urlsToDelete) {
@@ -215,6 +354,122 @@
             }
         }
     }
+    [self pruneLegacyFileNames];
+}
+
+- (BOOL)removeExpiredDataWithTimeLimit:(NSTimeInterval)timeLimit {
+    SDDiskCacheIndex *index = [self loadedIndex];
+    if (index) {
+        return [self removeExpiredDataWithIndex:index timeLimit:timeLimit];
+    }
+    CFAbsoluteTime deadline = CFAbsoluteTimeGetCurrent() + timeLimit;
+    // The last pass found the cache exceeds the maximum size, remove the oldest files it collected before starting a new pass
+    if (_expirationTrimmingFiles) {
+        return [self trimExpirationCandidatesBeforeDeadline:deadline];
+    }
+    NSURLResourceKey cacheContentDateKey = self.config.diskCacheExpireType == SDImageCacheConfigExpireTypeAccessDate ? NSURLContentAccessDateKey : NSURLContentModificationDateKey;
+    NSArray<NSString *> *resourceKeys = @[NSURLIsDirectoryKey, cacheContentDateKey, NSURLTotalFileAllocatedSizeKey];
+    // Continue the enumeration from the last slice, start a new pass if finished
+    if (!_expirationEnumerator) {
+        NSURL *diskCacheURL = [NSURL fileURLWithPath:self.diskCachePath isDirectory:YES];
+        _expirationEnumerator = [self.fileManager enumeratorAtURL:diskCacheURL
+                                       includingPropertiesForKeys:resourceKeys
+                                                          options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                     errorHandler:NULL];
+        _expirationTotalSize = 0;
+        _expirationCandidates = [NSMutableDictionary dictionary];
+    }
+    NSDate *expirationDate = (self.config.maxDiskAge < 0) ? nil: [NSDate dateWithTimeIntervalSinceNow:-self.config.maxDiskAge];
+    BOOL finished = NO;
+    do {
+        NSURL *fileURL = [_expirationEnumerator nextObject];
+        if (!fileURL) {
+            finished = YES;
+            break;
+        }
+        NSError *error;
+        NSDictionary<NSString *, id> *resourceValues = [fileURL resourceValuesForKeys:resourceKeys error:&error];
+        
+        // Skip directories and errors.
+        if (error || !resourceValues || [resourceValues[NSURLIsDirectoryKey] boolValue]) {
+            continue;
+        }
+        
+        // Remove files that are older than the expiration date;
+        NSDate *modifiedDate = resourceValues[cacheContentDateKey];
+        if (expirationDate && [[modifiedDate laterDate:expirationDate] isEqualToDate:expirationDate]) {
+            [self.fileManager removeItemAtURL:fileURL error:nil];
+            continue;
+        }
+        
+        NSNumber *totalAllocatedSize = resourceValues[NSURLTotalFileAllocatedSizeKey];
+        _expirationTotalSize += totalAllocatedSize.unsignedIntegerValue;
+        // Keep the oldest files of the whole pass, not of this slice, so the size-based cleanup does not remove the recent files of a slice
+        _expirationCandidates[fileURL] = resourceValues;
+        if (_expirationCandidates.count >= kSDDiskCacheExpirationCandidateCount * 2) {
+            NSArray<NSURL *> *sortedFiles = [self sortedExpirationCandidates];
+            [_expirationCandidates removeObjectsForKeys:[sortedFiles subarrayWithRange:NSMakeRange(kSDDiskCacheExpirationCandidateCount, sortedFiles.count - kSDDiskCacheExpirationCandidateCount)]];
+        }
+    } while (CFAbsoluteTimeGetCurrent() < deadline);
+    if (!finished) {
+        return NO;
+    }
+    _expirationEnumerator = nil;
+    [self pruneLegacyFileNames];
+    // If our remaining disk cache exceeds a configured maximum size, remove the oldest files of this pass until half of the maximum size
+    NSUInteger maxDiskSize = self.config.maxDiskSize;
+    if (maxDiskSize > 0 && _expirationTotalSize > maxDiskSize) {
+        _expirationTrimmingFiles = [self sortedExpirationCandidates];
+        _expirationTrimmingIndex = 0;
+        return [self trimExpirationCandidatesBeforeDeadline:deadline];
+    }
+    _expirationCandidates = nil;
+    return YES;
+}
+
+// Sort the candidates by their last modification time or last access time (oldest first)
+- (nonnull NSArray<NSURL *> *)sortedExpirationCandidates {
+    NSURLResourceKey cacheContentDateKey = self.config.diskCacheExpireType == SDImageCacheConfigExpireTypeAccessDate ? NSURLContentAccessDateKey : NSURLContentModificationDateKey;
+    return [_expirationCandidates keysSortedByValueWithOptions:NSSortConcurrent
+                                               usingComparator:^NSComparisonResult(id obj1, id obj2) {
+                                                   return [obj1[cacheContentDateKey] compare:obj2[cacheContentDateKey]];
+                                               }];
+}
+
+// Returns YES if the size-based cleanup finished
+- (BOOL)trimExpirationCandidatesBeforeDeadline:(CFAbsoluteTime)deadline {
+    NSURLResourceKey cacheContentDateKey = self.config.diskCacheExpireType == SDImageCacheConfigExpireTypeAccessDate ? NSURLContentAccessDateKey : NSURLContentModificationDateKey;
+    const NSUInteger desiredCacheSize = self.config.maxDiskSize / 2;
+    BOOL finished = NO;
+    while (YES) {
+        // The files not collected are removed by the next pass if the cache still exceeds the maximum size
+        if (_expirationTotalSize < desiredCacheSize || _expirationTrimmingIndex >= _expirationTrimmingFiles.count) {
+            finished = YES;
+            break;
+        }
+        NSURL *fileURL = _expirationTrimmingFiles[_expirationTrimmingIndex];
+        _expirationTrimmingIndex++;
+        NSDictionary<NSString *, id> *resourceValues = _expirationCandidates[fileURL];
+        // The file may be written or read again after it's checked by the pass
+        [fileURL removeAllCachedResourceValues];
+        NSDate *date;
+        [fileURL getResourceValue:&date forKey:cacheContentDateKey error:nil];
+        if (date && [date compare:resourceValues[cacheContentDateKey]] == NSOrderedDescending) {
+            continue;
+        }
+        if ([self.fileManager removeItemAtURL:fileURL error:nil]) {
+            NSUInteger size = [resourceValues[NSURLTotalFileAllocatedSizeKey] unsignedIntegerValue];
+            _expirationTotalSize -= MIN(_expirationTotalSize, size);
+        }
+        if (CFAbsoluteTimeGetCurrent() >= deadline) {
+            break;
+        }
+    }
+    if (finished) {
+        _expirationTrimmingFiles = nil;
+        _expirationCandidates = nil;
+    }
+    return finished;
 }
 
 - (nullable NSString *)cachePathForKey:(NSString *)key {
@@ -223,6 +478,20 @@
 }
 
 - (NSUInteger)totalSize {
+    SDDiskCacheIndex *index = [self loadedIndex];
+    if (index) {
+        return index.totalSize;
+    }
+    if (_usesFanOut) {
+        __block NSUInteger size = 0;
+        dispatch_semaphore_t lock = dispatch_semaphore_create(1);
+        [self enumerateFilesAtURL:[NSURL fileURLWithPath:self.diskCachePath isDirectory:YES] resourceKeys:@[NSURLIsDirectoryKey, NSURLFileSizeKey] usingBlock:^(NSURL *fileURL, NSDictionary<NSURLResourceKey, id> *resourceValues) {
+            SD_LOCK(lock);
+            size += [resourceValues[NSURLFileSizeKey] unsignedIntegerValue];
+            SD_UNLOCK(lock);
+        }];
+        return size;
+    }
     NSUInteger size = 0;
     NSDirectoryEnumerator *fileEnumerator = [self.fileManager enumeratorAtPath:self.diskCachePath];
     for (NSString *fileName in fileEnumerator) {
@@ -234,17 +503,500 @@
 }
 
 - (NSUInteger)totalCount {
+    SDDiskCacheIndex *index = [self loadedIndex];
+    if (index) {
+        return index.count;
+    }
+    if (_usesFanOut) {
+        // The subdirectories are not counted
+        __block NSUInteger count = 0;
+        dispatch_semaphore_t lock = dispatch_semaphore_create(1);
+        [self enumerateFilesAtURL:[NSURL fileURLWithPath:self.diskCachePath isDirectory:YES] resourceKeys:@[NSURLIsDirectoryKey] usingBlock:^(NSURL *fileURL, NSDictionary<NSURLResourceKey, id> *resourceValues) {
+            SD_LOCK(lock);
+            count++;
+            SD_UNLOCK(lock);
+        }];
+        return count;
+    }
     NSUInteger count = 0;
     NSDirectoryEnumerator *fileEnumerator = [self.fileManager enumeratorAtPath:self.diskCachePath];
     count = fileEnumerator.allObjects.count;
     return count;
 }
 
+#pragma mark - Enumeration
+
+// Enumerate the files (not directories) in the cache directory. When fan-out is enabled, each top-level subdirectory is enumerated concurrently, so the block should be thread-safe
+- (void)enumerateFilesAtURL:(nonnull NSURL *)diskCacheURL resourceKeys:(nonnull NSArray<NSURLResourceKey> *)resourceKeys usingBlock:(nonnull void(^)(NSURL * _Nonnull fileURL, NSDictionary<NSURLResourceKey, id> * _Nonnull resourceValues))block {
+    if (!_usesFanOut) {
+        [self enumerateFilesInDirectoryAtURL:diskCacheURL resourceKeys:resourceKeys usingBlock:block];
+        return;
+    }
+    NSArray<NSURL *> *fileURLs = [self.fileManager contentsOfDirectoryAtURL:diskCacheURL
+                                                 includingPropertiesForKeys:resourceKeys
+                                                                    options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                                      error:nil];
+    dispatch_apply(fileURLs.count, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^(size_t iteration) {
+        @autoreleasepool {
+            NSURL *fileURL = fileURLs[iteration];
+            NSDictionary<NSURLResourceKey, id> *resourceValues = [fileURL resourceValuesForKeys:resourceKeys error:nil];
+            if (!resourceValues) {
+                return;
+            }
+            if ([resourceValues[NSURLIsDirectoryKey] boolValue]) {
+                [self enumerateFilesInDirectoryAtURL:fileURL resourceKeys:resourceKeys usingBlock:block];
+            } else {
+                // The file of the flat layout
+                block(fileURL, resourceValues);
+            }
+        }
+    });
+}
+
+- (void)enumerateFilesInDirectoryAtURL:(nonnull NSURL *)directoryURL resourceKeys:(nonnull NSArray<NSURLResourceKey> *)resourceKeys usingBlock:(nonnull void(^)(NSURL * _Nonnull fileURL, NSDictionary<NSURLResourceKey, id> * _Nonnull resourceValues))block {
+    // This enumerator prefetches useful properties for our cache files.
+    // 获取缓存文件的属性
+    NSDirectoryEnumerator *fileEnumerator = [self.fileManager enumeratorAtURL:directoryURL
+                                               includingPropertiesForKeys:resourceKeys
+                                                                  options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                             errorHandler:NULL];
+    for (NSURL *fileURL in fileEnumerator) {
+        NSError *error;
+        NSDictionary<NSURLResourceKey, id> *resourceValues = [fileURL resourceValuesForKeys:resourceKeys error:&error];
+        
+        // Skip directories and errors.
+        if (error || !resourceValues || [resourceValues[NSURLIsDirectoryKey] boolValue]) {
+            continue;
+        }
+        block(fileURL, resourceValues);
+    }
+}
+
+#pragma mark - Read
+
+// Read the file with one open. The file not smaller than `diskCacheMappedReadingThreshold` is memory-mapped, the mapping is owned by the returned data, and keeps valid after the file is removed (unlink) or replaced (atomic rename) by eviction
+- (nullable NSData *)dataWithContentsOfFile:(nonnull NSString *)path {
+    NSUInteger threshold = self.config.diskCacheMappedReadingThreshold;
+    if (threshold == 0) {
+        return [NSData dataWithContentsOfFile:path options:self.config.diskCacheReadingOptions error:nil];
+    }
+    int fd = open(path.fileSystemRepresentation, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nil;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return nil;
+    }
+    size_t size = (size_t)st.st_size;
+    NSData *data;
+    if (size > 0 && size >= threshold) {
+        void *bytes = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (bytes != MAP_FAILED) {
+            data = [[NSData alloc] initWithBytesNoCopy:bytes length:size deallocator:^(void * _Nonnull bytes, NSUInteger length) {
+                munmap(bytes, length);
+            }];
+        }
+    }
+    if (!data) {
+        void *bytes = malloc(MAX(size, 1));
+        if (bytes && pread(fd, bytes, size, 0) == (ssize_t)size) {
+            data = [[NSData alloc] initWithBytesNoCopy:bytes length:size freeWhenDone:YES];
+        } else {
+            free(bytes);
+        }
+    }
+    close(fd);
+    return data;
+}
+
+#pragma mark - Index
+
+// The index file is next to the cache directory, so it's not touched by the directory operations
+- (nonnull NSString *)indexPath {
+    return [self.diskCachePath stringByAppendingString:@".index"];
+}
+
+// Open the index lazily on the first access, which is on the IO queue. The index is rebuilt from the files if it's newly created
+- (nullable SDDiskCacheIndex *)loadedIndex {
+    if (!_usesIndex) {
+        return nil;
+    }
+    SD_LOCK(_indexLock);
+    if (!_index) {
+        [self.fileManager createDirectoryAtPath:self.diskCachePath withIntermediateDirectories:YES attributes:nil error:NULL];
+        // The index does not store the directory, so the flat files should be moved into the subdirectories before it's used
+        BOOL movedFlatFiles = _hasFlatFiles && [self moveFlatFilesToSubdirectoriesAtPath:self.diskCachePath] > 0;
+        __block BOOL rebuilt = NO;
+        // The caches on the same path share the index
+        _index = [SDDiskCacheIndex sharedIndexWithPath:[self indexPath] rebuildBlock:^(SDDiskCacheIndex * _Nonnull index) {
+            [self rebuildIndex:index];
+            rebuilt = YES;
+        }];
+        if (movedFlatFiles && !rebuilt) {
+            [_index removeAllEntries];
+            [self rebuildIndex:_index];
+        }
+    }
+    SDDiskCacheIndex *index = _index;
+    SD_UNLOCK(_indexLock);
+    // Fall back to the files if the index is dropped
+    if (index.isInvalidated) {
+        return nil;
+    }
+    return index;
+}
+
+// The files are changed outside, rebuild the index from the files. The index is shared, so it's reset in place but not removed
+- (void)invalidateIndex {
+    SDDiskCacheIndex *index = [self loadedIndex];
+    if (!index) {
+        return;
+    }
+    SD_LOCK(_indexLock);
+    [index removeAllEntries];
+    [self rebuildIndex:index];
+    SD_UNLOCK(_indexLock);
+}
+
+- (void)rebuildIndex:(nonnull SDDiskCacheIndex *)index {
+    NSURL *diskCacheURL = [NSURL fileURLWithPath:self.diskCachePath isDirectory:YES];
+    NSArray<NSString *> *resourceKeys = @[NSURLIsDirectoryKey, NSURLContentModificationDateKey, NSURLContentAccessDateKey, NSURLFileSizeKey];
+    NSDirectoryEnumerator *fileEnumerator = [self.fileManager enumeratorAtURL:diskCacheURL
+                                               includingPropertiesForKeys:resourceKeys
+                                                                  options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                             errorHandler:NULL];
+    for (NSURL *fileURL in fileEnumerator) {
+        NSDictionary<NSString *, id> *resourceValues = [fileURL resourceValuesForKeys:resourceKeys error:nil];
+        // Skip directories and errors.
+        if (!resourceValues || [resourceValues[NSURLIsDirectoryKey] boolValue]) {
+            continue;
+        }
+        SDDiskCacheIndexEntry entry = {0};
+        if (!SDDiskCacheIndexEntryFromFileName(fileURL.lastPathComponent, &entry)) {
+            continue;
+        }
+        entry.size = [resourceValues[NSURLFileSizeKey] unsignedLongLongValue];
+        entry.modificationDate = [resourceValues[NSURLContentModificationDateKey] timeIntervalSinceReferenceDate];
+        entry.accessDate = [resourceValues[NSURLContentAccessDateKey] timeIntervalSinceReferenceDate];
+        // Both the legacy file without extension and the one with extension exist, keep the newer one
+        SDDiskCacheIndexEntry existingEntry;
+        if ([index getEntry:&existingEntry forDigest:entry.digest]) {
+            if (existingEntry.modificationDate >= entry.modificationDate) {
+                [self.fileManager removeItemAtURL:fileURL error:nil];
+                continue;
+            }
+            [self.fileManager removeItemAtPath:[self cachePathForIndexEntry:&existingEntry] error:nil];
+        }
+        if (![index setEntry:&entry]) {
+            // The index is dropped, the files are used directly
+            break;
+        }
+    }
+}
+
+// Each pass works on a snapshot of the index sorted by the last modification time or last access time (oldest first), the cursor moves from the oldest. Returns YES if the pass finished
+- (BOOL)removeExpiredDataWithIndex:(nonnull SDDiskCacheIndex *)index timeLimit:(NSTimeInterval)timeLimit {
+    CFAbsoluteTime deadline = CFAbsoluteTimeGetCurrent() + timeLimit;
+    BOOL useAccessDate = self.config.diskCacheExpireType == SDImageCacheConfigExpireTypeAccessDate;
+    if (!_expirationEntries) {
+        NSMutableData *entriesData = [[index copyAllEntries] mutableCopy];
+        qsort(entriesData.mutableBytes, entriesData.length / sizeof(SDDiskCacheIndexEntry), sizeof(SDDiskCacheIndexEntry), useAccessDate ? SDDiskCacheIndexEntryCompareAccessDate : SDDiskCacheIndexEntryCompareModificationDate);
+        _expirationEntries = entriesData;
+        _expirationEntryIndex = 0;
+    }
+    const SDDiskCacheIndexEntry *entries = _expirationEntries.bytes;
+    NSUInteger count = _expirationEntries.length / sizeof(SDDiskCacheIndexEntry);
+    NSTimeInterval expirationDate = (self.config.maxDiskAge < 0) ? -DBL_MAX : [NSDate timeIntervalSinceReferenceDate] - self.config.maxDiskAge;
+    NSUInteger maxDiskSize = self.config.maxDiskSize;
+    BOOL finished = NO;
+    while (YES) {
+        if (_expirationEntryIndex >= count) {
+            finished = YES;
+            break;
+        }
+        const SDDiskCacheIndexEntry *entry = &entries[_expirationEntryIndex];
+        NSTimeInterval date = useAccessDate ? entry->accessDate : entry->modificationDate;
+        // If our remaining disk cache exceeds a configured maximum size, delete the oldest files until half of the maximum size
+        NSUInteger currentCacheSize = index.totalSize;
+        if (maxDiskSize > 0 && currentCacheSize > maxDiskSize) {
+            _expirationTrimmingSize = YES;
+        } else if (maxDiskSize == 0 || currentCacheSize < maxDiskSize / 2) {
+            _expirationTrimmingSize = NO;
+        }
+        if (date > expirationDate && !_expirationTrimmingSize) {
+            // The remaining are newer
+            finished = YES;
+            break;
+        }
+        // The entry may be written again after the snapshot
+        SDDiskCacheIndexEntry currentEntry;
+        if ([index getEntry:&currentEntry forDigest:entry->digest] && currentEntry.modificationDate == entry->modificationDate) {
+            [self removeIndexEntry:&currentEntry fromIndex:index];
+        }
+        _expirationEntryIndex++;
+        if (CFAbsoluteTimeGetCurrent() >= deadline) {
+            break;
+        }
+    }
+    if (finished) {
+        _expirationEntries = nil;
+        _expirationEntryIndex = 0;
+        [self pruneLegacyFileNames];
+    }
+    return finished;
+}
+
+- (void)removeIndexEntry:(nonnull const SDDiskCacheIndexEntry *)entry fromIndex:(nonnull SDDiskCacheIndex *)index {
+    [index removeEntry:NULL forDigest:entry->digest];
+    [self.fileManager removeItemAtPath:[self cachePathForIndexEntry:entry] error:nil];
+}
+
+- (nonnull NSString *)cachePathForIndexEntry:(nonnull const SDDiskCacheIndexEntry *)entry {
+    NSString *ext = entry->extension[0] == '\0' ? nil : [NSString stringWithUTF8String:entry->extension];
+    return [self filePathForFileName:SDDiskCacheFileNameForDigest(entry->digest, ext) inPath:self.diskCachePath];
+}
+
 #pragma mark - Cache paths
 
 - (nullable NSString *)cachePathForKey:(nullable NSString *)key inPath:(nonnull NSString *)path {
-    NSString *filename = SDDiskCacheFileNameForKey(key);
-    return [path stringByAppendingPathComponent:filename];
+    return [self cachePathForKey:key inPath:path hashType:_fileNameHashType];
+}
+
+- (nonnull NSString *)cachePathForKey:(nullable NSString *)key inPath:(nonnull NSString *)path hashType:(SDImageCacheConfigFileNameHashType)hashType {
+    uint8_t digest[SD_DISK_CACHE_INDEX_DIGEST_LENGTH];
+    [self getDigest:digest forKey:key hashType:hashType];
+    // The extension is stored in the index slot, which has a smaller length limit
+    NSUInteger maxExtensionLength = _usesIndex ? SD_DISK_CACHE_INDEX_MAX_EXTENSION_LENGTH : SD_MAX_FILE_EXTENSION_LENGTH;
+    NSString *ext;
+    if (hashType == SDImageCacheConfigFileNameHashTypeMD5) {
+        // Keep the same file name as before
+        ext = SDDiskCacheFileExtensionForKey(key, maxExtensionLength);
+    } else {
+        ext = SDDiskCacheFastFileExtensionForKey(key, maxExtensionLength);
+    }
+    NSString *filename = SDDiskCacheFileNameForDigest(digest, ext);
+    return [self filePathForFileName:filename inPath:path];
+}
+
+// The file is in the `ab/cd/` subdirectories by the first 4 hex characters of the file name when fan-out is enabled, so each directory keeps small for a very large cache
+- (nonnull NSString *)filePathForFileName:(nonnull NSString *)fileName inPath:(nonnull NSString *)path {
+    if (!_usesFanOut) {
+        return [path stringByAppendingPathComponent:fileName];
+    }
+    NSString *subpath = [NSString stringWithFormat:@"%@/%@/%@", [fileName substringToIndex:2], [fileName substringWithRange:NSMakeRange(2, 2)], fileName];
+    return [path stringByAppendingPathComponent:subpath];
+}
+
+- (void)getDigest:(nonnull uint8_t *)digest forKey:(nullable NSString *)key hashType:(SDImageCacheConfigFileNameHashType)hashType {
+    const char *str = key.UTF8String;
+    if (str == NULL) {
+        str = "";
+    }
+    if (hashType == SDImageCacheConfigFileNameHashTypeMurmur3) {
+        SDDiskCacheMurmurHash3(str, strlen(str), digest);
+    } else {
+        SDDiskCacheMD5(str, strlen(str), digest);
+    }
+}
+
+// Move the file with the legacy MD5 name to the current name, returns NO if not found. The files are migrated lazily when they're accessed, and the remaining ones are removed by expiration. Only the file names recorded by `loadLegacyFileNames` are looked up, so the misses do not touch the disk once all of them are gone
+- (BOOL)migrateLegacyFileForKey:(nonnull NSString *)key {
+    BOOL movesFlatFiles = _hasFlatFiles && !_usesIndex;
+    BOOL hasLegacyFiles = [self loadLegacyFileNames];
+    if (movesFlatFiles) {
+        // The flat file is just moved into the subdirectory
+        NSString *filePath = [self cachePathForKey:key];
+        if ([self.fileManager fileExistsAtPath:filePath]) {
+            return YES;
+        }
+        if (_fileNameHashType == SDImageCacheConfigFileNameHashTypeMD5 && [self moveItemAtPath:filePath.stringByDeletingPathExtension toPath:filePath]) {
+            return YES;
+        }
+    }
+    if (!hasLegacyFiles) {
+        return NO;
+    }
+    NSString *legacyPath = [self cachePathForKey:key inPath:self.diskCachePath hashType:SDImageCacheConfigFileNameHashTypeMD5];
+    // checking the key with and without the extension, the same as the MD5 file name
+    NSString *legacyFileName = legacyPath.lastPathComponent;
+    SD_LOCK(_legacyLock);
+    if (![_legacyFileNames containsObject:legacyFileName]) {
+        legacyFileName = legacyFileName.stringByDeletingPathExtension;
+        if (![_legacyFileNames containsObject:legacyFileName]) {
+            legacyFileName = nil;
+        }
+    }
+    if (legacyFileName) {
+        [_legacyFileNames removeObject:legacyFileName];
+        if (_legacyFileNames.count == 0) {
+            [self saveLegacyFileNames];
+        }
+    }
+    SD_UNLOCK(_legacyLock);
+    if (!legacyFileName) {
+        return NO;
+    }
+    NSString *filePath = [self cachePathForKey:key];
+    SDDiskCacheIndex *index = [self loadedIndex];
+    if (index) {
+        uint8_t digest[SD_DISK_CACHE_INDEX_DIGEST_LENGTH];
+        [self getDigest:digest forKey:key hashType:SDImageCacheConfigFileNameHashTypeMD5];
+        SDDiskCacheIndexEntry entry;
+        if (![index getEntry:&entry forDigest:digest]) {
+            return NO;
+        }
+        [index removeEntry:NULL forDigest:digest];
+        legacyPath = [self cachePathForIndexEntry:&entry];
+        if (![self moveItemAtPath:legacyPath toPath:filePath]) {
+            // The entry is already removed, don't leave the file out of the index
+            [self.fileManager removeItemAtPath:legacyPath error:nil];
+            return NO;
+        }
+        // Keep the size and dates
+        SDDiskCacheIndexEntryFromFileName(filePath.lastPathComponent, &entry);
+        [index setEntry:&entry];
+        return YES;
+    }
+    legacyPath = [legacyPath.stringByDeletingLastPathComponent stringByAppendingPathComponent:legacyFileName];
+    return [self moveItemAtPath:legacyPath toPath:filePath];
+}
+
+// Returns YES if the legacy files may remain. Only the first call does the work: the files of the flat layout are moved into the subdirectories, and the MD5 file names are recorded when the file name hash is changed. The recorded names are persisted next to the cache directory, so the scan runs once per cache directory
+- (BOOL)loadLegacyFileNames {
+    BOOL migratesHash = _fileNameHashType != SDImageCacheConfigFileNameHashTypeMD5;
+    if (!migratesHash && !_hasFlatFiles) {
+        atomic_store_explicit(&_legacyFileNamesLoaded, true, memory_order_release);
+        return NO;
+    }
+    SD_LOCK(_legacyLock);
+    if (atomic_load_explicit(&_legacyFileNamesLoaded, memory_order_relaxed)) {
+        BOOL hasLegacyFiles = _legacyFileNames.count > 0;
+        SD_UNLOCK(_legacyLock);
+        return hasLegacyFiles;
+    }
+    if (_hasFlatFiles && !_usesIndex) {
+        // The index moves them when loaded
+        [self moveFlatFilesToSubdirectoriesAtPath:self.diskCachePath];
+    }
+    if (migratesHash && !_legacyFileNames) {
+        NSArray<NSString *> *fileNames = [NSArray arrayWithContentsOfFile:[self legacyFileNamesPath]];
+        if (fileNames) {
+            _legacyFileNames = [NSMutableSet setWithArray:fileNames];
+        } else {
+            // The files written before the hash is changed
+            _legacyFileNames = [NSMutableSet setWithArray:[self cacheFileNamesAtPath:self.diskCachePath]];
+            [self saveLegacyFileNames];
+        }
+    }
+    BOOL hasLegacyFiles = _legacyFileNames.count > 0;
+    atomic_store_explicit(&_legacyFileNamesLoaded, true, memory_order_release);
+    SD_UNLOCK(_legacyLock);
+    return hasLegacyFiles;
+}
+
+// The files moved from another cache directory are the legacy ones as well
+- (void)addLegacyFileNames:(nullable NSArray<NSString *> *)fileNames {
+    if (fileNames.count == 0) {
+        return;
+    }
+    [self loadLegacyFileNames];
+    SD_LOCK(_legacyLock);
+    if (_legacyFileNames) {
+        [_legacyFileNames addObjectsFromArray:fileNames];
+        [self saveLegacyFileNames];
+    }
+    SD_UNLOCK(_legacyLock);
+}
+
+- (nonnull NSArray<NSString *> *)cacheFileNamesAtPath:(nonnull NSString *)path {
+    NSMutableArray<NSString *> *fileNames = [NSMutableArray array];
+    NSDirectoryEnumerator<NSString *> *fileEnumerator = [self.fileManager enumeratorAtPath:path];
+    for (NSString *subpath in fileEnumerator) {
+        // The subdirectories and other files do not have the hash prefix
+        NSString *fileName = subpath.lastPathComponent;
+        if (SDDiskCacheFileNameHasDigest(fileName)) {
+            [fileNames addObject:fileName];
+        }
+    }
+    return fileNames;
+}
+
+// Should be called with `_legacyLock`
+- (void)saveLegacyFileNames {
+    [self.fileManager createDirectoryAtPath:self.diskCachePath.stringByDeletingLastPathComponent withIntermediateDirectories:YES attributes:nil error:NULL];
+    [_legacyFileNames.allObjects writeToFile:[self legacyFileNamesPath] atomically:YES];
+}
+
+// Drop the recorded names of the files removed by expiration, so the lookup stops once all of them are gone
+- (void)pruneLegacyFileNames {
+    SD_LOCK(_legacyLock);
+    if (_legacyFileNames.count > 0) {
+        NSUInteger count = _legacyFileNames.count;
+        for (NSString *fileName in _legacyFileNames.allObjects) {
+            if (![self.fileManager fileExistsAtPath:[self filePathForFileName:fileName inPath:self.diskCachePath]]) {
+                [_legacyFileNames removeObject:fileName];
+            }
+        }
+        if (_legacyFileNames.count != count) {
+            [self saveLegacyFileNames];
+        }
+    }
+    SD_UNLOCK(_legacyLock);
+}
+
+// The file is next to the cache directory, the same as the index
+- (nonnull NSString *)legacyFileNamesPath {
+    return [self.diskCachePath stringByAppendingString:@".legacy"];
+}
+
+- (BOOL)moveItemAtPath:(nonnull NSString *)srcPath toPath:(nonnull NSString *)dstPath {
+    if ([self.fileManager moveItemAtPath:srcPath toPath:dstPath error:nil]) {
+        return YES;
+    }
+    // The subdirectory may not exist
+    NSString *directory = dstPath.stringByDeletingLastPathComponent;
+    if (!_usesFanOut || ![self.fileManager fileExistsAtPath:srcPath] || [self.fileManager fileExistsAtPath:directory]) {
+        return NO;
+    }
+    [self.fileManager createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+    return [self.fileManager moveItemAtPath:srcPath toPath:dstPath error:nil];
+}
+
+// Move the cache files of the flat layout into the subdirectories, returns the number of moved files
+- (NSUInteger)moveFlatFilesToSubdirectoriesAtPath:(nonnull NSString *)path {
+    if (!_usesFanOut) {
+        return 0;
+    }
+    NSUInteger count = 0;
+    NSMutableSet<NSString *> *directories = [NSMutableSet set];
+    NSArray<NSString *> *fileNames = [self.fileManager contentsOfDirectoryAtPath:path error:nil];
+    for (NSString *fileName in fileNames) {
+        @autoreleasepool {
+            // The subdirectories and other files do not have the hash prefix
+            if (!SDDiskCacheFileNameHasDigest(fileName)) {
+                continue;
+            }
+            NSString *flatPath = [path stringByAppendingPathComponent:fileName];
+            NSString *filePath = [self filePathForFileName:fileName inPath:path];
+            NSString *directory = filePath.stringByDeletingLastPathComponent;
+            if (![directories containsObject:directory]) {
+                [self.fileManager createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+                [directories addObject:directory];
+            }
+            if ([self.fileManager moveItemAtPath:flatPath toPath:filePath error:nil]) {
+                count++;
+            } else {
+                // The file is written again into the subdirectory, which is newer
+                [self.fileManager removeItemAtPath:flatPath error:nil];
+            }
+        }
+    }
+    if ([path isEqualToString:self.diskCachePath]) {
+        _hasFlatFiles = NO;
+    }
+    return count;
 }
 
 - (void)moveCacheDirectoryFromPath:(nonnull NSString *)srcPath toPath:(nonnull NSString *)dstPath {
@@ -252,6 +1004,10 @@
     NSParameterAssert(dstPath);
     // Check if old path is equal to new path
     if ([srcPath isEqualToString:dstPath]) {
+        // Only move the files of the flat layout into the subdirectories
+        if ([self moveFlatFilesToSubdirectoriesAtPath:dstPath] > 0 && [dstPath isEqualToString:self.diskCachePath]) {
+            [self invalidateIndex];
+        }
         return;
     }
     BOOL isDirectory;
@@ -259,6 +1015,12 @@
     if (![self.fileManager fileExistsAtPath:srcPath isDirectory:&isDirectory] || !isDirectory) {
         return;
     }
+    // The files of the old directory have the legacy names, the current files are recorded before they're merged
+    NSArray<NSString *> *legacyFileNames;
+    if ([dstPath isEqualToString:self.diskCachePath] && _fileNameHashType != SDImageCacheConfigFileNameHashTypeMD5) {
+        [self loadLegacyFileNames];
+        legacyFileNames = [self cacheFileNamesAtPath:srcPath];
+    }
     // Check if new path is directory
     if (![self.fileManager fileExistsAtPath:dstPath isDirectory:&isDirectory] || !isDirectory) {
         if (!isDirectory) {
@@ -282,35 +1044,212 @@
         // Remove the old path
         [self.fileManager removeItemAtPath:srcPath error:nil];
     }
+    [self moveFlatFilesToSubdirectoriesAtPath:dstPath];
+    if ([dstPath isEqualToString:self.diskCachePath]) {
+        [self invalidateIndex];
+        [self addLegacyFileNames:legacyFileNames];
+    }
 }
 
 #pragma mark - Hash
 
-#define SD_MAX_FILE_EXTENSION_LENGTH (NAME_MAX - CC_MD5_DIGEST_LENGTH * 2 - 1)
-
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wdeprecated-declarations"
-// 磁盘图片data 保存路径生成函数
-static inline NSString * _Nonnull SDDiskCacheFileNameForKey(NSString * _Nullable key) {
-    const char *str = key.UTF8String;
-    if (str == NULL) {
-        str = "";
+static inline void SDDiskCacheMD5(const void * _Nonnull data, size_t length, uint8_t * _Nonnull digest) {
+    CC_MD5(data, (CC_LONG)length, digest);
+}
+#pragma clang diagnostic pop
+
+static inline uint64_t SDDiskCacheRotl64(uint64_t x, int8_t r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t SDDiskCacheFmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// MurmurHash3_x64_128 by Austin Appleby, which is in the public domain. The digest is h1 then h2 in little-endian
+void SDDiskCacheMurmurHash3(const void * _Nonnull key, size_t length, uint8_t * _Nonnull digest) {
+    const uint8_t *data = key;
+    const size_t nblocks = length / 16;
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+    uint64_t h1 = 0;
+    uint64_t h2 = 0;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+    for (size_t i = 0; i < nblocks; i++) {
+        memcpy(&k1, data + i * 16, sizeof(k1));
+        memcpy(&k2, data + i * 16 + 8, sizeof(k2));
+        k1 *= c1; k1 = SDDiskCacheRotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = SDDiskCacheRotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= c2; k2 = SDDiskCacheRotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = SDDiskCacheRotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+    const uint8_t *tail = data + nblocks * 16;
+    k1 = 0;
+    k2 = 0;
+    // The cases fall through
+    switch (length & 15) {
+        case 15: k2 ^= (uint64_t)tail[14] << 48;
+        case 14: k2 ^= (uint64_t)tail[13] << 40;
+        case 13: k2 ^= (uint64_t)tail[12] << 32;
+        case 12: k2 ^= (uint64_t)tail[11] << 24;
+        case 11: k2 ^= (uint64_t)tail[10] << 16;
+        case 10: k2 ^= (uint64_t)tail[9] << 8;
+        case 9: k2 ^= (uint64_t)tail[8];
+            k2 *= c2; k2 = SDDiskCacheRotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        case 8: k1 ^= (uint64_t)tail[7] << 56;
+        case 7: k1 ^= (uint64_t)tail[6] << 48;
+        case 6: k1 ^= (uint64_t)tail[5] << 40;
+        case 5: k1 ^= (uint64_t)tail[4] << 32;
+        case 4: k1 ^= (uint64_t)tail[3] << 24;
+        case 3: k1 ^= (uint64_t)tail[2] << 16;
+        case 2: k1 ^= (uint64_t)tail[1] << 8;
+        case 1: k1 ^= (uint64_t)tail[0];
+            k1 *= c1; k1 = SDDiskCacheRotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        default: break;
     }
-    unsigned char r[CC_MD5_DIGEST_LENGTH];
-    CC_MD5(str, (CC_LONG)strlen(str), r);
+    h1 ^= length;
+    h2 ^= length;
+    h1 += h2;
+    h2 += h1;
+    h1 = SDDiskCacheFmix64(h1);
+    h2 = SDDiskCacheFmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    memcpy(digest, &h1, sizeof(h1));
+    memcpy(digest + 8, &h2, sizeof(h2));
+}
+
+static inline NSString * _Nullable SDDiskCacheFileExtensionForKey(NSString * _Nullable key, NSUInteger maxLength) {
     NSURL *keyURL = [NSURL URLWithString:key];
     NSString *ext = keyURL ? keyURL.pathExtension : key.pathExtension;
     // File system has file name length limit, we need to check if ext is too long, we don't add it to the filename
-    if (ext.length > SD_MAX_FILE_EXTENSION_LENGTH) {
+    if ([ext lengthOfBytesUsingEncoding:NSUTF8StringEncoding] > maxLength) {
         ext = nil;
     }
-    NSString *filename = [NSString stringWithFormat:@"%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%@",
-                          r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7], r[8], r[9], r[10],
-                          r[11], r[12], r[13], r[14], r[15], ext.length == 0 ? @"" : [NSString stringWithFormat:@".%@", ext]];
-    return filename;
-    
+    return ext;
+}
+
+// The extension of the last path component without the query and fragment, without parsing the key into `NSURL`
+static inline NSString * _Nullable SDDiskCacheFastFileExtensionForKey(NSString * _Nullable key, NSUInteger maxLength) {
+    const char *str = key.UTF8String;
+    if (str == NULL) {
+        return nil;
+    }
+    size_t end = strcspn(str, "?#");
+    const char *host = strstr(str, "://");
+    if (host && (size_t)(host - str) < end) {
+        // The URL without path, such as `http://example.com`
+        const char *path = strchr(host + 3, '/');
+        if (!path || (size_t)(path - str) >= end) {
+            return nil;
+        }
+    }
+    for (size_t i = end; i > 0; i--) {
+        char c = str[i - 1];
+        if (c == '/') {
+            return nil;
+        }
+        if (c == '.') {
+            size_t length = end - i;
+            // File system has file name length limit, we need to check if ext is too long, we don't add it to the filename
+            if (length == 0 || length > maxLength || i == 1 || str[i - 2] == '/') {
+                return nil;
+            }
+            return [[NSString alloc] initWithBytes:str + i length:length encoding:NSUTF8StringEncoding];
+        }
+    }
+    return nil;
+}
+
+static const char kSDDiskCacheHexTable[] = "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9fa0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebfc0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedfe0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+static inline NSString * _Nonnull SDDiskCacheFileNameForDigest(const uint8_t * _Nonnull r, NSString * _Nullable ext) {
     // 沙盒cache路径 + url的md5 + .图片类型
+    char buffer[NAME_MAX + 1];
+    for (NSUInteger i = 0; i < SD_DISK_CACHE_INDEX_DIGEST_LENGTH; i++) {
+        memcpy(buffer + i * 2, kSDDiskCacheHexTable + r[i] * 2, 2);
+    }
+    size_t length = SD_DISK_CACHE_INDEX_DIGEST_LENGTH * 2;
+    const char *extString = ext.UTF8String;
+    size_t extLength = extString ? strlen(extString) : 0;
+    if (extLength > 0 && length + 1 + extLength <= NAME_MAX) {
+        buffer[length] = '.';
+        memcpy(buffer + length + 1, extString, extLength);
+        length += 1 + extLength;
+    }
+    return [[NSString alloc] initWithBytes:buffer length:length encoding:NSUTF8StringEncoding];
+}
+
+static inline int SDDiskCacheHexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Whether the file name starts with the hex digest, which is a cache file name
+static inline BOOL SDDiskCacheFileNameHasDigest(NSString * _Nonnull fileName) {
+    const char *str = fileName.UTF8String;
+    if (str == NULL || strlen(str) < SD_DISK_CACHE_INDEX_DIGEST_LENGTH * 2) {
+        return NO;
+    }
+    for (NSUInteger i = 0; i < SD_DISK_CACHE_INDEX_DIGEST_LENGTH * 2; i++) {
+        if (SDDiskCacheHexValue(str[i]) < 0) {
+            return NO;
+        }
+    }
+    char next = str[SD_DISK_CACHE_INDEX_DIGEST_LENGTH * 2];
+    return next == '\0' || next == '.';
+}
+
+// Parse the digest and extension from the cache file name, returns NO if it's not a cache file name
+static inline BOOL SDDiskCacheIndexEntryFromFileName(NSString * _Nonnull fileName, SDDiskCacheIndexEntry * _Nonnull entry) {
+    const char *str = fileName.UTF8String;
+    if (str == NULL || strlen(str) < SD_DISK_CACHE_INDEX_DIGEST_LENGTH * 2) {
+        return NO;
+    }
+    for (NSUInteger i = 0; i < SD_DISK_CACHE_INDEX_DIGEST_LENGTH; i++) {
+        int high = SDDiskCacheHexValue(str[i * 2]);
+        int low = SDDiskCacheHexValue(str[i * 2 + 1]);
+        if (high < 0 || low < 0) {
+            return NO;
+        }
+        entry->digest[i] = (uint8_t)(high << 4 | low);
+    }
+    const char *ext = str + SD_DISK_CACHE_INDEX_DIGEST_LENGTH * 2;
+    if (*ext == '\0') {
+        entry->extension[0] = '\0';
+        return YES;
+    }
+    if (*ext != '.' || strlen(ext + 1) > SD_DISK_CACHE_INDEX_MAX_EXTENSION_LENGTH) {
+        return NO;
+    }
+    strlcpy(entry->extension, ext + 1, sizeof(entry->extension));
+    return YES;
+}
+
+static int SDDiskCacheIndexEntryCompareModificationDate(const void *a, const void *b) {
+    NSTimeInterval date1 = ((const SDDiskCacheIndexEntry *)a)->modificationDate;
+    NSTimeInterval date2 = ((const SDDiskCacheIndexEntry *)b)->modificationDate;
+    return (date1 > date2) - (date1 < date2);
+}
+
+static int SDDiskCacheIndexEntryCompareAccessDate(const void *a, const void *b) {
+    NSTimeInterval date1 = ((const SDDiskCacheIndexEntry *)a)->accessDate;
+    NSTimeInterval date2 = ((const SDDiskCacheIndexEntry *)b)->accessDate;
+    return (date1 > date2) - (date1 < date2);
 }
-#pragma clang diagnostic pop
 
 @end
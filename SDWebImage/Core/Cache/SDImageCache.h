@@ -53,6 +53,16 @@ typedef NS_OPTIONS(NSUInteger, SDImageCacheOptions) {
      * Note this options is not compatible with `SDImageCacheDecodeFirstFrameOnly`, which always produce a UIImage/NSImage.
      */
     SDImageCacheMatchAnimatedImageClass = 1 << 7,
+    /**
+     * By default, the async disk queries are served in order. This flag marks the query as low priority, such as the prefetching. The low priority disk queries are sent to the IO queue one by one, so the other disk queries do not wait for a large batch of them. The queued low priority query is skipped without disk IO when it's cancelled, and its decoding runs after the others.
+     * The query with `SDWebImageLowPriority` gets this flag.
+     */
+    SDImageCacheLowPriority = 1 << 8,
+    /**
+     * This flag marks the query as high priority, its decoding runs before the other queued decodings.
+     * The query with `SDWebImageHighPriority` gets this flag.
+     */
+    SDImageCacheHighPriority = 1 << 9,
 };
 
 /**
@@ -76,6 +86,12 @@ typedef NS_OPTIONS(NSUInteger, SDImageCacheOptions) {
  */
 @property (nonatomic, strong, readonly, nonnull) id<SDMemoryCache> memoryCache;
 
+/**
+ * The memory cache for the encoded image data, which is checked before reading the disk cache. The data read from or written to disk cache is stored in it as well.
+ * It's a `SDShardedMemoryCache` using the `SDImageCacheConfig.maxMemoryDataCost` as the cost limit. Nil if the `maxMemoryDataCost` is 0.
+ */
+@property (nonatomic, strong, readonly, nullable) id<SDMemoryCache> memoryDataCache;
+
 /**
  * The disk cache implementation object used for current image cache.
  * By default we use `SDMemoryCache` class, you can also use this to call your own implementation class method.
@@ -266,6 +282,22 @@ typedef NS_OPTIONS(NSUInteger, SDImageCacheOptions) {
  */
 - (nullable NSOperation *)queryCacheOperationForKey:(nullable NSString *)key options:(SDImageCacheOptions)options context:(nullable SDWebImageContext *)context done:(nullable SDImageCacheQueryCompletionBlock)doneBlock;
 
+/**
+ * Asynchronously queries the cache for the keys in one batch and call the completion when done.
+ * The memory cache hits are answered synchronously. The others are read from disk in one block for each IO queue, in order of the keys, then decoded in parallel. So a page of keys costs a few queue hops, instead of one query for each key.
+ * The keys share the in-flight disk queries with the single queries of the same keys. With `SDImageCacheLowPriority`, the keys are sent to the IO queue one by one through the low priority lane, the same as the single low priority query.
+ * @note The sync query options (`SDImageCacheQueryMemoryDataSync` and `SDImageCacheQueryDiskDataSync`) and `SDImageCacheQueryMemoryData` are ignored.
+ *
+ * @param keys          The unique keys used to store the wanted images
+ * @param options       A mask to specify options to use for this cache query
+ * @param context       A context contains different options to perform specify changes or processes, see `SDWebImageContextOption`. This hold the extra objects which `options` enum can not hold.
+ * @param progressBlock The block called for each found image, on the main queue for the disk cache
+ * @param doneBlock     The completion block called once with all the found images
+ *
+ * @return a NSOperation instance containing the cache op, nil if all the keys hit the memory cache
+ */
+- (nullable NSOperation *)queryCacheOperationForKeys:(nonnull NSArray<NSString *> *)keys options:(SDImageCacheOptions)options context:(nullable SDWebImageContext *)context progress:(nullable SDImageCacheBatchQueryProgressBlock)progressBlock done:(nullable SDImageCacheBatchQueryCompletionBlock)doneBlock;
+
 /**
  * Synchronously query the memory cache.
  *
@@ -338,10 +370,25 @@ typedef NS_OPTIONS(NSUInteger, SDImageCacheOptions) {
 
 /**
  * Asynchronously remove all expired cached image from disk. Non-blocking method - returns immediately.
+ * @note When `diskCacheExpirationSliceDuration` of the config is set, the expiration runs in slices, so the disk queries do not wait for the whole cleanup.
  * @param completionBlock A block that should be executed after cache expiration completes (optional)
  */
 - (void)deleteOldFilesWithCompletionBlock:(nullable SDWebImageNoParamsBlock)completionBlock;
 
+#pragma mark - Prewarm Ops
+
+/**
+ * Synchronously save the most recently used keys in memory cache (limited by `config.memoryCachePrewarmCount`), with the memory cost. This is called automatically when the app terminates or enters background.
+ * The keys are saved in the file `<diskCachePath>.hotkeys.plist`, which is outside of the disk cache directory, so it's not counted in the disk cache size.
+ */
+- (void)saveMemoryCacheHotKeys;
+
+/**
+ * Asynchronously load the saved hot keys from disk cache, and decode them into memory cache in background. The keys are queried with `SDImageCacheLowPriority`, so the prewarm does not delay the queries from UI. This is called automatically after the cache initialized when `config.memoryCachePrewarmCount` is not 0.
+ * @param completion A block that should be executed after all the hot keys are loaded (optional)
+ */
+- (void)prewarmMemoryCacheWithCompletion:(nullable SDWebImageNoParamsBlock)completion;
+
 #pragma mark - Cache Info
 
 /**
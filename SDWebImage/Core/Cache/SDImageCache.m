@@ -10,19 +10,57 @@
 #import "NSImage+Compatibility.h"
 #import "SDImageCodersManager.h"
 #import "SDImageTransformer.h"
+#import "SDWebImageCacheSerializer.h"
 #import "SDImageCoderHelper.h"
 #import "SDAnimatedImage.h"
 #import "UIImage+MemoryCacheCost.h"
 #import "UIImage+Metadata.h"
+#import "SDShardedMemoryCache.h"
+#import "SDImageCacheQueryOperation.h"
+#import "SDDiskCacheIndex.h"
+#import "SDInternalMacros.h"
+
+static NSString * const SDImageCacheHotKeyKey = @"key";
+static NSString * const SDImageCacheHotKeyCostKey = @"cost";
+
+// The smaller image is decoded first, so the thumbnails do not wait for the large images queued ahead
+static inline NSOperationQueuePriority SDImageCacheDecodePriorityForData(NSData * _Nonnull data, SDImageCacheOptions options) {
+    // The priority class of the query goes first, then the smaller data
+    if (options & SDImageCacheHighPriority) {
+        return NSOperationQueuePriorityVeryHigh;
+    } else if (options & SDImageCacheLowPriority) {
+        return NSOperationQueuePriorityVeryLow;
+    }
+    if (data.length <= 16 * 1024) {
+        return NSOperationQueuePriorityHigh;
+    } else if (data.length <= 256 * 1024) {
+        return NSOperationQueuePriorityNormal;
+    }
+    return NSOperationQueuePriorityLow;
+}
+
+// The disk queries with the same key and the same decoding options get the same image. The low priority queries are not shared with the others, so they can not hold the visible queries
+static inline NSString * _Nonnull SDImageCacheQueryCoalescingKey(NSString * _Nonnull key, SDImageCacheOptions options, SDWebImageContext * _Nullable context) {
+    SDImageCacheOptions decodeOptions = options & (SDImageCacheScaleDownLargeImages | SDImageCacheDecodeFirstFrameOnly | SDImageCachePreloadAllFrames | SDImageCacheAvoidDecodeImage | SDImageCacheMatchAnimatedImageClass | SDImageCacheLowPriority);
+    NSNumber *scaleFactor = context[SDWebImageContextImageScaleFactor];
+    Class animatedImageClass = context[SDWebImageContextAnimatedImageClass];
+    return [NSString stringWithFormat:@"%lu|%@|%@|%@", (unsigned long)decodeOptions, scaleFactor, NSStringFromClass(animatedImageClass), key];
+}
 
 @interface SDImageCache ()
 
 #pragma mark - Properties
 @property (nonatomic, strong, readwrite, nonnull) id<SDMemoryCache> memoryCache;
+@property (nonatomic, strong, readwrite, nullable) id<SDMemoryCache> memoryDataCache;
 @property (nonatomic, strong, readwrite, nonnull) id<SDDiskCache> diskCache;
 @property (nonatomic, copy, readwrite, nonnull) SDImageCacheConfig *config;
 @property (nonatomic, copy, readwrite, nonnull) NSString *diskCachePath;
 @property (nonatomic, strong, nullable) dispatch_queue_t ioQueue;
+@property (nonatomic, copy, nullable) NSArray<dispatch_queue_t> *ioStripeQueues;
+@property (nonatomic, strong, nonnull) NSOperationQueue *decodeQueue;
+@property (nonatomic, strong, nonnull) NSOperationQueue *lowPriorityQueue;
+@property (nonatomic, strong, nonnull) NSMutableDictionary<NSString *, SDImageCacheQueryOperation *> *pendingQueries;
+@property (nonatomic, strong, nonnull) dispatch_semaphore_t pendingQueriesLock;
 
 @end
 
@@ -67,20 +105,60 @@
     if ((self = [super init])) {
         NSAssert(ns, @"Cache namespace should not be nil");
         
-        // Create IO serial queue
-        // 串行队列 保证磁盘缓存是 串行进行的IO
-        _ioQueue = dispatch_queue_create("com.hackemist.SDImageCache", DISPATCH_QUEUE_SERIAL);
-        
         if (!config) {
             config = SDImageCacheConfig.defaultCacheConfig;
         }
         _config = [config copy];
         
+        // Create IO serial queue
+        // 串行队列 保证磁盘缓存是 串行进行的IO
+        NSUInteger concurrentCount = _config.maxConcurrentDiskOperationCount;
+        if (concurrentCount > 1) {
+            // The operations of one key are serialized on its stripe queue, the stripe queues run concurrently on the IO queue. The whole cache operations are barriers
+            _ioQueue = dispatch_queue_create("com.hackemist.SDImageCache", DISPATCH_QUEUE_CONCURRENT);
+            NSMutableArray<dispatch_queue_t> *stripeQueues = [NSMutableArray arrayWithCapacity:concurrentCount];
+            for (NSUInteger i = 0; i < concurrentCount; i++) {
+                dispatch_queue_t stripeQueue = dispatch_queue_create("com.hackemist.SDImageCache.stripe", DISPATCH_QUEUE_SERIAL);
+                dispatch_set_target_queue(stripeQueue, _ioQueue);
+                [stripeQueues addObject:stripeQueue];
+            }
+            _ioStripeQueues = [stripeQueues copy];
+        } else {
+            _ioQueue = dispatch_queue_create("com.hackemist.SDImageCache", DISPATCH_QUEUE_SERIAL);
+        }
+        
+        // The disk data is decoded out of the IO queue, so the decoding does not block the other disk queries
+        _decodeQueue = [NSOperationQueue new];
+        _decodeQueue.name = @"com.hackemist.SDImageCache.decode";
+        _decodeQueue.maxConcurrentOperationCount = MAX(_config.maxConcurrentDecodeOperationCount, 1);
+        _decodeQueue.qualityOfService = NSQualityOfServiceUserInitiated;
+        // The low priority disk queries are sent to the IO queue one by one, so the other disk queries are queued behind at most one of them
+        _lowPriorityQueue = [NSOperationQueue new];
+        _lowPriorityQueue.name = @"com.hackemist.SDImageCache.lowPriority";
+        _lowPriorityQueue.maxConcurrentOperationCount = 1;
+        _lowPriorityQueue.qualityOfService = NSQualityOfServiceUtility;
+        _pendingQueries = [NSMutableDictionary dictionary];
+        _pendingQueriesLock = dispatch_semaphore_create(1);
+        
         // 初始化内存缓存
         // Init the memory cache
         NSAssert([config.memoryCacheClass conformsToProtocol:@protocol(SDMemoryCache)], @"Custom memory cache class must conform to `SDMemoryCache` protocol");
         _memoryCache = [[config.memoryCacheClass alloc] initWithConfig:_config];
         
+        // 初始化原始数据的内存缓存
+        // Init the encoded data memory cache if need
+        if (_config.maxMemoryDataCost > 0) {
+            SDImageCacheConfig *dataConfig = [_config copy];
+            dataConfig.maxMemoryCost = _config.maxMemoryDataCost;
+            dataConfig.maxMemoryCount = 0;
+            // The budget is for decoded images
+            dataConfig.memoryBudget = nil;
+            // NSData is not held by views, and the cost is the data length, not the decode time
+            dataConfig.shouldUseWeakMemoryCache = NO;
+            dataConfig.memoryCacheEvictionPolicy = SDImageCacheConfigEvictionPolicyLRU;
+            _memoryDataCache = [[SDShardedMemoryCache alloc] initWithConfig:dataConfig];
+        }
+        
         // 初始化磁盘缓存地址
         // Init the disk cache
         if (directory != nil) {
@@ -96,6 +174,11 @@
         
         // Check and migrate disk cache directory if need
         [self migrateDiskCacheDirectory];
+        
+        // Prewarm the memory cache with the hot keys of last launch
+        if (_config.memoryCachePrewarmCount > 0) {
+            [self prewarmMemoryCacheWithCompletion:nil];
+        }
 
 #if SD_UIKIT
         // Subscribe to app events
@@ -138,6 +221,21 @@
     return paths.firstObject;
 }
 
+// The queue for the disk operations of the key. It's the stripe queue by the key hash when the disk operations are concurrent, so the operations of one key keep the order
+- (nonnull dispatch_queue_t)ioQueueForKey:(nonnull NSString *)key {
+    NSArray<dispatch_queue_t> *stripeQueues = self.ioStripeQueues;
+    if (!stripeQueues) {
+        return self.ioQueue;
+    }
+    // `-[NSString hash]` only samples 96 characters of the long strings, so the URLs differing elsewhere get the same queue. Hash the full key
+    const char *str = key.UTF8String ?: "";
+    uint8_t digest[SD_DISK_CACHE_INDEX_DIGEST_LENGTH];
+    SDDiskCacheMurmurHash3(str, strlen(str), digest);
+    uint64_t hash;
+    memcpy(&hash, digest, sizeof(hash));
+    return stripeQueues[hash % stripeQueues.count];
+}
+
 // 迁移磁盘缓存路径
 - (void)migrateDiskCacheDirectory {
     if ([self.diskCache isKindOfClass:[SDDiskCache class]]) {
@@ -147,10 +245,16 @@
             NSString *newDefaultPath = [[[self userCacheDirectory] stringByAppendingPathComponent:@"com.hackemist.SDImageCache"] stringByAppendingPathComponent:@"default"];
             // ~/Library/Caches/default/com.hackemist.SDWebImageCache.default/
             NSString *oldDefaultPath = [[[self userCacheDirectory] stringByAppendingPathComponent:@"default"] stringByAppendingPathComponent:@"com.hackemist.SDWebImageCache.default"];
-            dispatch_async(self.ioQueue, ^{
+            dispatch_barrier_async(self.ioQueue, ^{
                 [((SDDiskCache *)self.diskCache) moveCacheDirectoryFromPath:oldDefaultPath toPath:newDefaultPath];
             });
         });
+        if (self.config.shouldUseDiskCacheDirectoryFanOut) {
+            // Move the files of the flat layout into the subdirectories
+            dispatch_barrier_async(self.ioQueue, ^{
+                [((SDDiskCache *)self.diskCache) moveCacheDirectoryFromPath:self.diskCachePath toPath:self.diskCachePath];
+            });
+        }
     }
 }
 
@@ -204,7 +308,7 @@
     // 存储在磁盘缓存
     // 存储的是 NSdata
     if (toDisk) {
-        dispatch_async(self.ioQueue, ^{
+        dispatch_async([self ioQueueForKey:key], ^{
             @autoreleasepool {
                 NSData *data = imageData;
                 if (!data && image) {
@@ -250,7 +354,7 @@
         return;
     }
     
-    dispatch_sync(self.ioQueue, ^{
+    dispatch_sync([self ioQueueForKey:key], ^{
         [self _storeImageDataToDisk:imageData forKey:key];
     });
 }
@@ -263,12 +367,14 @@
     
     // 存储到磁盘中
     [self.diskCache setData:imageData forKey:key];
+    [self.memoryDataCache setObject:imageData forKey:key cost:imageData.length];
 }
 
 #pragma mark - Query and Retrieve Ops
 
 - (void)diskImageExistsWithKey:(nullable NSString *)key completion:(nullable SDImageCacheCheckCompletionBlock)completionBlock {
-    dispatch_async(self.ioQueue, ^{
+    dispatch_queue_t queue = key ? [self ioQueueForKey:key] : self.ioQueue;
+    dispatch_async(queue, ^{
         BOOL exists = [self _diskImageDataExistsWithKey:key];
         if (completionBlock) {
             dispatch_async(dispatch_get_main_queue(), ^{
@@ -284,7 +390,7 @@
     }
     
     __block BOOL exists = NO;
-    dispatch_sync(self.ioQueue, ^{
+    dispatch_sync([self ioQueueForKey:key], ^{
         exists = [self _diskImageDataExistsWithKey:key];
     });
     
@@ -305,7 +411,7 @@
         return nil;
     }
     __block NSData *imageData = nil;
-    dispatch_sync(self.ioQueue, ^{
+    dispatch_sync([self ioQueueForKey:key], ^{
         imageData = [self diskImageDataBySearchingAllPathsForKey:key];
     });
     
@@ -316,6 +422,32 @@
     return [self.memoryCache objectForKey:key];
 }
 
+// The memory cache image which matches the query options
+- (nullable UIImage *)imageFromMemoryCacheForKey:(nonnull NSString *)key options:(SDImageCacheOptions)options context:(nullable SDWebImageContext *)context {
+    UIImage *image = [self imageFromMemoryCacheForKey:key];
+    if (image) {
+        if (options & SDImageCacheDecodeFirstFrameOnly) {
+            // Ensure static image
+            Class animatedImageClass = image.class;
+            if (image.sd_isAnimated || ([animatedImageClass isSubclassOfClass:[UIImage class]] && [animatedImageClass conformsToProtocol:@protocol(SDAnimatedImage)])) {
+#if SD_MAC
+                image = [[NSImage alloc] initWithCGImage:image.CGImage scale:image.scale orientation:kCGImagePropertyOrientationUp];
+#else
+                image = [[UIImage alloc] initWithCGImage:image.CGImage scale:image.scale orientation:image.imageOrientation];
+#endif
+            }
+        } else if (options & SDImageCacheMatchAnimatedImageClass) {
+            // Check image class matching
+            Class animatedImageClass = image.class;
+            Class desiredImageClass = context[SDWebImageContextAnimatedImageClass];
+            if (desiredImageClass && ![animatedImageClass isSubclassOfClass:desiredImageClass]) {
+                image = nil;
+            }
+        }
+    }
+    return image;
+}
+
 - (nullable UIImage *)imageFromDiskCacheForKey:(nullable NSString *)key {
     UIImage *diskImage = [self diskImageForKey:key];
     if (diskImage && self.config.shouldCacheImagesInMemory) {
@@ -343,18 +475,23 @@
         return nil;
     }
     
-    NSData *data = [self.diskCache dataForKey:key];
+    // Check the encoded data memory tier first, which avoid the disk IO
+    NSData *data = [self.memoryDataCache objectForKey:key];
     if (data) {
         return data;
     }
     
-    // Addtional cache path for custom pre-load cache
-    if (self.additionalCachePathBlock) {
+    data = [self.diskCache dataForKey:key];
+    if (!data && self.additionalCachePathBlock) {
+        // Addtional cache path for custom pre-load cache
         NSString *filePath = self.additionalCachePathBlock(key);
         if (filePath) {
             data = [NSData dataWithContentsOfFile:filePath options:self.config.diskCacheReadingOptions error:nil];
         }
     }
+    if (data) {
+        [self.memoryDataCache setObject:data forKey:key cost:data.length];
+    }
 
     return data;
 }
@@ -377,6 +514,34 @@
     }
 }
 
+// Transform the cached original image like the manager does for the downloaded image, and store the result under the transformed key with the same store cache type and cache serializer, so the next query hits directly
+- (nullable UIImage *)transformedImageFromOriginalImage:(nullable UIImage *)originalImage data:(nullable NSData *)originalData originalKey:(nonnull NSString *)originalKey transformer:(nonnull id<SDImageTransformer>)transformer forKey:(nonnull NSString *)key context:(nullable SDWebImageContext *)context {
+    // The animated image is not transformed by default, keep the miss to let the manager decide
+    if (!originalImage || originalImage.sd_isAnimated) {
+        return nil;
+    }
+    UIImage *transformedImage = [transformer transformedImageWithImage:originalImage forKey:originalKey];
+    if (!transformedImage) {
+        return nil;
+    }
+    SDImageCacheType storeCacheType = SDImageCacheTypeAll;
+    if (context[SDWebImageContextStoreCacheType]) {
+        storeCacheType = [context[SDWebImageContextStoreCacheType] integerValue];
+    }
+    id<SDWebImageCacheSerializer> cacheSerializer = context[SDWebImageContextCacheSerializer];
+    BOOL imageWasTransformed = ![transformedImage isEqual:originalImage];
+    NSData *cacheData;
+    // pass nil if the image was transformed, so we can recalculate the data from the image
+    if (cacheSerializer && (storeCacheType == SDImageCacheTypeDisk || storeCacheType == SDImageCacheTypeAll)) {
+        // The cache key is the URL string unless a cache key filter is used
+        cacheData = [cacheSerializer cacheDataWithImage:transformedImage originalData:(imageWasTransformed ? nil : originalData) imageURL:[NSURL URLWithString:originalKey]];
+    } else {
+        cacheData = (imageWasTransformed ? nil : originalData);
+    }
+    [self storeImage:transformedImage imageData:cacheData forKey:key cacheType:storeCacheType completion:nil];
+    return transformedImage;
+}
+
 - (nullable NSOperation *)queryCacheOperationForKey:(NSString *)key done:(SDImageCacheQueryCompletionBlock)doneBlock {
     return [self queryCacheOperationForKey:key options:0 done:doneBlock];
 }
@@ -394,36 +559,20 @@
     }
     
     id<SDImageTransformer> transformer = context[SDWebImageContextImageTransformer];
+    // The original key to derive the transformed image from, when the transformed image is not cached
+    NSString *originalKey;
     if (transformer) {
         // grab the transformed disk image if transformer provided
         NSString *transformerKey = [transformer transformerKey];
+        if (self.config.shouldDeriveTransformedImageFromOriginal) {
+            originalKey = key;
+        }
         key = SDTransformedKeyForKey(key, transformerKey);
     }
     
     // First check the in-memory cache...
     // 先查询内存缓存 如果找到则直接d回调
-    UIImage *image = [self imageFromMemoryCacheForKey:key];
-    
-    if (image) {
-        if (options & SDImageCacheDecodeFirstFrameOnly) {
-            // Ensure static image
-            Class animatedImageClass = image.class;
-            if (image.sd_isAnimated || ([animatedImageClass isSubclassOfClass:[UIImage class]] && [animatedImageClass conformsToProtocol:@protocol(SDAnimatedImage)])) {
-#if SD_MAC
-                image = [[NSImage alloc] initWithCGImage:image.CGImage scale:image.scale orientation:kCGImagePropertyOrientationUp];
-#else
-                image = [[UIImage alloc] initWithCGImage:image.CGImage scale:image.scale orientation:image.imageOrientation];
-#endif
-            }
-        } else if (options & SDImageCacheMatchAnimatedImageClass) {
-            // Check image class matching
-            Class animatedImageClass = image.class;
-            Class desiredImageClass = context[SDWebImageContextAnimatedImageClass];
-            if (desiredImageClass && ![animatedImageClass isSubclassOfClass:desiredImageClass]) {
-                image = nil;
-            }
-        }
-    }
+    UIImage *image = [self imageFromMemoryCacheForKey:key options:options context:context];
     
     // 是否是只查询内存缓存
     BOOL shouldQueryMemoryOnly = (image && !(options & SDImageCacheQueryMemoryData));
@@ -443,7 +592,34 @@
     // 2. in-memory cache miss & diskDataSync
     BOOL shouldQueryDiskSync = ((image && options & SDImageCacheQueryMemoryDataSync) ||
                                 (!image && options & SDImageCacheQueryDiskDataSync));
-    void(^queryDiskBlock)(void) =  ^{
+    
+    // Coalesce the async disk queries of the same key, the later callers attach to the in-flight query, so the data is read and decoded once
+    NSOperation *token;
+    if (!image && !shouldQueryDiskSync) {
+        NSString *coalescingKey = SDImageCacheQueryCoalescingKey(key, options, context);
+        SD_LOCK(self.pendingQueriesLock);
+        token = [self.pendingQueries[coalescingKey] addWaiterWithDoneBlock:doneBlock];
+        if (token) {
+            SD_UNLOCK(self.pendingQueriesLock);
+            return token;
+        }
+        SDImageCacheQueryOperation *query = [SDImageCacheQueryOperation new];
+        token = [query addWaiterWithDoneBlock:doneBlock];
+        self.pendingQueries[coalescingKey] = query;
+        SD_UNLOCK(self.pendingQueriesLock);
+        operation = query;
+        doneBlock = ^(UIImage * _Nullable diskImage, NSData * _Nullable diskData, SDImageCacheType cacheType) {
+            SD_LOCK(self.pendingQueriesLock);
+            // The cancelled query may be replaced by a new one
+            if (self.pendingQueries[coalescingKey] == query) {
+                [self.pendingQueries removeObjectForKey:coalescingKey];
+            }
+            SD_UNLOCK(self.pendingQueriesLock);
+            [query doneWithImage:diskImage data:diskData cacheType:cacheType];
+        };
+    }
+    // The decode stage, which is on the decode queue for the async query
+    void(^decodeBlock)(NSData *) = ^(NSData *diskData) {
         if (operation.isCancelled) {
             if (doneBlock) {
                 doneBlock(nil, nil, SDImageCacheTypeNone);
@@ -456,7 +632,6 @@
          NSData-> UIImage 转换的时候会产生很多的临时变量需要释放
          */
         @autoreleasepool {
-            NSData *diskData = [self diskImageDataBySearchingAllPathsForKey:key];
             UIImage *diskImage;
             SDImageCacheType cacheType = SDImageCacheTypeNone;
             if (image) {
@@ -486,12 +661,274 @@
         }
     };
     
+    // The decode stage of the transformed image miss, transform the cached original image and store the result under the transformed key
+    void(^deriveBlock)(UIImage *, NSData *) = ^(UIImage *originalImage, NSData *originalData) {
+        if (operation.isCancelled) {
+            if (doneBlock) {
+                doneBlock(nil, nil, SDImageCacheTypeNone);
+            }
+            return;
+        }
+        
+        @autoreleasepool {
+            SDImageCacheType cacheType = originalImage ? SDImageCacheTypeMemory : SDImageCacheTypeDisk;
+            if (!originalImage) {
+                originalImage = [self diskImageForKey:originalKey data:originalData options:options context:context];
+                // Keep the decoded original in memory only if asked, the same as the manager stores the original image
+                SDImageCacheType originalStoreCacheType = [context[SDWebImageContextOriginalStoreCacheType] integerValue];
+                if (originalImage && self.config.shouldCacheImagesInMemory && (originalStoreCacheType == SDImageCacheTypeMemory || originalStoreCacheType == SDImageCacheTypeAll)) {
+                    [self.memoryCache setObject:originalImage forKey:originalKey cost:originalImage.sd_memoryCost];
+                }
+            }
+            UIImage *transformedImage = [self transformedImageFromOriginalImage:originalImage data:originalData originalKey:originalKey transformer:transformer forKey:key context:context];
+            if (!transformedImage) {
+                cacheType = SDImageCacheTypeNone;
+            }
+            
+            if (doneBlock) {
+                if (shouldQueryDiskSync) {
+                    doneBlock(transformedImage, nil, cacheType);
+                } else {
+                    dispatch_async(dispatch_get_main_queue(), ^{
+                        doneBlock(transformedImage, nil, cacheType);
+                    });
+                }
+            }
+        }
+    };
+    
     // Query in ioQueue to keep IO-safe
+    dispatch_queue_t ioQueue = [self ioQueueForKey:key];
     if (shouldQueryDiskSync) {
-        dispatch_sync(self.ioQueue, queryDiskBlock);
+        __block NSData *diskData;
+        __block UIImage *originalImage;
+        __block NSData *originalData;
+        dispatch_sync(ioQueue, ^{
+            @autoreleasepool {
+                diskData = [self diskImageDataBySearchingAllPathsForKey:key];
+                if (!image && !diskData && originalKey) {
+                    originalImage = [self imageFromMemoryCacheForKey:originalKey options:options context:context];
+                    if (!originalImage) {
+                        originalData = [self diskImageDataBySearchingAllPathsForKey:originalKey];
+                    }
+                }
+            }
+        });
+        if (originalImage || originalData) {
+            deriveBlock(originalImage, originalData);
+        } else {
+            decodeBlock(diskData);
+        }
+    } else {
+        // The disk IO stage
+        dispatch_block_t ioBlock = ^{
+            if (operation.isCancelled) {
+                if (doneBlock) {
+                    doneBlock(nil, nil, SDImageCacheTypeNone);
+                }
+                return;
+            }
+            NSData *diskData;
+            @autoreleasepool {
+                diskData = [self diskImageDataBySearchingAllPathsForKey:key];
+            }
+            if (!image && !diskData && originalKey) {
+                // The transformed image missed, try the original image
+                UIImage *originalImage = [self imageFromMemoryCacheForKey:originalKey options:options context:context];
+                NSData *originalData;
+                if (!originalImage) {
+                    @autoreleasepool {
+                        originalData = [self diskImageDataBySearchingAllPathsForKey:originalKey];
+                    }
+                }
+                if (originalImage || originalData) {
+                    NSBlockOperation *deriveOperation = [NSBlockOperation blockOperationWithBlock:^{
+                        deriveBlock(originalImage, originalData);
+                    }];
+                    deriveOperation.queuePriority = originalData ? SDImageCacheDecodePriorityForData(originalData, options) : NSOperationQueuePriorityHigh;
+                    [self.decodeQueue addOperation:deriveOperation];
+                    return;
+                }
+            }
+            if (image || !diskData) {
+                // Nothing to decode
+                decodeBlock(diskData);
+                return;
+            }
+            NSBlockOperation *decodeOperation = [NSBlockOperation blockOperationWithBlock:^{
+                decodeBlock(diskData);
+            }];
+            decodeOperation.queuePriority = SDImageCacheDecodePriorityForData(diskData, options);
+            [self.decodeQueue addOperation:decodeOperation];
+        };
+        if (options & SDImageCacheLowPriority) {
+            // The queued low priority query is skipped without IO when it's cancelled
+            NSBlockOperation *ioOperation = [NSBlockOperation blockOperationWithBlock:^{
+                dispatch_sync(ioQueue, ioBlock);
+            }];
+            [self.lowPriorityQueue addOperation:ioOperation];
+        } else {
+            dispatch_async(ioQueue, ioBlock);
+        }
+    }
+    
+    return token ?: operation;
+}
+
+- (nullable NSOperation *)queryCacheOperationForKeys:(nonnull NSArray<NSString *> *)keys options:(SDImageCacheOptions)options context:(nullable SDWebImageContext *)context progress:(nullable SDImageCacheBatchQueryProgressBlock)progressBlock done:(nullable SDImageCacheBatchQueryCompletionBlock)doneBlock {
+    NSString *transformerKey = [context[SDWebImageContextImageTransformer] transformerKey];
+    NSMutableDictionary<NSString *, UIImage *> *images = [NSMutableDictionary dictionaryWithCapacity:keys.count];
+    // The cache key (transformed) to the input keys
+    NSMutableDictionary<NSString *, NSMutableArray<NSString *> *> *diskKeys = [NSMutableDictionary dictionary];
+    // The cache keys in order of the input keys, which is usually the visible order
+    NSMutableArray<NSString *> *orderedCacheKeys = [NSMutableArray array];
+    
+    // Answer the memory hits immediately
+    for (NSString *key in keys) {
+        NSString *cacheKey = transformerKey ? SDTransformedKeyForKey(key, transformerKey) : key;
+        UIImage *image = [self imageFromMemoryCacheForKey:cacheKey options:options context:context];
+        if (image) {
+            images[key] = image;
+            if (progressBlock) {
+                progressBlock(key, image, nil, SDImageCacheTypeMemory);
+            }
+            continue;
+        }
+        NSMutableArray<NSString *> *inputKeys = diskKeys[cacheKey];
+        if (!inputKeys) {
+            inputKeys = [NSMutableArray arrayWithCapacity:1];
+            diskKeys[cacheKey] = inputKeys;
+            [orderedCacheKeys addObject:cacheKey];
+        }
+        [inputKeys addObject:key];
+    }
+    if (diskKeys.count == 0) {
+        if (doneBlock) {
+            doneBlock([images copy]);
+        }
+        return nil;
+    }
+    
+    // Coalesce with the single queries, the keys in flight attach to the existing queries, and the others are registered, so the later single queries attach to this batch
+    SDImageCacheBatchQueryOperation *operation = [SDImageCacheBatchQueryOperation new];
+    dispatch_semaphore_t lock = dispatch_semaphore_create(1);
+    dispatch_group_t group = dispatch_group_create();
+    NSMutableDictionary<NSString *, SDImageCacheQueryOperation *> *queries = [NSMutableDictionary dictionaryWithCapacity:orderedCacheKeys.count];
+    NSMutableArray<NSString *> *queryKeys = [NSMutableArray arrayWithCapacity:orderedCacheKeys.count];
+    for (NSString *cacheKey in orderedCacheKeys) {
+        NSArray<NSString *> *inputKeys = diskKeys[cacheKey];
+        dispatch_group_enter(group);
+        // Called on the main queue
+        SDImageCacheQueryCompletionBlock waiterBlock = ^(UIImage * _Nullable diskImage, NSData * _Nullable diskData, SDImageCacheType cacheType) {
+            if (diskImage) {
+                SD_LOCK(lock);
+                for (NSString *key in inputKeys) {
+                    images[key] = diskImage;
+                }
+                SD_UNLOCK(lock);
+                if (progressBlock) {
+                    for (NSString *key in inputKeys) {
+                        progressBlock(key, diskImage, diskData, cacheType);
+                    }
+                }
+            }
+            dispatch_group_leave(group);
+        };
+        NSString *coalescingKey = SDImageCacheQueryCoalescingKey(cacheKey, options, context);
+        SD_LOCK(self.pendingQueriesLock);
+        NSOperation *token = [self.pendingQueries[coalescingKey] addWaiterWithDoneBlock:waiterBlock];
+        if (!token) {
+            SDImageCacheQueryOperation *query = [SDImageCacheQueryOperation new];
+            token = [query addWaiterWithDoneBlock:waiterBlock];
+            self.pendingQueries[coalescingKey] = query;
+            queries[cacheKey] = query;
+            [queryKeys addObject:cacheKey];
+        }
+        SD_UNLOCK(self.pendingQueriesLock);
+        [operation addToken:token];
+    }
+    
+    // Resolve the query registered by this batch on the main queue, the same as the single query
+    void(^finishBlock)(NSString *, SDImageCacheQueryOperation *, UIImage *, NSData *) = ^(NSString *cacheKey, SDImageCacheQueryOperation *query, UIImage *diskImage, NSData *diskData) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            NSString *coalescingKey = SDImageCacheQueryCoalescingKey(cacheKey, options, context);
+            SD_LOCK(self.pendingQueriesLock);
+            if (self.pendingQueries[coalescingKey] == query) {
+                [self.pendingQueries removeObjectForKey:coalescingKey];
+            }
+            SD_UNLOCK(self.pendingQueriesLock);
+            [query doneWithImage:diskImage data:diskData cacheType:diskImage ? SDImageCacheTypeDisk : SDImageCacheTypeNone];
+        });
+    };
+    // The disk IO stage of one key, then the decode stage in parallel
+    void(^readBlock)(NSString *) = ^(NSString *cacheKey) {
+        SDImageCacheQueryOperation *query = queries[cacheKey];
+        // The query is cancelled when all the callers attached to it are cancelled
+        if (query.isCancelled) {
+            finishBlock(cacheKey, query, nil, nil);
+            return;
+        }
+        NSData *diskData;
+        @autoreleasepool {
+            diskData = [self diskImageDataBySearchingAllPathsForKey:cacheKey];
+        }
+        if (!diskData) {
+            finishBlock(cacheKey, query, nil, nil);
+            return;
+        }
+        NSBlockOperation *decodeOperation = [NSBlockOperation blockOperationWithBlock:^{
+            @autoreleasepool {
+                UIImage *diskImage = query.isCancelled ? nil : [self diskImageForKey:cacheKey data:diskData options:options context:context];
+                if (diskImage && self.config.shouldCacheImagesInMemory) {
+                    [self.memoryCache setObject:diskImage forKey:cacheKey cost:diskImage.sd_memoryCost];
+                }
+                finishBlock(cacheKey, query, diskImage, diskData);
+            }
+        }];
+        decodeOperation.queuePriority = SDImageCacheDecodePriorityForData(diskData, options);
+        [self.decodeQueue addOperation:decodeOperation];
+    };
+    
+    if (options & SDImageCacheLowPriority) {
+        // The same as the single low priority query, the keys are sent to the IO queue one by one, so the other disk queries do not wait for the whole batch
+        for (NSString *cacheKey in queryKeys) {
+            dispatch_queue_t ioQueue = [self ioQueueForKey:cacheKey];
+            NSBlockOperation *ioOperation = [NSBlockOperation blockOperationWithBlock:^{
+                dispatch_sync(ioQueue, ^{
+                    readBlock(cacheKey);
+                });
+            }];
+            [self.lowPriorityQueue addOperation:ioOperation];
+        }
     } else {
-        dispatch_async(self.ioQueue, queryDiskBlock);
+        // One IO block for each IO queue, the keys of one queue are read in order of the input keys
+        NSMutableArray<dispatch_queue_t> *ioQueues = [NSMutableArray array];
+        NSMutableDictionary<NSValue *, NSMutableArray<NSString *> *> *ioQueueKeys = [NSMutableDictionary dictionary];
+        for (NSString *cacheKey in queryKeys) {
+            dispatch_queue_t ioQueue = [self ioQueueForKey:cacheKey];
+            NSValue *queueValue = [NSValue valueWithNonretainedObject:ioQueue];
+            NSMutableArray<NSString *> *cacheKeys = ioQueueKeys[queueValue];
+            if (!cacheKeys) {
+                cacheKeys = [NSMutableArray array];
+                ioQueueKeys[queueValue] = cacheKeys;
+                [ioQueues addObject:ioQueue];
+            }
+            [cacheKeys addObject:cacheKey];
+        }
+        for (dispatch_queue_t ioQueue in ioQueues) {
+            NSArray<NSString *> *cacheKeys = ioQueueKeys[[NSValue valueWithNonretainedObject:ioQueue]];
+            dispatch_async(ioQueue, ^{
+                for (NSString *cacheKey in cacheKeys) {
+                    readBlock(cacheKey);
+                }
+            });
+        }
     }
+    dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+        if (doneBlock) {
+            doneBlock([images copy]);
+        }
+    });
     
     return operation;
 }
@@ -514,10 +951,14 @@
     if (fromMemory && self.config.shouldCacheImagesInMemory) {
         [self.memoryCache removeObjectForKey:key];
     }
+    // The encoded data is a copy of disk cache, which should be removed in both cases
+    [self.memoryDataCache removeObjectForKey:key];
 
     if (fromDisk) {
-        dispatch_async(self.ioQueue, ^{
+        dispatch_async([self ioQueueForKey:key], ^{
             [self.diskCache removeDataForKey:key];
+            // The queued disk query may fill it again before removal
+            [self.memoryDataCache removeObjectForKey:key];
             
             if (completion) {
                 dispatch_async(dispatch_get_main_queue(), ^{
@@ -536,13 +977,14 @@
     }
     
     [self.memoryCache removeObjectForKey:key];
+    [self.memoryDataCache removeObjectForKey:key];
 }
 
 - (void)removeImageFromDiskForKey:(NSString *)key {
     if (!key) {
         return;
     }
-    dispatch_sync(self.ioQueue, ^{
+    dispatch_sync([self ioQueueForKey:key], ^{
         [self _removeImageFromDiskForKey:key];
     });
 }
@@ -554,17 +996,20 @@
     }
     
     [self.diskCache removeDataForKey:key];
+    [self.memoryDataCache removeObjectForKey:key];
 }
 
 #pragma mark - Cache clean Ops
 
 - (void)clearMemory {
     [self.memoryCache removeAllObjects];
+    [self.memoryDataCache removeAllObjects];
 }
 
 - (void)clearDiskOnCompletion:(nullable SDWebImageNoParamsBlock)completion {
-    dispatch_async(self.ioQueue, ^{
+    dispatch_barrier_async(self.ioQueue, ^{
         [self.diskCache removeAllData];
+        [self.memoryDataCache removeAllObjects];
         if (completion) {
             dispatch_async(dispatch_get_main_queue(), ^{
                 completion();
@@ -574,8 +1019,15 @@
 }
 
 - (void)deleteOldFilesWithCompletionBlock:(nullable SDWebImageNoParamsBlock)completionBlock {
-    dispatch_async(self.ioQueue, ^{
+    NSTimeInterval sliceDuration = self.config.diskCacheExpirationSliceDuration;
+    if (sliceDuration > 0 && [self.diskCache respondsToSelector:@selector(removeExpiredDataWithTimeLimit:)]) {
+        [self deleteOldFilesInSlicesWithDuration:sliceDuration completion:completionBlock];
+        return;
+    }
+    dispatch_barrier_async(self.ioQueue, ^{
         [self.diskCache removeExpiredData];
+        // The disk cache does not report the expired keys, drop the encoded data tier so the expired data is not returned from memory
+        [self.memoryDataCache removeAllObjects];
         if (completionBlock) {
             dispatch_async(dispatch_get_main_queue(), ^{
                 completionBlock();
@@ -584,10 +1036,93 @@
     });
 }
 
+// Each slice is a separate block on the IO queue, so the queries enqueued meanwhile run between the slices
+- (void)deleteOldFilesInSlicesWithDuration:(NSTimeInterval)duration completion:(nullable SDWebImageNoParamsBlock)completionBlock {
+    dispatch_barrier_async(self.ioQueue, ^{
+        if (![self.diskCache removeExpiredDataWithTimeLimit:duration]) {
+            [self deleteOldFilesInSlicesWithDuration:duration completion:completionBlock];
+            return;
+        }
+        [self.memoryDataCache removeAllObjects];
+        if (completionBlock) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completionBlock();
+            });
+        }
+    });
+}
+
+#pragma mark - Prewarm Ops
+
+- (nonnull NSString *)hotKeysPath {
+    // Outside of the disk cache directory, so it does not affect the disk cache size and count
+    return [self.diskCachePath stringByAppendingString:@".hotkeys.plist"];
+}
+
+- (void)saveMemoryCacheHotKeys {
+    NSUInteger limit = self.config.memoryCachePrewarmCount;
+    if (limit == 0 || ![self.memoryCache isKindOfClass:[SDShardedMemoryCache class]]) {
+        return;
+    }
+    NSMutableArray<NSDictionary<NSString *, id> *> *hotKeys = [NSMutableArray arrayWithCapacity:limit];
+    [(SDShardedMemoryCache *)self.memoryCache enumerateHotKeysWithLimit:limit usingBlock:^(id _Nonnull key, NSUInteger cost, BOOL * _Nonnull stop) {
+        if ([key isKindOfClass:[NSString class]]) {
+            [hotKeys addObject:@{SDImageCacheHotKeyKey : key, SDImageCacheHotKeyCostKey : @(cost)}];
+        }
+    }];
+    [hotKeys writeToFile:[self hotKeysPath] atomically:YES];
+}
+
+- (void)prewarmMemoryCacheWithCompletion:(nullable SDWebImageNoParamsBlock)completion {
+    NSUInteger limit = self.config.memoryCachePrewarmCount;
+    if (limit == 0 || !self.config.shouldCacheImagesInMemory) {
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), completion);
+        }
+        return;
+    }
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        NSArray<NSDictionary<NSString *, id> *> *hotKeys = [NSArray arrayWithContentsOfFile:[self hotKeysPath]];
+        NSUInteger costLimit = self.config.maxMemoryCost;
+        NSUInteger countLimit = self.config.maxMemoryCount;
+        NSUInteger totalCost = 0;
+        NSUInteger totalCount = 0;
+        dispatch_group_t group = dispatch_group_create();
+        // The hottest one first
+        for (NSDictionary<NSString *, id> *hotKey in hotKeys) {
+            if (![hotKey isKindOfClass:[NSDictionary class]]) {
+                continue;
+            }
+            NSString *key = hotKey[SDImageCacheHotKeyKey];
+            NSUInteger cost = [hotKey[SDImageCacheHotKeyCostKey] unsignedIntegerValue];
+            if (![key isKindOfClass:[NSString class]]) {
+                continue;
+            }
+            // Do not evict the images loaded by UI
+            if (totalCount >= limit || (countLimit > 0 && totalCount >= countLimit) || (costLimit > 0 && totalCost + cost > costLimit)) {
+                break;
+            }
+            totalCost += cost;
+            totalCount++;
+            // Use the low priority lane, so the prewarm does not compete with the queries from UI at launch. The query skips the key already in memory cache, and stores the decoded image into memory cache.
+            dispatch_group_enter(group);
+            [self queryCacheOperationForKey:key options:SDImageCacheLowPriority context:nil done:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+                dispatch_group_leave(group);
+            }];
+        }
+        dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+            if (completion) {
+                completion();
+            }
+        });
+    });
+}
+
 #pragma mark - UIApplicationWillTerminateNotification
 
 #if SD_UIKIT || SD_MAC
 - (void)applicationWillTerminate:(NSNotification *)notification {
+    [self saveMemoryCacheHotKeys];
     [self deleteOldFilesWithCompletionBlock:nil];
 }
 #endif
@@ -596,6 +1131,8 @@
 
 #if SD_UIKIT
 - (void)applicationDidEnterBackground:(NSNotification *)notification {
+    // The app may be killed in background without termination notification
+    [self saveMemoryCacheHotKeys];
     if (!self.config.shouldRemoveExpiredDataWhenEnterBackground) {
         return;
     }
@@ -623,7 +1160,7 @@
 
 - (NSUInteger)totalDiskSize {
     __block NSUInteger size = 0;
-    dispatch_sync(self.ioQueue, ^{
+    dispatch_barrier_sync(self.ioQueue, ^{
         size = [self.diskCache totalSize];
     });
     return size;
@@ -631,14 +1168,14 @@
 
 - (NSUInteger)totalDiskCount {
     __block NSUInteger count = 0;
-    dispatch_sync(self.ioQueue, ^{
+    dispatch_barrier_sync(self.ioQueue, ^{
         count = [self.diskCache totalCount];
     });
     return count;
 }
 
 - (void)calculateSizeWithCompletionBlock:(nullable SDImageCacheCalculateSizeBlock)completionBlock {
-    dispatch_async(self.ioQueue, ^{
+    dispatch_barrier_async(self.ioQueue, ^{
         NSUInteger fileCount = [self.diskCache totalCount];
         NSUInteger totalSize = [self.diskCache totalSize];
         if (completionBlock) {
@@ -661,14 +1198,7 @@
     return options;
 }
 
-@end
-
-@implementation SDImageCache (SDImageCache)
-
-#pragma mark - SDImageCache
-
-- (id<SDWebImageOperation>)queryImageForKey:(NSString *)key options:(SDWebImageOptions)options context:(nullable SDWebImageContext *)context completion:(nullable SDImageCacheQueryCompletionBlock)completionBlock {
-   
++ (SDImageCacheOptions)cacheOptionsFromImageOptions:(SDWebImageOptions)options {
     SDImageCacheOptions cacheOptions = 0;
     
     if (options & SDWebImageQueryMemoryData) cacheOptions |= SDImageCacheQueryMemoryData;
@@ -687,9 +1217,29 @@
     
     if (options & SDWebImageMatchAnimatedImageClass) cacheOptions |= SDImageCacheMatchAnimatedImageClass;
     
+    if (options & SDWebImageLowPriority) cacheOptions |= SDImageCacheLowPriority;
+    
+    if (options & SDWebImageHighPriority) cacheOptions |= SDImageCacheHighPriority;
+    
+    return cacheOptions;
+}
+
+@end
+
+@implementation SDImageCache (SDImageCache)
+
+#pragma mark - SDImageCache
+
+- (id<SDWebImageOperation>)queryImageForKey:(NSString *)key options:(SDWebImageOptions)options context:(nullable SDWebImageContext *)context completion:(nullable SDImageCacheQueryCompletionBlock)completionBlock {
+    SDImageCacheOptions cacheOptions = [[self class] cacheOptionsFromImageOptions:options];
     return [self queryCacheOperationForKey:key options:cacheOptions context:context done:completionBlock];
 }
 
+- (id<SDWebImageOperation>)queryImagesForKeys:(NSArray<NSString *> *)keys options:(SDWebImageOptions)options context:(nullable SDWebImageContext *)context progress:(nullable SDImageCacheBatchQueryProgressBlock)progressBlock completion:(nullable SDImageCacheBatchQueryCompletionBlock)completionBlock {
+    SDImageCacheOptions cacheOptions = [[self class] cacheOptionsFromImageOptions:options];
+    return [self queryCacheOperationForKeys:keys options:cacheOptions context:context progress:progressBlock done:completionBlock];
+}
+
 // 存储图片
 - (void)storeImage:(UIImage *)image imageData:(NSData *)imageData forKey:(nullable NSString *)key cacheType:(SDImageCacheType)cacheType completion:(nullable SDWebImageNoParamsBlock)completionBlock {
     switch (cacheType) {
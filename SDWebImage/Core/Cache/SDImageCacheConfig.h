@@ -9,6 +9,8 @@
 #import <Foundation/Foundation.h>
 #import "SDWebImageCompat.h"
 
+@class SDImageCacheMemoryBudget;
+
 /// Image Cache Expire Type  图像缓存过期类型
 typedef NS_ENUM(NSUInteger, SDImageCacheConfigExpireType) {
     /** 当图片被访问的时候 就更新这个值
@@ -21,6 +23,43 @@ typedef NS_ENUM(NSUInteger, SDImageCacheConfigExpireType) {
     SDImageCacheConfigExpireTypeModificationDate
 };
 
+/// Memory Cache Admission Policy  内存缓存准入策略
+typedef NS_ENUM(NSUInteger, SDImageCacheConfigAdmissionPolicy) {
+    /** 所有新的图片都直接进入缓存，按照 LRU 淘汰
+     * Every new entry is admitted, the cache evicts in LRU order (Default)
+     */
+    SDImageCacheConfigAdmissionPolicyNone,
+    /** 新的图片先进入一个小的窗口，只有访问频率比将被淘汰的图片更高时才进入主缓存
+     * W-TinyLFU. New entries go into a small LRU window (1% of the capacity), then only get admitted into the main cache when they are accessed more frequently than the entries which would be evicted. The frequency is estimated by a count-min sketch which is aged periodically. This avoids the one-off scans (such as fast scrolling a long list) flushing the hot images.
+     */
+    SDImageCacheConfigAdmissionPolicyTinyLFU
+};
+
+/// Memory Cache Eviction Policy  内存缓存淘汰策略
+typedef NS_ENUM(NSUInteger, SDImageCacheConfigEvictionPolicy) {
+    /** 淘汰最近最少使用的图片
+     * Evict the least recently used entries first (Default)
+     */
+    SDImageCacheConfigEvictionPolicyLRU,
+    /** 淘汰 访问次数 * 解码耗时 / 内存大小 最低的图片
+     * GreedyDual-Size-Frequency. Each entry has a priority `H = L + frequency * decodeTime / memoryCost`, the lowest is evicted first, and `L` is raised to the evicted priority so the entries which are not accessed for a long time can be evicted finally. The decode time is `sd_decodeTime` of the image, recorded by the default image decoding. This keeps the images which are expensive to decode, to reduce the CPU spent on re-decoding.
+     */
+    SDImageCacheConfigEvictionPolicyGDSF
+};
+
+/// Disk Cache File Name Hash Type  磁盘缓存文件名的哈希类型
+typedef NS_ENUM(NSUInteger, SDImageCacheConfigFileNameHashType) {
+    /** 使用 MD5 作为文件名
+     * The file name is the MD5 of the key, the same as the previous versions (Default)
+     */
+    SDImageCacheConfigFileNameHashTypeMD5,
+    /** 使用 MurmurHash3 作为文件名
+     * The file name is the 128-bit MurmurHash3 of the key, which is much faster than MD5. The file name keeps the same length, and the extension is parsed without `NSURL`.
+     * The files named by MD5 are moved to the new file name lazily when they're accessed, the remaining ones are removed by the expiration as usual. Their names are recorded once in a `.legacy` file next to the disk cache directory, so the misses stop looking for them once all of them are gone.
+     */
+    SDImageCacheConfigFileNameHashTypeMurmur3
+};
+
 /**
  The class contains all the config for image cache
  @note This class conform to NSCopying, make sure to add the property in `copyWithZone:` as well.
@@ -66,6 +105,13 @@ typedef NS_ENUM(NSUInteger, SDImageCacheConfigExpireType) {
  */
 @property (assign, nonatomic) NSDataReadingOptions diskCacheReadingOptions;
 
+/** 使用内存映射读取磁盘缓存的文件大小阈值
+ * The minimum file size, in bytes, to read the disk cache by memory mapping (`mmap`). The mapped data is handed to the coders directly, and owned by the decoded image (such as `SDAnimatedImage.animatedImageData`), so the large animated images do not cost their file size in dirty heap memory. The mapping keeps valid when the file is removed or replaced by the cache, and the file is always written atomically when this is enabled.
+ * Defaults to 0. Which means `diskCacheReadingOptions` is used to read the file.
+ * @note This value only works with the built-in `SDDiskCache` class.
+ */
+@property (assign, nonatomic) NSUInteger diskCacheMappedReadingThreshold;
+
 /** 写入磁盘的选项
  * The writing options while writing cache to disk.
  * Defaults to `NSDataWritingAtomic`. You can set this to `NSDataWritingWithoutOverwriting` to prevent overwriting an existing file.
@@ -86,6 +132,63 @@ typedef NS_ENUM(NSUInteger, SDImageCacheConfigExpireType) {
  */
 @property (assign, nonatomic) NSUInteger maxDiskSize;
 
+/** 使用持久化的磁盘缓存索引
+ * Whether or not to use a persistent memory-mapped index for the built-in `SDDiskCache`. The index stores the size, modification date and access date of every file, and is kept in sync on set and remove. So the existence check and read only need one file system access, the total size and count are O(1), and the expiration does not need to enumerate the directory.
+ * The index file is next to the disk cache directory, and is rebuilt from the files when it's missing or invalid.
+ * Defaults to NO.
+ * @note When enabled, the file extension longer than 22 bytes is not added to the cache file name. Don't modify the files in the disk cache directory directly, which makes the index out of sync.
+ * @note This value does not support dynamic changes. Which means further modification on this value after cache initlized has no effect.
+ */
+@property (assign, nonatomic) BOOL shouldUseDiskCacheIndex;
+
+/** 磁盘缓存文件名的哈希类型
+ * The hash function of the cache file name for the built-in `SDDiskCache`. The hash does not need to be cryptographic, it's only used to map the key to a file name, so `SDImageCacheConfigFileNameHashTypeMurmur3` can be used to reduce the CPU spent on every cache query.
+ * Defaults to `SDImageCacheConfigFileNameHashTypeMD5`.
+ * @note This value does not support dynamic changes. Which means further modification on this value after cache initlized has no effect.
+ */
+@property (assign, nonatomic) SDImageCacheConfigFileNameHashType diskCacheFileNameHashType;
+
+/** 磁盘缓存使用两级子目录
+ * Whether or not to store the files of the built-in `SDDiskCache` in two levels of subdirectories by the hash prefix of the file name, such as `ab/cd/abcd...`. This keeps each directory small for a very large disk cache (hundreds of thousands of files), and the cleanup and size calculation enumerate the subdirectories concurrently.
+ * The files of the flat layout are moved into the subdirectories by `moveCacheDirectoryFromPath:toPath:`, which is called by `SDImageCache` on the IO queue after initialization. Before that, all the flat files are moved on the first access of a missing file.
+ * Defaults to NO.
+ * @note This value does not support dynamic changes. Which means further modification on this value after cache initlized has no effect. The files are not moved back to the flat layout when it's disabled again.
+ */
+@property (assign, nonatomic) BOOL shouldUseDiskCacheDirectoryFanOut;
+
+/** 转换图片缓存未命中时从原图生成
+ * Whether or not to derive the transformed image from the cached original image, when the query with `SDWebImageContextImageTransformer` misses the transformed key. The original image is looked up in memory and on disk by the original key, transformed locally, and the result is stored under the transformed key by `SDWebImageContextStoreCacheType` and `SDWebImageContextCacheSerializer`, the same as the manager stores the transformed image. So a new transformer (such as a new thumbnail size) does not download the image again when the original image is cached.
+ * The query callback gets the transformed image without data, and the cache type of the original image.
+ * Defaults to NO.
+ * @note The original image is cached only if it's stored by `SDWebImageContextOriginalStoreCacheType`, or it's loaded without transformer. The original image decoded from disk is kept in memory only if `SDWebImageContextOriginalStoreCacheType` includes memory. The animated original image is not transformed.
+ */
+@property (assign, nonatomic) BOOL shouldDeriveTransformedImageFromOriginal;
+
+/** 分片清理过期磁盘缓存的时长
+ * The maximum time of a slice, in seconds, when removing the expired disk data. The expiration is split into slices on the IO queue, so the disk queries do not wait for the whole cleanup of a large disk cache. For example, 0.005 for 5ms per slice.
+ * Defaults to 0. Which means the expiration runs in one block.
+ * @note When the disk cache is not indexed (see `shouldUseDiskCacheIndex`), the size-based cleanup in slices runs after a full pass, and removes at most the oldest 1000 files found by the pass. The remaining are removed by the next pass if the cache still exceeds the maximum size.
+ * @note The disk cache class should implement `removeExpiredDataWithTimeLimit:`, otherwise this value has no effect.
+ */
+@property (assign, nonatomic) NSTimeInterval diskCacheExpirationSliceDuration;
+
+/** 磁盘缓存的最大并发操作数
+ * The maximum number of concurrent disk operations of `SDImageCache`. When it's greater than 1, the IO queue becomes concurrent: the operations of different keys (read, existence check, write and removal) run concurrently, the operations of the same key keep serialized in order, by striping the keys into this number of serial queues. The whole cache operations (such as clear, expiration and size calculation) still run exclusively.
+ * So a slow read of a large image does not block the reads of other small images.
+ * Defaults to 1. Which means all the disk operations are serialized.
+ * @note The disk cache class should be thread-safe for different keys when this is greater than 1. The built-in `SDDiskCache` and `SDPackDiskCache` are.
+ * @note This value does not support dynamic changes. Which means further modification on this value after cache initlized has no effect.
+ */
+@property (assign, nonatomic) NSUInteger maxConcurrentDiskOperationCount;
+
+/** 磁盘缓存解码的最大并发数
+ * The maximum number of concurrent decodes for the async disk queries of `SDImageCache`. The disk data is read on the IO queue, then decoded on a separate decode queue, so a large decode does not block the other disk queries. The smaller data is decoded first.
+ * Defaults to the number of active processors.
+ * @note The sync disk query (`SDImageCacheQueryDiskDataSync`) decodes on the calling thread.
+ * @note This value does not support dynamic changes. Which means further modification on this value after cache initlized has no effect.
+ */
+@property (assign, nonatomic) NSUInteger maxConcurrentDecodeOperationCount;
+
 /** 内存缓存的最大值
  * The maximum "total cost" of the in-memory image cache. The cost function is the bytes size held in memory.
  * @note The memory cost is bytes size in memory, but not simple pixels count. For common ARGB8888 image, one pixel is 4 bytes (32 bits).
@@ -99,6 +202,53 @@ typedef NS_ENUM(NSUInteger, SDImageCacheConfigExpireType) {
  */
 @property (assign, nonatomic) NSUInteger maxMemoryCount;
 
+/** 多个内存缓存共享的内存预算
+ * The memory budget shared with other caches, such as the caches of different namespaces. The total cost of all the memory caches which use the same budget stays under the budget's limit, see `SDImageCacheMemoryBudget`.
+ * Defaults to nil.
+ * @note This value only works with the built-in `SDShardedMemoryCache` class.
+ * @note This value does not support dynamic changes. Which means further modification on this value after cache initlized has no effect.
+ * @note Since the budget should be shared, we just pass this by reference during copying.
+ */
+@property (strong, nonatomic, nullable) SDImageCacheMemoryBudget *memoryBudget;
+
+/** 在共享内存预算中的权重
+ * The weight of the memory cache in the shared `memoryBudget`. The cache exceeding the `totalCostLimit * weight / totalWeight` is trimmed first when the budget is over limit.
+ * Defaults to 1.
+ * @note This value does not support dynamic changes. Which means further modification on this value after cache initlized has no effect.
+ */
+@property (assign, nonatomic) double memoryBudgetWeight;
+
+/** 内存中缓存的图片原始数据的最大值
+ * The maximum bytes of the encoded image data (the `NSData` from disk or network) kept in memory. This is a separate tier between the decoded image memory cache and the disk cache, so a decoded image which is evicted can be decoded again without disk IO. The encoded data is usually much smaller than the decoded bitmap.
+ * Defaults to 0. Which means the encoded data memory tier is disabled.  默认为 0 不缓存原始数据
+ * @note This value does not support dynamic changes. Which means further modification on this value after cache initlized has no effect.
+ */
+@property (assign, nonatomic) NSUInteger maxMemoryDataCost;
+
+/** 内存缓存预热的图片数量
+ * The number of the most recently used keys in memory cache to be saved when the app terminates or enters background, and be prewarmed (loaded from disk cache and decoded in background, with a bounded concurrency) into memory cache after the next launch. This can make the first screen hit the memory cache.
+ * Defaults to 0. Which means the memory cache is not prewarmed.  默认为 0 不预热
+ * @note The keys are saved in the file next to the disk cache directory, see `-[SDImageCache saveMemoryCacheHotKeys]`. Only the built-in `SDShardedMemoryCache` class supports providing the hot keys.
+ * @note The prewarm stops when the `maxMemoryCost` or `maxMemoryCount` is reached, so it does not evict the images loaded by the UI.
+ */
+@property (assign, nonatomic) NSUInteger memoryCachePrewarmCount;
+
+/** 内存缓存的准入策略
+ * The admission policy of the in-memory image cache.
+ * Defaults to `SDImageCacheConfigAdmissionPolicyNone`.
+ * @note This value only works with the built-in `SDShardedMemoryCache` class. The custom memory cache class can check this value as well.
+ * @note This value does not support dynamic changes. Which means further modification on this value after cache initlized has no effect.
+ */
+@property (assign, nonatomic) SDImageCacheConfigAdmissionPolicy memoryCacheAdmissionPolicy;
+
+/** 内存缓存的淘汰策略
+ * The eviction policy of the in-memory image cache.
+ * Defaults to `SDImageCacheConfigEvictionPolicyLRU`.
+ * @note This value only works with the built-in `SDShardedMemoryCache` class. When using `SDImageCacheConfigEvictionPolicyGDSF`, the `memoryCacheAdmissionPolicy` is ignored.
+ * @note This value does not support dynamic changes. Which means further modification on this value after cache initlized has no effect.
+ */
+@property (assign, nonatomic) SDImageCacheConfigEvictionPolicy memoryCacheEvictionPolicy;
+
 /* 清除磁盘缓存时将根据其检查的属性
  * The attribute which the clear cache will be checked against when clearing the disk cache
  * Default is Modified Date  默认根据修改日期清除缓存
@@ -115,7 +265,7 @@ typedef NS_ENUM(NSUInteger, SDImageCacheConfigExpireType) {
 
 /** 自定义的内存缓存类  提供的类的实例必须遵守 SDMemoryCache 协议才允许使用
  * The custom memory cache class. Provided class instance must conform to `SDMemoryCache` protocol to allow usage.
- * Defaults to built-in `SDMemoryCache` class.
+ * Defaults to built-in `SDMemoryCache` class. You can set this to `SDShardedMemoryCache` class to use the sharded LRU implementation, which is evicted only by `maxMemoryCost`, `maxMemoryCount` and the memory warning, so you should set the limits as well.
  * @note This value does not support dynamic changes. Which means further modification on this value after cache initlized has no effect.
  */
 @property (assign, nonatomic, nonnull) Class memoryCacheClass;
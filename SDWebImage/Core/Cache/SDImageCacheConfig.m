@@ -30,11 +30,22 @@ static const NSInteger kDefaultCacheMaxDiskAge = 60 * 60 * 24 * 7; // 1 week   /
         _shouldUseWeakMemoryCache = YES;   // 默认弱引用内存缓存
         _shouldRemoveExpiredDataWhenEnterBackground = YES;  // APP进入后台的时候，默认删除过期的数据
         _diskCacheReadingOptions = 0;  // NSDataReadingMappedIfSafe 
+        _diskCacheMappedReadingThreshold = 0;  // 默认不使用内存映射读取
         _diskCacheWritingOptions = NSDataWritingAtomic;  // 磁盘写入选项
         _maxDiskAge = kDefaultCacheMaxDiskAge;   // 最大磁盘缓存周期 一周  60 * 60 * 24 * 7
         _maxDiskSize = 0;  // 磁盘缓存的大小没有限制
+        _shouldUseDiskCacheIndex = NO;  // 默认不使用磁盘缓存索引
+        _shouldUseDiskCacheDirectoryFanOut = NO;  // 默认所有文件都在同一个目录
+        _shouldDeriveTransformedImageFromOriginal = NO;  // 默认转换图片未命中时不从原图生成
+        _diskCacheExpirationSliceDuration = 0;  // 默认一次清理完成
+        _maxConcurrentDiskOperationCount = 1;  // 默认磁盘操作串行执行
+        _maxConcurrentDecodeOperationCount = [NSProcessInfo processInfo].activeProcessorCount;  // 默认解码并发数为处理器核数
+        _diskCacheFileNameHashType = SDImageCacheConfigFileNameHashTypeMD5;  // 默认使用 MD5 文件名
         _diskCacheExpireType = SDImageCacheConfigExpireTypeModificationDate;   // 默认根据修改日期清除磁盘缓存
-        _memoryCacheClass = [SDMemoryCache class];    
+        _memoryBudgetWeight = 1;
+        _memoryCacheAdmissionPolicy = SDImageCacheConfigAdmissionPolicyNone;  // 默认不使用准入策略
+        _memoryCacheEvictionPolicy = SDImageCacheConfigEvictionPolicyLRU;  // 默认 LRU 淘汰
+        _memoryCacheClass = [SDMemoryCache class];
         _diskCacheClass = [SDDiskCache class];
     }
     return self;
@@ -47,11 +58,25 @@ static const NSInteger kDefaultCacheMaxDiskAge = 60 * 60 * 24 * 7; // 1 week   /
     config.shouldUseWeakMemoryCache = self.shouldUseWeakMemoryCache;
     config.shouldRemoveExpiredDataWhenEnterBackground = self.shouldRemoveExpiredDataWhenEnterBackground;
     config.diskCacheReadingOptions = self.diskCacheReadingOptions;
+    config.diskCacheMappedReadingThreshold = self.diskCacheMappedReadingThreshold;
     config.diskCacheWritingOptions = self.diskCacheWritingOptions;
     config.maxDiskAge = self.maxDiskAge;
     config.maxDiskSize = self.maxDiskSize;
+    config.shouldUseDiskCacheIndex = self.shouldUseDiskCacheIndex;
+    config.shouldUseDiskCacheDirectoryFanOut = self.shouldUseDiskCacheDirectoryFanOut;
+    config.shouldDeriveTransformedImageFromOriginal = self.shouldDeriveTransformedImageFromOriginal;
+    config.diskCacheExpirationSliceDuration = self.diskCacheExpirationSliceDuration;
+    config.maxConcurrentDiskOperationCount = self.maxConcurrentDiskOperationCount;
+    config.maxConcurrentDecodeOperationCount = self.maxConcurrentDecodeOperationCount;
+    config.diskCacheFileNameHashType = self.diskCacheFileNameHashType;
     config.maxMemoryCost = self.maxMemoryCost;
     config.maxMemoryCount = self.maxMemoryCount;
+    config.memoryBudget = self.memoryBudget; // The budget should be shared, just pass the reference
+    config.memoryBudgetWeight = self.memoryBudgetWeight;
+    config.maxMemoryDataCost = self.maxMemoryDataCost;
+    config.memoryCachePrewarmCount = self.memoryCachePrewarmCount;
+    config.memoryCacheAdmissionPolicy = self.memoryCacheAdmissionPolicy;
+    config.memoryCacheEvictionPolicy = self.memoryCacheEvictionPolicy;
     config.diskCacheExpireType = self.diskCacheExpireType;
     config.fileManager = self.fileManager; // NSFileManager does not conform to NSCopying, just pass the reference
     config.memoryCacheClass = self.memoryCacheClass;
@@ -43,6 +43,10 @@ typedef NSString * _Nullable (^SDImageCacheAdditionalCachePathBlock)(NSString *
 // 查找缓存完成后的回调块
 typedef void(^SDImageCacheQueryCompletionBlock)(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType);
 typedef void(^SDImageCacheContainsCompletionBlock)(SDImageCacheType containsCacheType);
+// 批量查找缓存时，每找到一张图片的回调块
+typedef void(^SDImageCacheBatchQueryProgressBlock)(NSString * _Nonnull key, UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType);
+// 批量查找缓存完成后的回调块，key 为查询的 key，没有找到的 key 不在其中
+typedef void(^SDImageCacheBatchQueryCompletionBlock)(NSDictionary<NSString *, UIImage *> * _Nonnull images);
 
 /** 从缓存中查询图像的解码过程
  This is the built-in decoding process for image query from cache.
@@ -125,4 +129,22 @@ FOUNDATION_EXPORT UIImage * _Nullable SDImageCacheDecodeImageData(NSData * _Nonn
 - (void)clearWithCacheType:(SDImageCacheType)cacheType
                 completion:(nullable SDWebImageNoParamsBlock)completionBlock;
 
+@optional
+/**
+ Query the cached images from image cache for the given keys in one batch. The operation can be used to cancel the query.
+ The memory cache hits are answered synchronously, the others are read from disk and decoded asynchronously in one pass, instead of one query for each key.
+
+ @param keys The image cache keys
+ @param options A mask to specify options to use for this query
+ @param context A context contains different options to perform specify changes or processes, see `SDWebImageContextOption`. This hold the extra objects which `options` enum can not hold.
+ @param progressBlock The block called for each found image, on the main queue for the disk cache. Pass nil if you only need the result of the whole batch
+ @param completionBlock The completion block called once with all the found images, on the main queue if any key is queried from disk
+ @return The operation for this query
+ */
+- (nullable id<SDWebImageOperation>)queryImagesForKeys:(nonnull NSArray<NSString *> *)keys
+                                               options:(SDWebImageOptions)options
+                                               context:(nullable SDWebImageContext *)context
+                                              progress:(nullable SDImageCacheBatchQueryProgressBlock)progressBlock
+                                            completion:(nullable SDImageCacheBatchQueryCompletionBlock)completionBlock;
+
 @end
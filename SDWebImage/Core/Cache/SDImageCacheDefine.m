@@ -11,6 +11,8 @@
 #import "SDImageCoderHelper.h"
 #import "SDAnimatedImage.h"
 #import "UIImage+Metadata.h"
+#import "UIImage+MemoryCacheCost.h"
+#import "SDShardedMemoryCache+Private.h"
 #import "SDInternalMacros.h"
 
 // 主要是对图片进行 Decode 操作 
@@ -26,6 +28,8 @@ UIImage * _Nullable SDImageCacheDecodeImageData(NSData * _Nonnull imageData, NSS
         coderOptions = [mutableCoderOptions copy];
     }
     
+    // Measure the decode cost, used by the memory cache eviction
+    CFAbsoluteTime decodeStartTime = CFAbsoluteTimeGetCurrent();
     if (!decodeFirstFrame) {
         Class animatedImageClass = context[SDWebImageContextAnimatedImageClass];
         // check whether we should use `SDAnimatedImage`
@@ -64,6 +68,9 @@ UIImage * _Nullable SDImageCacheDecodeImageData(NSData * _Nonnull imageData, NSS
                 image = [SDImageCoderHelper decodedImageWithImage:image];
             }
         }
+        if (SDImageCacheShouldRecordDecodeTime()) {
+            image.sd_decodeTime = CFAbsoluteTimeGetCurrent() - decodeStartTime;
+        }
     }
     
     return image;
@@ -0,0 +1,60 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDWebImageCompat.h"
+
+@class SDShardedMemoryCache;
+
+/**
+ A memory budget shared by several memory caches, such as the caches of different namespaces. The total cost of all the registered caches stays under one ceiling.
+ Each cache has a share of the budget by its weight. When the total cost exceeds the limit, only the caches which use more than their share are trimmed, and the least recently used entry among them is evicted first. A cache can use the memory which other caches leave unused.
+ * 多个内存缓存共享一个总的内存预算，超出时按照权重和最近使用情况淘汰
+ @note Set this to `SDImageCacheConfig.memoryBudget`, the `SDShardedMemoryCache` created with the config registers itself automatically. The cache's own `maxMemoryCost` still works as well.
+ */
+@interface SDImageCacheMemoryBudget : NSObject
+
+/**
+ The maximum total cost of all the registered caches. Changing this value trims the caches immediately.
+ Defaults to 0. Which means there is no limit.
+ */
+@property (nonatomic, assign) NSUInteger totalCostLimit;
+
+/**
+ The current total cost of all the registered caches.
+ */
+@property (nonatomic, assign, readonly) NSUInteger totalCost;
+
+/**
+ Create a new budget with the total cost limit.
+
+ @param totalCostLimit The maximum total cost of all the registered caches.
+ @return The new budget instance.
+ */
+- (nonnull instancetype)initWithTotalCostLimit:(NSUInteger)totalCostLimit;
+
+/**
+ Register a memory cache to the budget. The cache is held weakly.
+
+ @param memoryCache The memory cache to register.
+ @param weight The weight to calculate the share of the budget, should be greater than 0. For example, a cache with weight 2 gets twice share of a cache with weight 1.
+ */
+- (void)registerMemoryCache:(nonnull SDShardedMemoryCache *)memoryCache weight:(double)weight;
+
+/**
+ Unregister a memory cache from the budget.
+
+ @param memoryCache The memory cache to unregister.
+ */
+- (void)unregisterMemoryCache:(nonnull SDShardedMemoryCache *)memoryCache;
+
+/**
+ Trim the registered caches until the total cost is under the limit. The caches call this automatically after adding objects.
+ */
+- (void)trimIfNeeded;
+
+@end
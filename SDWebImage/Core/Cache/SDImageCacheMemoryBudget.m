@@ -0,0 +1,140 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDImageCacheMemoryBudget.h"
+#import "SDShardedMemoryCache+Private.h"
+#import "SDInternalMacros.h"
+#import <stdatomic.h>
+
+@interface SDImageCacheMemoryBudget () {
+    atomic_ullong _clock;
+    atomic_llong _totalCost; // running total, each registered cache adds its cost changes, so checking the limit does not need the lock
+}
+
+@property (nonatomic, strong, nonnull) NSMapTable<SDShardedMemoryCache *, NSNumber *> *caches; // weak cache -> weight
+@property (nonatomic, strong, nonnull) dispatch_semaphore_t lock; // protect `caches`
+@property (nonatomic, strong, nonnull) dispatch_semaphore_t trimLock; // only one thread trims at the same time
+
+@end
+
+@implementation SDImageCacheMemoryBudget
+
+- (instancetype)init {
+    return [self initWithTotalCostLimit:0];
+}
+
+- (instancetype)initWithTotalCostLimit:(NSUInteger)totalCostLimit {
+    self = [super init];
+    if (self) {
+        _totalCostLimit = totalCostLimit;
+        _caches = [NSMapTable weakToStrongObjectsMapTable];
+        _lock = dispatch_semaphore_create(1);
+        _trimLock = dispatch_semaphore_create(1);
+        atomic_init(&_clock, 0);
+        atomic_init(&_totalCost, 0);
+    }
+    return self;
+}
+
+- (uint64_t)tick {
+    return atomic_fetch_add_explicit(&_clock, 1, memory_order_relaxed) + 1;
+}
+
+- (void)addCost:(long long)cost {
+    atomic_fetch_add_explicit(&_totalCost, cost, memory_order_relaxed);
+}
+
+- (void)setTotalCostLimit:(NSUInteger)totalCostLimit {
+    _totalCostLimit = totalCostLimit;
+    [self trimIfNeeded];
+}
+
+- (void)registerMemoryCache:(SDShardedMemoryCache *)memoryCache weight:(double)weight {
+    if (!memoryCache) {
+        return;
+    }
+    SD_LOCK(self.lock);
+    BOOL registered = [self.caches objectForKey:memoryCache] != nil;
+    [self.caches setObject:@(weight > 0 ? weight : 1) forKey:memoryCache];
+    if (!registered) {
+        // The later changes are reported by the cache
+        memoryCache.registeredBudget = self;
+        [self addCost:(long long)memoryCache.totalCost];
+    }
+    SD_UNLOCK(self.lock);
+}
+
+- (void)unregisterMemoryCache:(SDShardedMemoryCache *)memoryCache {
+    if (!memoryCache) {
+        return;
+    }
+    SD_LOCK(self.lock);
+    if ([self.caches objectForKey:memoryCache]) {
+        [self.caches removeObjectForKey:memoryCache];
+        memoryCache.registeredBudget = nil;
+        [self addCost:-(long long)memoryCache.totalCost];
+    }
+    SD_UNLOCK(self.lock);
+}
+
+- (NSUInteger)totalCost {
+    long long totalCost = atomic_load_explicit(&_totalCost, memory_order_relaxed);
+    return totalCost > 0 ? (NSUInteger)totalCost : 0;
+}
+
+- (void)trimIfNeeded {
+    NSUInteger totalCostLimit = self.totalCostLimit;
+    if (totalCostLimit == 0 || self.totalCost <= totalCostLimit) {
+        return;
+    }
+    SD_LOCK(self.trimLock);
+    // Snapshot, the caches are retained during trimming
+    SD_LOCK(self.lock);
+    NSMutableArray<SDShardedMemoryCache *> *caches = [NSMutableArray arrayWithCapacity:self.caches.count];
+    NSMutableArray<NSNumber *> *weights = [NSMutableArray arrayWithCapacity:self.caches.count];
+    double totalWeight = 0;
+    for (SDShardedMemoryCache *cache in self.caches.keyEnumerator) {
+        NSNumber *weight = [self.caches objectForKey:cache];
+        [caches addObject:cache];
+        [weights addObject:weight];
+        totalWeight += weight.doubleValue;
+    }
+    SD_UNLOCK(self.lock);
+    
+    // Use the exact costs of the caches during trimming
+    while (YES) {
+        NSUInteger totalCost = 0;
+        for (SDShardedMemoryCache *cache in caches) {
+            totalCost += cache.totalCost;
+        }
+        if (totalCost <= totalCostLimit) {
+            break;
+        }
+        // Only the caches exceeding their share are trimmed, the least recently used entry among them goes first
+        SDShardedMemoryCache *victimCache;
+        uint64_t oldestTime = UINT64_MAX;
+        for (NSUInteger i = 0; i < caches.count; i++) {
+            SDShardedMemoryCache *cache = caches[i];
+            double share = totalCostLimit * weights[i].doubleValue / totalWeight;
+            if (cache.totalCost <= share) {
+                continue;
+            }
+            uint64_t time = [cache oldestAccessTime];
+            if (time < oldestTime) {
+                oldestTime = time;
+                victimCache = cache;
+            }
+        }
+        if (!victimCache || ![victimCache evictOldestObject]) {
+            break;
+        }
+    }
+    SD_UNLOCK(self.trimLock);
+}
+
+@end
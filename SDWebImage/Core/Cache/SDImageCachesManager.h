@@ -17,6 +17,31 @@ typedef NS_ENUM(NSUInteger, SDImageCachesManagerOperationPolicy) {
     SDImageCachesManagerOperationPolicyLowestOnly // process the lowest priority cache only
 };
 
+/**
+ The query statistics of one cache in the caches manager, which is a snapshot. Used for tuning the cache order.
+ */
+@interface SDImageCachesManagerQueryStatistics : NSObject <NSCopying>
+
+/// The number of the completed queries on this cache.
+@property (nonatomic, assign, readonly) NSUInteger queryCount;
+/// The number of the queries which hit (`image` != nil).
+@property (nonatomic, assign, readonly) NSUInteger hitCount;
+/// The hit rate, 0 if no query.
+/// @note A cache after the first one in the `Serial` order is only queried when the former caches miss, so its hit rate is conditional on their misses.
+@property (nonatomic, assign, readonly) double hitRate;
+/// The number of the probes, which are the queries that do not depend on the other caches missing: the first cache of a `Serial` query, or any cache of a `Concurrent` query.
+@property (nonatomic, assign, readonly) NSUInteger probeCount;
+/// The number of the probes which hit.
+@property (nonatomic, assign, readonly) NSUInteger probeHitCount;
+/// The hit rate of the probes, 0 if no probe. This is used to rank the caches.
+@property (nonatomic, assign, readonly) double probeHitRate;
+/// The median query latency in seconds, of the recent queries.
+@property (nonatomic, assign, readonly) NSTimeInterval medianLatency;
+/// The 95th percentile query latency in seconds, of the recent queries.
+@property (nonatomic, assign, readonly) NSTimeInterval p95Latency;
+
+@end
+
 /** 主要是操作  SDImageCache  类，对缓存进行   存储,  删除,  清理,  查询
  A caches manager to manage multiple caches.
  */
@@ -32,15 +57,87 @@ typedef NS_ENUM(NSUInteger, SDImageCachesManagerOperationPolicy) {
 /**
  Operation policy for query op.
  Defaults to `Serial`, means query all caches serially (one completion called then next begin) until one cache query success (`image` != nil).
+ @note For `Concurrent`, the caches race from the highest priority, the first hit wins and the other queries still running are cancelled, so their disk reads and decodes are not wasted. See `queryBackfillCacheType` and `setQueryLatencyBudget:forCache:`.
  */
 @property (nonatomic, assign) SDImageCachesManagerOperationPolicy queryOperationPolicy;
 
+/**
+ The cache type to backfill (promote) the hit image of the `Serial` and `Concurrent` query policy, into the caches with higher priority than the hit cache. The backfill is asynchronous, and does not delay the query completion.
+ For example, use `SDImageCacheTypeMemory` with memory, disk and shared container caches stacked, so the next query hits the fastest cache.
+ Defaults to `SDImageCacheTypeNone`, means no backfill.
+ */
+@property (nonatomic, assign) SDImageCacheType queryBackfillCacheType;
+
+/**
+ Set the latency budget of the cache for the `Concurrent` query policy. If the cache does not complete the query within the budget, its query is cancelled and treated as a miss, so a slow cache can not hold the query which all the other caches missed.
+ 
+ @param budget The budget in seconds. Pass 0 to remove the budget, which is the default.
+ @param cache cache
+ */
+- (void)setQueryLatencyBudget:(NSTimeInterval)budget forCache:(nonnull id<SDImageCache>)cache;
+
+/**
+ Returns the latency budget of the cache for the `Concurrent` query policy, 0 if no budget.
+ 
+ @param cache cache
+ */
+- (NSTimeInterval)queryLatencyBudgetForCache:(nonnull id<SDImageCache>)cache;
+
+/**
+ Whether or not to reorder the caches of the `Serial` query policy by the query statistics, instead of the priority. The cache with the lower expected cost (the median latency divided by the hit rate) is queried first, so a cold cache does not delay the query of the cache which usually hits.
+ The hit rate is the probe hit rate (see `SDImageCachesManagerQueryStatistics.probeHitRate`), because the hit rate of a later cache only counts the keys missed by the former caches. A few sampling queries put each cache first in turn, so every cache gets the probes.
+ The cache keeps its priority order until it has enough probes.
+ Defaults to NO.
+ @note The probes of a cache which is not first are collected slowly (one of the sampling queries per cache), and the `Concurrent` probes after a hit are cancelled and not counted, so the probe hit rate is still an estimate.
+ */
+@property (nonatomic, assign) BOOL shouldAdaptQueryOrder;
+
+/**
+ The minimum hit rate of the cache for the `Serial` query policy, when `shouldAdaptQueryOrder` is YES. The cache with lower hit rate is skipped, except a few sampling queries to keep its statistics fresh.
+ Defaults to 0, means never skip.
+ @note The skipped cache may contain the image, so the query may miss. Use this only for the caches which can be reloaded.
+ */
+@property (nonatomic, assign) double queryMinimumHitRate;
+
+/**
+ Whether or not to record the query statistics when `shouldAdaptQueryOrder` is NO, for `queryStatisticsForCache:`.
+ Defaults to NO, means the queries are only recorded for the adaptive query order.
+ */
+@property (nonatomic, assign) BOOL shouldRecordQueryStatistics;
+
+/**
+ Returns the query statistics snapshot of the cache. The queries of `Serial` and `Concurrent` policy are recorded, when `shouldAdaptQueryOrder` or `shouldRecordQueryStatistics` is YES.
+ 
+ @param cache cache
+ @return The statistics, nil if the cache is never queried
+ */
+- (nullable SDImageCachesManagerQueryStatistics *)queryStatisticsForCache:(nonnull id<SDImageCache>)cache;
+
+/**
+ Reset the query statistics of all caches.
+ */
+- (void)resetQueryStatistics;
+
 /**
  Operation policy for store op.
  Defaults to `HighestOnly`, means store to the highest priority cache only.
  */
 @property (nonatomic, assign) SDImageCachesManagerOperationPolicy storeOperationPolicy;
 
+/**
+ The write-back interval for the `Serial` and `Concurrent` store policy, in seconds. When it's greater than 0, the store op writes the highest priority cache immediately and calls the completion, the other caches are written later when the pending writes are flushed, and the pending write of the same key is replaced by the latest one.
+ The pending writes are dropped when the key is removed, or the caches are cleared, including the ones taken by a flush but not written yet.
+ Defaults to 0, means all the caches are written immediately.
+ */
+@property (nonatomic, assign) NSTimeInterval storeWriteBackInterval;
+
+/**
+ Write the pending stores of `storeWriteBackInterval` to the caches now. For example, call this when the app enters background.
+ 
+ @param completionBlock A block executed after the pending stores are sent to the caches, on the main queue
+ */
+- (void)flushWriteBackWithCompletion:(nullable SDWebImageNoParamsBlock)completionBlock;
+
 /**
  Operation policy for remove op.
  Defaults to `Concurrent`, means remove all caches concurrently.
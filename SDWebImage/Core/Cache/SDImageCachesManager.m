@@ -11,9 +11,122 @@
 #import "SDImageCache.h"
 #import "SDInternalMacros.h"
 
+// The latency samples of the recent queries
+#define SD_CACHES_MANAGER_LATENCY_SAMPLE_COUNT 64
+// The queries needed before the statistics is used for ordering
+static const NSUInteger kSDImageCachesManagerMinimumQueryCount = 20;
+// One of these queries still probes the skipped cache
+static const NSUInteger kSDImageCachesManagerSkippedCacheSampleInterval = 16;
+
+@interface SDImageCachesManagerQueryStatistics ()
+
+@property (nonatomic, assign, readwrite) NSUInteger queryCount;
+@property (nonatomic, assign, readwrite) NSUInteger hitCount;
+@property (nonatomic, assign, readwrite) NSUInteger probeCount;
+@property (nonatomic, assign, readwrite) NSUInteger probeHitCount;
+@property (nonatomic, assign, readwrite) NSTimeInterval medianLatency;
+@property (nonatomic, assign, readwrite) NSTimeInterval p95Latency;
+
+@end
+
+@implementation SDImageCachesManagerQueryStatistics
+{
+    // The recent samples in record order, the oldest is replaced first
+    NSTimeInterval _latencies[SD_CACHES_MANAGER_LATENCY_SAMPLE_COUNT];
+    // The same samples in ascending order, updated with each record, so the median and p95 do not need a sort
+    NSTimeInterval _sortedLatencies[SD_CACHES_MANAGER_LATENCY_SAMPLE_COUNT];
+}
+
+- (double)hitRate {
+    return self.queryCount > 0 ? (double)self.hitCount / self.queryCount : 0;
+}
+
+- (double)probeHitRate {
+    return self.probeCount > 0 ? (double)self.probeHitCount / self.probeCount : 0;
+}
+
+- (void)recordQueryWithLatency:(NSTimeInterval)latency hit:(BOOL)hit probe:(BOOL)probe {
+    NSUInteger count = MIN(self.queryCount, SD_CACHES_MANAGER_LATENCY_SAMPLE_COUNT);
+    NSUInteger slot = self.queryCount % SD_CACHES_MANAGER_LATENCY_SAMPLE_COUNT;
+    if (count == SD_CACHES_MANAGER_LATENCY_SAMPLE_COUNT) {
+        // Remove the replaced sample from the sorted samples
+        NSTimeInterval oldLatency = _latencies[slot];
+        NSUInteger index = 0;
+        while (index < count - 1 && _sortedLatencies[index] != oldLatency) {
+            index++;
+        }
+        memmove(&_sortedLatencies[index], &_sortedLatencies[index + 1], (count - 1 - index) * sizeof(NSTimeInterval));
+        count--;
+    }
+    _latencies[slot] = latency;
+    // Insert the new sample
+    NSUInteger index = count;
+    while (index > 0 && _sortedLatencies[index - 1] > latency) {
+        _sortedLatencies[index] = _sortedLatencies[index - 1];
+        index--;
+    }
+    _sortedLatencies[index] = latency;
+    count++;
+    self.medianLatency = _sortedLatencies[count / 2];
+    self.p95Latency = _sortedLatencies[MIN(count - 1, count * 95 / 100)];
+    self.queryCount++;
+    if (hit) {
+        self.hitCount++;
+    }
+    if (probe) {
+        self.probeCount++;
+        if (hit) {
+            self.probeHitCount++;
+        }
+    }
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    SDImageCachesManagerQueryStatistics *statistics = [[[self class] allocWithZone:zone] init];
+    statistics.queryCount = self.queryCount;
+    statistics.hitCount = self.hitCount;
+    statistics.probeCount = self.probeCount;
+    statistics.probeHitCount = self.probeHitCount;
+    statistics.medianLatency = self.medianLatency;
+    statistics.p95Latency = self.p95Latency;
+    return statistics;
+}
+
+@end
+
+// The maximum pending stores of write-back, they're flushed immediately when it's full
+static const NSUInteger kSDImageCachesManagerMaxPendingStoreCount = 64;
+
+// The pending store of write-back
+@interface SDImageCachesManagerPendingStore : NSObject
+
+@property (nonatomic, strong, nullable) UIImage *image;
+@property (nonatomic, strong, nullable) NSData *imageData;
+@property (nonatomic, assign) SDImageCacheType cacheType;
+@property (nonatomic, assign) NSUInteger generation; // The write-back generation when it's added
+@property (nonatomic, copy, nullable) NSArray<id<SDImageCache>> *caches; // The caches to write, which are not written when it's added, from the lowest priority
+
+@end
+
+@implementation SDImageCachesManagerPendingStore
+
+@end
+
 @interface SDImageCachesManager ()
 
 @property (nonatomic, strong, nonnull) dispatch_semaphore_t cachesLock;
+@property (nonatomic, strong, nonnull) NSMapTable<id<SDImageCache>, NSNumber *> *queryLatencyBudgets;
+@property (nonatomic, strong, nonnull) NSMapTable<id<SDImageCache>, SDImageCachesManagerQueryStatistics *> *queryStatistics;
+@property (nonatomic, strong, nonnull) dispatch_semaphore_t queryStatisticsLock;
+@property (nonatomic, assign) NSUInteger adaptiveQueryCount;
+@property (nonatomic, strong, nonnull) NSMutableDictionary<NSString *, SDImageCachesManagerPendingStore *> *pendingStores;
+@property (nonatomic, strong, nonnull) dispatch_semaphore_t pendingStoresLock;
+@property (nonatomic, assign) BOOL writeBackScheduled;
+// The stores taken by the flush are checked against these before written, so the later remove and clear still win
+@property (nonatomic, assign) NSUInteger writeBackGeneration;
+@property (nonatomic, assign) NSUInteger clearedGeneration;
+@property (nonatomic, strong, nonnull) NSMutableDictionary<NSString *, NSNumber *> *removedGenerations;
+@property (nonatomic, assign) NSUInteger flushingCount;
 
 @end
 
@@ -39,9 +152,20 @@
         self.removeOperationPolicy = SDImageCachesManagerOperationPolicyConcurrent;
         self.containsOperationPolicy = SDImageCachesManagerOperationPolicySerial;
         self.clearOperationPolicy = SDImageCachesManagerOperationPolicyConcurrent;
+        self.queryBackfillCacheType = SDImageCacheTypeNone;
+        self.shouldAdaptQueryOrder = NO;
+        self.shouldRecordQueryStatistics = NO;
+        self.queryMinimumHitRate = 0;
+        self.storeWriteBackInterval = 0;
         // initialize with default image caches
         _imageCaches = [NSMutableArray arrayWithObject:[SDImageCache sharedImageCache]];
         _cachesLock = dispatch_semaphore_create(1);
+        _queryLatencyBudgets = [NSMapTable weakToStrongObjectsMapTable];
+        _queryStatistics = [NSMapTable weakToStrongObjectsMapTable];
+        _queryStatisticsLock = dispatch_semaphore_create(1);
+        _pendingStores = [NSMutableDictionary dictionary];
+        _removedGenerations = [NSMutableDictionary dictionary];
+        _pendingStoresLock = dispatch_semaphore_create(1);
     }
     return self;
 }
@@ -82,6 +206,208 @@
     SD_UNLOCK(self.cachesLock);
 }
 
+- (void)setQueryLatencyBudget:(NSTimeInterval)budget forCache:(id<SDImageCache>)cache {
+    if (!cache) {
+        return;
+    }
+    SD_LOCK(self.cachesLock);
+    if (budget > 0) {
+        [self.queryLatencyBudgets setObject:@(budget) forKey:cache];
+    } else {
+        [self.queryLatencyBudgets removeObjectForKey:cache];
+    }
+    SD_UNLOCK(self.cachesLock);
+}
+
+- (NSTimeInterval)queryLatencyBudgetForCache:(id<SDImageCache>)cache {
+    if (!cache) {
+        return 0;
+    }
+    SD_LOCK(self.cachesLock);
+    NSTimeInterval budget = [[self.queryLatencyBudgets objectForKey:cache] doubleValue];
+    SD_UNLOCK(self.cachesLock);
+    return budget;
+}
+
+#pragma mark - Query Statistics
+
+- (SDImageCachesManagerQueryStatistics *)queryStatisticsForCache:(id<SDImageCache>)cache {
+    if (!cache) {
+        return nil;
+    }
+    SD_LOCK(self.queryStatisticsLock);
+    SDImageCachesManagerQueryStatistics *statistics = [[self.queryStatistics objectForKey:cache] copy];
+    SD_UNLOCK(self.queryStatisticsLock);
+    return statistics;
+}
+
+- (void)resetQueryStatistics {
+    SD_LOCK(self.queryStatisticsLock);
+    [self.queryStatistics removeAllObjects];
+    self.adaptiveQueryCount = 0;
+    SD_UNLOCK(self.queryStatisticsLock);
+}
+
+// The probe is the query which does not depend on the other caches missing
+- (void)recordQueryForCache:(id<SDImageCache>)cache latency:(NSTimeInterval)latency hit:(BOOL)hit probe:(BOOL)probe {
+    if (!self.shouldAdaptQueryOrder && !self.shouldRecordQueryStatistics) {
+        return;
+    }
+    SD_LOCK(self.queryStatisticsLock);
+    SDImageCachesManagerQueryStatistics *statistics = [self.queryStatistics objectForKey:cache];
+    if (!statistics) {
+        statistics = [SDImageCachesManagerQueryStatistics new];
+        [self.queryStatistics setObject:statistics forKey:cache];
+    }
+    [statistics recordQueryWithLatency:latency hit:hit probe:probe];
+    SD_UNLOCK(self.queryStatisticsLock);
+}
+
+// The caches for the serial query, from the highest priority. The ranking uses the probe hit rate, because the hit rate of a later cache only counts the keys missed by the former caches
+- (NSArray<id<SDImageCache>> *)serialQueryOrderForCaches:(NSArray<id<SDImageCache>> *)caches {
+    if (!self.shouldAdaptQueryOrder || caches.count == 0) {
+        return caches;
+    }
+    NSUInteger count = caches.count;
+    NSMutableArray<NSNumber *> *costs = [NSMutableArray arrayWithCapacity:count];
+    NSMutableIndexSet *indexes = [NSMutableIndexSet indexSet];
+    double minimumHitRate = self.queryMinimumHitRate;
+    SD_LOCK(self.queryStatisticsLock);
+    NSUInteger adaptiveQueryCount = self.adaptiveQueryCount++;
+    BOOL isSampling = (adaptiveQueryCount % kSDImageCachesManagerSkippedCacheSampleInterval) == 0;
+    // The sampling query puts the caches first in turn, so each cache gets the probes
+    NSUInteger probeIndex = (adaptiveQueryCount / kSDImageCachesManagerSkippedCacheSampleInterval) % count;
+    for (NSUInteger i = 0; i < count; i++) {
+        // Read in place, the median is updated when the query is recorded
+        SDImageCachesManagerQueryStatistics *statistics = [self.queryStatistics objectForKey:caches[i]];
+        if (statistics.probeCount < kSDImageCachesManagerMinimumQueryCount) {
+            // Not enough probes, keep the priority order to collect the statistics
+            [costs addObject:@(0)];
+            [indexes addIndex:i];
+        } else {
+            double hitRate = statistics.probeHitRate;
+            [costs addObject:@(hitRate > 0 ? statistics.medianLatency / hitRate : INFINITY)];
+            if (isSampling || hitRate >= minimumHitRate) {
+                [indexes addIndex:i];
+            }
+        }
+    }
+    SD_UNLOCK(self.queryStatisticsLock);
+    
+    if (indexes.count == 0) {
+        // Never skip all the caches
+        return caches;
+    }
+    NSMutableArray<NSNumber *> *orderedIndexes = [NSMutableArray arrayWithCapacity:indexes.count];
+    [indexes enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL * _Nonnull stop) {
+        [orderedIndexes addObject:@(idx)];
+    }];
+    // Stable, the same cost keeps the priority order
+    [orderedIndexes sortWithOptions:NSSortStable usingComparator:^NSComparisonResult(NSNumber * _Nonnull index1, NSNumber * _Nonnull index2) {
+        return [costs[index1.unsignedIntegerValue] compare:costs[index2.unsignedIntegerValue]];
+    }];
+    if (isSampling) {
+        [orderedIndexes removeObject:@(probeIndex)];
+        [orderedIndexes insertObject:@(probeIndex) atIndex:0];
+    }
+    NSMutableArray<id<SDImageCache>> *orderedCaches = [NSMutableArray arrayWithCapacity:orderedIndexes.count];
+    for (NSNumber *index in orderedIndexes) {
+        [orderedCaches addObject:caches[index.unsignedIntegerValue]];
+    }
+    return [orderedCaches copy];
+}
+
+#pragma mark - Write-back
+
+- (void)addPendingStoreWithImage:(UIImage *)image imageData:(NSData *)imageData forKey:(NSString *)key cacheType:(SDImageCacheType)cacheType caches:(NSArray<id<SDImageCache>> *)caches {
+    SDImageCachesManagerPendingStore *pendingStore = [SDImageCachesManagerPendingStore new];
+    pendingStore.image = image;
+    pendingStore.imageData = imageData;
+    pendingStore.cacheType = cacheType;
+    pendingStore.caches = caches;
+    SD_LOCK(self.pendingStoresLock);
+    pendingStore.generation = ++self.writeBackGeneration;
+    // The latest store of the key wins
+    self.pendingStores[key] = pendingStore;
+    BOOL isFull = self.pendingStores.count >= kSDImageCachesManagerMaxPendingStoreCount;
+    BOOL shouldSchedule = !isFull && !self.writeBackScheduled;
+    if (shouldSchedule) {
+        self.writeBackScheduled = YES;
+    }
+    SD_UNLOCK(self.pendingStoresLock);
+    if (isFull) {
+        [self flushWriteBackWithCompletion:nil];
+    } else if (shouldSchedule) {
+        @weakify(self);
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.storeWriteBackInterval * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+            @strongify(self);
+            [self flushWriteBackWithCompletion:nil];
+        });
+    }
+}
+
+- (void)flushWriteBackWithCompletion:(SDWebImageNoParamsBlock)completionBlock {
+    SD_LOCK(self.pendingStoresLock);
+    NSDictionary<NSString *, SDImageCachesManagerPendingStore *> *pendingStores = [self.pendingStores copy];
+    [self.pendingStores removeAllObjects];
+    self.writeBackScheduled = NO;
+    BOOL shouldFlush = pendingStores.count > 0;
+    if (shouldFlush) {
+        self.flushingCount++;
+    }
+    SD_UNLOCK(self.pendingStoresLock);
+    
+    if (shouldFlush) {
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+            // The stores are written one by one, the image removed or cleared after the snapshot is skipped
+            [pendingStores enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull key, SDImageCachesManagerPendingStore * _Nonnull pendingStore, BOOL * _Nonnull stop) {
+                for (id<SDImageCache> cache in pendingStore.caches.reverseObjectEnumerator) {
+                    if (![self isPendingStoreValid:pendingStore forKey:key]) {
+                        break;
+                    }
+                    // The cache is not called under lock, it may call back into this manager
+                    [cache storeImage:pendingStore.image imageData:pendingStore.imageData forKey:key cacheType:pendingStore.cacheType completion:nil];
+                    if (![self isPendingStoreValid:pendingStore forKey:key]) {
+                        // Removed or cleared while storing, the remove may be issued to the cache before this store, so remove again
+                        [cache removeImageForKey:key cacheType:pendingStore.cacheType completion:nil];
+                        break;
+                    }
+                }
+            }];
+            SD_LOCK(self.pendingStoresLock);
+            self.flushingCount--;
+            if (self.flushingCount == 0) {
+                [self.removedGenerations removeAllObjects];
+            }
+            SD_UNLOCK(self.pendingStoresLock);
+            if (completionBlock) {
+                dispatch_async(dispatch_get_main_queue(), completionBlock);
+            }
+        });
+    } else if (completionBlock) {
+        dispatch_async(dispatch_get_main_queue(), completionBlock);
+    }
+}
+
+// Whether or not the pending store is still newer than the remove of the key and the clear
+- (BOOL)isPendingStoreValid:(SDImageCachesManagerPendingStore *)pendingStore forKey:(NSString *)key {
+    SD_LOCK(self.pendingStoresLock);
+    NSUInteger removedGeneration = self.removedGenerations[key].unsignedIntegerValue;
+    BOOL isValid = pendingStore.generation > self.clearedGeneration && pendingStore.generation > removedGeneration;
+    SD_UNLOCK(self.pendingStoresLock);
+    return isValid;
+}
+
+// The caches with higher priority than the cache, from the highest priority
+- (NSArray<id<SDImageCache>> *)cachesWithHigherPriorityThanCache:(id<SDImageCache>)cache {
+    NSArray<id<SDImageCache>> *caches = self.caches;
+    NSUInteger index = [caches indexOfObjectIdenticalTo:cache];
+    if (index == NSNotFound || index + 1 >= caches.count) {
+        return @[];
+    }
+    return [caches subarrayWithRange:NSMakeRange(index + 1, caches.count - index - 1)].reverseObjectEnumerator.allObjects;
+}
+
 #pragma mark - SDImageCache
 
 - (id<SDWebImageOperation>)queryImageForKey:(NSString *)key options:(SDWebImageOptions)options context:(SDWebImageContext *)context completion:(SDImageCacheQueryCompletionBlock)completionBlock {
@@ -109,14 +435,15 @@
         case SDImageCachesManagerOperationPolicyConcurrent: {
             SDImageCachesManagerOperation *operation = [SDImageCachesManagerOperation new];
             [operation beginWithTotalCount:caches.count];
-            [self concurrentQueryImageForKey:key options:options context:context completion:completionBlock enumerator:caches.reverseObjectEnumerator operation:operation];
+            [self concurrentQueryImageForKey:key options:options context:context completion:completionBlock caches:caches.reverseObjectEnumerator.allObjects operation:operation];
             return operation;
         }
             break;
         case SDImageCachesManagerOperationPolicySerial: {
             SDImageCachesManagerOperation *operation = [SDImageCachesManagerOperation new];
-            [operation beginWithTotalCount:caches.count];
-            [self serialQueryImageForKey:key options:options context:context completion:completionBlock enumerator:caches.reverseObjectEnumerator operation:operation];
+            NSArray<id<SDImageCache>> *orderedCaches = [self serialQueryOrderForCaches:caches.reverseObjectEnumerator.allObjects];
+            [operation beginWithTotalCount:orderedCaches.count];
+            [self serialQueryImageForKey:key options:options context:context completion:completionBlock enumerator:orderedCaches.objectEnumerator probe:YES operation:operation];
             return operation;
         }
             break;
@@ -138,6 +465,12 @@
         [caches.firstObject storeImage:image imageData:imageData forKey:key cacheType:cacheType completion:completionBlock];
         return;
     }
+    if (self.storeWriteBackInterval > 0 && (self.storeOperationPolicy == SDImageCachesManagerOperationPolicySerial || self.storeOperationPolicy == SDImageCachesManagerOperationPolicyConcurrent)) {
+        // Write the highest priority cache now, the others later
+        [caches.lastObject storeImage:image imageData:imageData forKey:key cacheType:cacheType completion:completionBlock];
+        [self addPendingStoreWithImage:image imageData:imageData forKey:key cacheType:cacheType caches:[caches subarrayWithRange:NSMakeRange(0, count - 1)]];
+        return;
+    }
     switch (self.storeOperationPolicy) {
         case SDImageCachesManagerOperationPolicyHighestOnly: {
             id<SDImageCache> cache = caches.lastObject;
@@ -168,6 +501,13 @@
     if (!key) {
         return;
     }
+    // The removed image should not be written back later, including the in-flight flush
+    SD_LOCK(self.pendingStoresLock);
+    [self.pendingStores removeObjectForKey:key];
+    if (self.flushingCount > 0) {
+        self.removedGenerations[key] = @(self.writeBackGeneration);
+    }
+    SD_UNLOCK(self.pendingStoresLock);
     NSArray<id<SDImageCache>> *caches = self.caches;
     NSUInteger count = caches.count;
     if (count == 0) {
@@ -243,6 +583,11 @@
 }
 
 - (void)clearWithCacheType:(SDImageCacheType)cacheType completion:(SDWebImageNoParamsBlock)completionBlock {
+    SD_LOCK(self.pendingStoresLock);
+    [self.pendingStores removeAllObjects];
+    self.clearedGeneration = self.writeBackGeneration;
+    [self.removedGenerations removeAllObjects];
+    SD_UNLOCK(self.pendingStoresLock);
     NSArray<id<SDImageCache>> *caches = self.caches;
     NSUInteger count = caches.count;
     if (count == 0) {
@@ -279,37 +624,74 @@
 
 #pragma mark - Concurrent Operation
 
-- (void)concurrentQueryImageForKey:(NSString *)key options:(SDWebImageOptions)options context:(SDWebImageContext *)context completion:(SDImageCacheQueryCompletionBlock)completionBlock enumerator:(NSEnumerator<id<SDImageCache>> *)enumerator operation:(SDImageCachesManagerOperation *)operation {
-    NSParameterAssert(enumerator);
+- (void)concurrentQueryImageForKey:(NSString *)key options:(SDWebImageOptions)options context:(SDWebImageContext *)context completion:(SDImageCacheQueryCompletionBlock)completionBlock caches:(NSArray<id<SDImageCache>> *)caches operation:(SDImageCachesManagerOperation *)operation {
+    NSParameterAssert(caches);
     NSParameterAssert(operation);
-    for (id<SDImageCache> cache in enumerator) {
-        [cache queryImageForKey:key options:options context:context completion:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
-            if (operation.isCancelled) {
-                // Cancelled
-                return;
-            }
-            if (operation.isFinished) {
-                // Finished
+    // The caches are ordered from the highest priority, the index is used to cancel the losers and backfill the higher priority caches
+    [caches enumerateObjectsUsingBlock:^(id<SDImageCache>  _Nonnull cache, NSUInteger idx, BOOL * _Nonnull stop) {
+        if (operation.isCancelled || operation.isFinished) {
+            // The higher priority cache hit synchronously, no need to query the others
+            *stop = YES;
+            return;
+        }
+        CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+        id<SDWebImageOperation> subOperation = [cache queryImageForKey:key options:options context:context completion:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+            if (![operation completeOneAtIndex:idx]) {
+                // Cancelled, finished, or skipped by the latency budget
                 return;
             }
-            [operation completeOne];
+            [self recordQueryForCache:cache latency:CFAbsoluteTimeGetCurrent() - startTime hit:image != nil probe:YES];
             if (image) {
                 // Success
-                [operation done];
+                if (![operation tryDone]) {
+                    return;
+                }
+                [operation cancelSubOperationsExceptIndex:idx];
+                [self backfillImage:image imageData:data forKey:key caches:[caches subarrayWithRange:NSMakeRange(0, idx)]];
                 if (completionBlock) {
                     completionBlock(image, data, cacheType);
                 }
                 return;
             }
-            if (operation.pendingCount == 0) {
+            if (operation.pendingCount == 0 && [operation tryDone]) {
                 // Complete
-                [operation done];
                 if (completionBlock) {
                     completionBlock(nil, nil, SDImageCacheTypeNone);
                 }
             }
         }];
+        [operation setSubOperation:subOperation atIndex:idx];
+        
+        NSTimeInterval budget = [self queryLatencyBudgetForCache:cache];
+        if (budget > 0) {
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(budget * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+                if (![operation completeOneAtIndex:idx]) {
+                    // Already completed
+                    return;
+                }
+                // Skip the slow cache
+                [subOperation cancel];
+                if (operation.pendingCount == 0 && [operation tryDone]) {
+                    if (completionBlock) {
+                        completionBlock(nil, nil, SDImageCacheTypeNone);
+                    }
+                }
+            });
+        }
+    }];
+}
+
+- (void)backfillImage:(UIImage *)image imageData:(NSData *)imageData forKey:(NSString *)key caches:(NSArray<id<SDImageCache>> *)caches {
+    SDImageCacheType cacheType = self.queryBackfillCacheType;
+    if (cacheType == SDImageCacheTypeNone || caches.count == 0) {
+        return;
     }
+    // Do not delay the query completion
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        for (id<SDImageCache> cache in caches) {
+            [cache storeImage:image imageData:imageData forKey:key cacheType:cacheType completion:nil];
+        }
+    });
 }
 
 - (void)concurrentStoreImage:(UIImage *)image imageData:(NSData *)imageData forKey:(NSString *)key cacheType:(SDImageCacheType)cacheType completion:(SDWebImageNoParamsBlock)completionBlock enumerator:(NSEnumerator<id<SDImageCache>> *)enumerator operation:(SDImageCachesManagerOperation *)operation {
@@ -422,7 +804,8 @@
 
 #pragma mark - Serial Operation
 
-- (void)serialQueryImageForKey:(NSString *)key options:(SDWebImageOptions)options context:(SDWebImageContext *)context completion:(SDImageCacheQueryCompletionBlock)completionBlock enumerator:(NSEnumerator<id<SDImageCache>> *)enumerator operation:(SDImageCachesManagerOperation *)operation {
+// Only the first cache is queried regardless of the others, which is the probe
+- (void)serialQueryImageForKey:(NSString *)key options:(SDWebImageOptions)options context:(SDWebImageContext *)context completion:(SDImageCacheQueryCompletionBlock)completionBlock enumerator:(NSEnumerator<id<SDImageCache>> *)enumerator probe:(BOOL)probe operation:(SDImageCachesManagerOperation *)operation {
     NSParameterAssert(enumerator);
     NSParameterAssert(operation);
     id<SDImageCache> cache = enumerator.nextObject;
@@ -435,6 +818,7 @@
         return;
     }
     @weakify(self);
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
     [cache queryImageForKey:key options:options context:context completion:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
         @strongify(self);
         if (operation.isCancelled) {
@@ -445,17 +829,19 @@
             // Finished
             return;
         }
+        [self recordQueryForCache:cache latency:CFAbsoluteTimeGetCurrent() - startTime hit:image != nil probe:probe];
         [operation completeOne];
         if (image) {
             // Success
             [operation done];
+            [self backfillImage:image imageData:data forKey:key caches:[self cachesWithHigherPriorityThanCache:cache]];
             if (completionBlock) {
                 completionBlock(image, data, cacheType);
             }
             return;
         }
         // Next
-        [self serialQueryImageForKey:key options:options context:context completion:completionBlock enumerator:enumerator operation:operation];
+        [self serialQueryImageForKey:key options:options context:context completion:completionBlock enumerator:enumerator probe:NO operation:operation];
     }];
 }
 
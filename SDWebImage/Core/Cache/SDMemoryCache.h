@@ -65,6 +65,28 @@
  */
 - (void)removeAllObjects;
 
+@optional
+/**
+ Removes objects from the cache until the total cost is below or equal to the specified value, the least recently used objects are removed first.
+ 
+ @param cost The total cost allowed to remain after the cache has been trimmed.
+ */
+- (void)trimToCost:(NSUInteger)cost;
+
+/**
+ Removes objects from the cache until the total count is below or equal to the specified value, the least recently used objects are removed first.
+ 
+ @param count The total count allowed to remain after the cache has been trimmed.
+ */
+- (void)trimToCount:(NSUInteger)count;
+
+/**
+ Removes objects from the cache until both the total cost and count are below or equal to the specified fraction of the current value, the least recently used objects are removed first. This can be used to release memory gradually under memory pressure, instead of `removeAllObjects`.
+ 
+ @param fraction The fraction allowed to remain after the cache has been trimmed, between 0 and 1. For example, 0.5 removes half of the cache.
+ */
+- (void)trimToFraction:(double)fraction;
+
 @end
 
 /**
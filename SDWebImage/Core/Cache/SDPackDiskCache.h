@@ -0,0 +1,56 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDWebImageCompat.h"
+#import "SDDiskCache.h"
+
+/**
+ A log-structured disk cache for the small images. Set `SDImageCacheConfig.diskCacheClass` to this class to use it.
+ * 小图片追加写入到分段文件中，内存里维护 key -> (分段, 偏移, 长度) 的索引，避免每张图片一个文件带来的文件系统开销
+ * The data which is not larger than `maxPackedDataLength` is appended to the segment files under the `segments` sub-directory, and the index of key -> (segment, offset, length) is kept in memory. The index is rebuilt by scanning the segments in background after initialization, and the access waits until it finished. A removal is recorded as a tombstone record.
+ * The larger data keeps using one file per key, by an internal `SDDiskCache` under the `files` sub-directory.
+ * The space of the removed and overwritten entries is reclaimed by compacting the oldest segments in background, see `compact`.
+ @note For `SDImageCacheConfigExpireTypeAccessDate`, the access date of the packed data is only tracked in memory, it falls back to the modification date after relaunch.
+ @note The packed data does not have a standalone file, `cachePathForKey:` returns the path which the data would be stored if it's larger than `maxPackedDataLength`.
+ */
+@interface SDPackDiskCache : NSObject <SDDiskCache>
+
+/**
+ Cache Config object - storing all kind of settings.
+ */
+@property (nonatomic, strong, readonly, nonnull) SDImageCacheConfig *config;
+
+/**
+ The data whose length is less than or equal to this value is packed into the segment files. The larger one is stored as a separate file.
+ Defaults to 16KB.
+ */
+@property (nonatomic, assign) NSUInteger maxPackedDataLength;
+
+/**
+ The maximum size of a segment file. When the writing segment is full, a new segment is started.
+ Defaults to 4MB.
+ */
+@property (nonatomic, assign) NSUInteger maxSegmentSize;
+
+/**
+ The segments are compacted when the ratio of the dead bytes (the removed and overwritten entries) in the sealed segments exceeds this value.
+ Defaults to 0.5.
+ */
+@property (nonatomic, assign) double compactionRatio;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
+
+/**
+ Reclaims the space of the removed and overwritten entries, if the dead bytes ratio exceeds `compactionRatio`.
+ The oldest segment is compacted first: its live entries are appended to the writing segment, then the segment file is deleted. Only the oldest segment is compacted, so the tombstones in it can be dropped safely.
+ This is called automatically in background after removals, and in `removeExpiredData`.
+ This method blocks the calling thread until the compaction finished, the lock is released between segments.
+ */
+- (void)compact;
+
+@end
@@ -0,0 +1,595 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDPackDiskCache.h"
+#import "SDImageCacheConfig.h"
+#import "SDInternalMacros.h"
+#import <fcntl.h>
+#import <unistd.h>
+
+static NSString * const kSDPackDiskCacheSegmentsDirectory = @"segments";
+static NSString * const kSDPackDiskCacheFilesDirectory = @"files";
+static NSString * const kSDPackDiskCacheSegmentExtension = @"pack";
+
+static const uint32_t kSDPackDiskCacheRecordMagic = 0x4B504453; // "SDPK"
+static const uint32_t kSDPackDiskCacheRecordFlagTombstone = 1 << 0;
+
+// The record is header + key (UTF-8) + data, appended to the segment file. A tombstone record has no data.
+typedef struct SDPackDiskCacheRecordHeader {
+    uint32_t magic;
+    uint32_t flags;
+    uint32_t keyLength;
+    uint32_t dataLength;
+    NSTimeInterval date; // Since reference date
+} SDPackDiskCacheRecordHeader;
+
+static inline void SDPackDiskCacheAppendRecord(NSMutableData * _Nonnull buffer, uint32_t flags, NSData * _Nonnull keyData, NSData * _Nullable data, NSTimeInterval date) {
+    SDPackDiskCacheRecordHeader header = {kSDPackDiskCacheRecordMagic, flags, (uint32_t)keyData.length, (uint32_t)data.length, date};
+    [buffer appendBytes:&header length:sizeof(header)];
+    [buffer appendData:keyData];
+    if (data) {
+        [buffer appendData:data];
+    }
+}
+
+// A segment file. The file descriptor is closed when the segment is deallocated, so the reader which holds the segment can still read after the file is deleted by compaction.
+@interface SDPackDiskCacheSegment : NSObject {
+    @package
+    uint32_t _identifier;
+    int _fd;
+    uint64_t _size;
+    uint64_t _liveSize; // The bytes of the records which are still in index
+    NSMutableSet<NSString *> *_keys;
+}
+
+@end
+
+@implementation SDPackDiskCacheSegment
+
+- (instancetype)initWithIdentifier:(uint32_t)identifier fileDescriptor:(int)fd {
+    if (self = [super init]) {
+        _identifier = identifier;
+        _fd = fd;
+        _keys = [NSMutableSet set];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+@end
+
+@interface SDPackDiskCacheEntry : NSObject {
+    @package
+    SDPackDiskCacheSegment *_segment;
+    uint64_t _offset; // The offset of data in segment
+    uint32_t _length;
+    uint32_t _recordLength;
+    NSTimeInterval _modificationDate;
+    NSTimeInterval _accessDate;
+}
+
+@end
+
+@implementation SDPackDiskCacheEntry
+@end
+
+@interface SDPackDiskCache () {
+    NSMutableDictionary<NSString *, SDPackDiskCacheEntry *> *_entries;
+    NSMutableArray<SDPackDiskCacheSegment *> *_segments; // Sorted by identifier, the last one is the writing segment
+    uint64_t _packedSize; // The data length of the entries in index
+    BOOL _compactionScheduled;
+    dispatch_semaphore_t _lock;
+    dispatch_queue_t _compactionQueue;
+    dispatch_group_t _loadGroup; // The replay of the segments, the access waits until it finished
+}
+
+@property (nonatomic, copy) NSString *diskCachePath;
+@property (nonatomic, copy) NSString *segmentsPath;
+@property (nonatomic, strong, nonnull) NSFileManager *fileManager;
+@property (nonatomic, strong, nonnull) SDDiskCache *fileCache;
+
+@end
+
+@implementation SDPackDiskCache
+
+- (instancetype)init {
+    NSAssert(NO, @"Use `initWithCachePath:` with the disk cache path");
+    return nil;
+}
+
+#pragma mark - SDDiskCache Protocol
+- (instancetype)initWithCachePath:(NSString *)cachePath config:(nonnull SDImageCacheConfig *)config {
+    if (self = [super init]) {
+        _diskCachePath = [cachePath copy];
+        _segmentsPath = [cachePath stringByAppendingPathComponent:kSDPackDiskCacheSegmentsDirectory];
+        _config = config;
+        _maxPackedDataLength = 16 * 1024;
+        _maxSegmentSize = 4 * 1024 * 1024;
+        _compactionRatio = 0.5;
+        _entries = [NSMutableDictionary dictionary];
+        _segments = [NSMutableArray array];
+        _lock = dispatch_semaphore_create(1);
+        _compactionQueue = dispatch_queue_create("com.hackemist.SDPackDiskCache", dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
+        if (config.fileManager) {
+            _fileManager = config.fileManager;
+        } else {
+            _fileManager = [NSFileManager new];
+        }
+        // Use a sub-directory, so the expiration of `SDDiskCache` does not touch the segment files. The config is copied because the size limit is shared with the packed data, see `removeExpiredData`
+        _fileCache = [[SDDiskCache alloc] initWithCachePath:[cachePath stringByAppendingPathComponent:kSDPackDiskCacheFilesDirectory] config:[config copy]];
+        // The cache is usually created on the main thread, replay the segments in background instead of blocking the launch
+        _loadGroup = dispatch_group_create();
+        dispatch_group_async(_loadGroup, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+            SD_LOCK(self->_lock);
+            [self loadSegments];
+            SD_UNLOCK(self->_lock);
+        });
+    }
+    return self;
+}
+
+- (void)waitUntilLoaded {
+    dispatch_group_wait(_loadGroup, DISPATCH_TIME_FOREVER);
+}
+
+- (BOOL)containsDataForKey:(NSString *)key {
+    NSParameterAssert(key);
+    [self waitUntilLoaded];
+    SD_LOCK(_lock);
+    BOOL exists = _entries[key] != nil;
+    SD_UNLOCK(_lock);
+    if (exists) {
+        return YES;
+    }
+    return [self.fileCache containsDataForKey:key];
+}
+
+- (NSData *)dataForKey:(NSString *)key {
+    NSParameterAssert(key);
+    [self waitUntilLoaded];
+    SDPackDiskCacheSegment *segment;
+    uint64_t offset = 0;
+    uint32_t length = 0;
+    SD_LOCK(_lock);
+    SDPackDiskCacheEntry *entry = _entries[key];
+    if (entry) {
+        segment = entry->_segment;
+        offset = entry->_offset;
+        length = entry->_length;
+        entry->_accessDate = [NSDate timeIntervalSinceReferenceDate];
+    }
+    SD_UNLOCK(_lock);
+    if (!segment) {
+        return [self.fileCache dataForKey:key];
+    }
+
+    // The segment is appended only, read without lock
+    void *bytes = malloc(MAX(length, 1));
+    if (!bytes) {
+        return nil;
+    }
+    if (pread(segment->_fd, bytes, length, (off_t)offset) != (ssize_t)length) {
+        free(bytes);
+        return nil;
+    }
+    return [NSData dataWithBytesNoCopy:bytes length:length freeWhenDone:YES];
+}
+
+- (void)setData:(NSData *)data forKey:(NSString *)key {
+    NSParameterAssert(data);
+    NSParameterAssert(key);
+    [self waitUntilLoaded];
+    if (data.length > MIN(self.maxPackedDataLength, UINT32_MAX)) {
+        SD_LOCK(_lock);
+        BOOL packed = _entries[key] != nil;
+        BOOL removed = packed && [self removePackedDataForKeys:@[key]];
+        SD_UNLOCK(_lock);
+        if (packed && !removed) {
+            // The tombstone is not written, the packed data would shadow the file
+            return;
+        }
+        [self.fileCache setData:data forKey:key];
+        if (removed) {
+            [self scheduleCompactionIfNeeded];
+        }
+        return;
+    }
+
+    NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+    NSTimeInterval date = [NSDate timeIntervalSinceReferenceDate];
+    NSMutableData *record = [NSMutableData dataWithCapacity:sizeof(SDPackDiskCacheRecordHeader) + keyData.length + data.length];
+    SDPackDiskCacheAppendRecord(record, 0, keyData, data, date);
+
+    SD_LOCK(_lock);
+    uint64_t offset = 0;
+    SDPackDiskCacheSegment *segment = [self appendRecords:record offset:&offset];
+    BOOL overwritten = NO;
+    if (segment) {
+        overwritten = [self removeEntryForKey:key];
+        [self addEntryForKey:key segment:segment offset:offset + sizeof(SDPackDiskCacheRecordHeader) + keyData.length length:(uint32_t)data.length recordLength:(uint32_t)record.length date:date];
+    }
+    SD_UNLOCK(_lock);
+    if (!segment) {
+        return;
+    }
+
+    // The data may be stored as a large file before
+    [self.fileCache removeDataForKey:key];
+    if (overwritten) {
+        [self scheduleCompactionIfNeeded];
+    }
+}
+
+- (void)removeDataForKey:(NSString *)key {
+    NSParameterAssert(key);
+    [self waitUntilLoaded];
+    SD_LOCK(_lock);
+    BOOL removed = [self removePackedDataForKeys:@[key]];
+    SD_UNLOCK(_lock);
+    [self.fileCache removeDataForKey:key];
+    if (removed) {
+        [self scheduleCompactionIfNeeded];
+    }
+}
+
+- (void)removeAllData {
+    [self waitUntilLoaded];
+    SD_LOCK(_lock);
+    [_entries removeAllObjects];
+    // The file descriptor is closed when the last reader finished
+    [_segments removeAllObjects];
+    _packedSize = 0;
+    [self.fileManager removeItemAtPath:self.segmentsPath error:nil];
+    SD_UNLOCK(_lock);
+    [self.fileCache removeAllData];
+}
+
+- (void)removeExpiredData {
+    [self waitUntilLoaded];
+    SDImageCacheConfig *config = self.config;
+    BOOL useAccessDate = config.diskCacheExpireType == SDImageCacheConfigExpireTypeAccessDate;
+    NSTimeInterval expirationDate = (config.maxDiskAge < 0) ? -DBL_MAX : [NSDate timeIntervalSinceReferenceDate] - config.maxDiskAge;
+
+    // Remove the packed data that are older than the expiration date
+    SD_LOCK(_lock);
+    NSMutableArray<NSString *> *expiredKeys = [NSMutableArray array];
+    [_entries enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull key, SDPackDiskCacheEntry * _Nonnull entry, BOOL * _Nonnull stop) {
+        NSTimeInterval date = useAccessDate ? entry->_accessDate : entry->_modificationDate;
+        if (date <= expirationDate) {
+            [expiredKeys addObject:key];
+        }
+    }];
+    [self removePackedDataForKeys:expiredKeys];
+    uint64_t packedSize = _packedSize;
+    SD_UNLOCK(_lock);
+
+    // The large files share the size limit with the packed data
+    NSUInteger maxDiskSize = config.maxDiskSize;
+    SDImageCacheConfig *fileConfig = self.fileCache.config;
+    fileConfig.maxDiskAge = config.maxDiskAge;
+    fileConfig.diskCacheExpireType = config.diskCacheExpireType;
+    fileConfig.maxDiskSize = maxDiskSize > 0 ? MAX(maxDiskSize - (NSUInteger)MIN(packedSize, maxDiskSize), 1) : 0;
+    [self.fileCache removeExpiredData];
+
+    // If the remaining exceeds the maximum size, remove the oldest packed data until half of the maximum size, the same as `SDDiskCache`
+    if (maxDiskSize > 0) {
+        NSUInteger fileSize = [self.fileCache totalSize];
+        SD_LOCK(_lock);
+        if (_packedSize + fileSize > maxDiskSize) {
+            const uint64_t desiredSize = (maxDiskSize / 2 > fileSize) ? (maxDiskSize / 2 - fileSize) : 0;
+            NSArray<NSString *> *sortedKeys = [_entries keysSortedByValueWithOptions:NSSortConcurrent usingComparator:^NSComparisonResult(SDPackDiskCacheEntry * _Nonnull entry1, SDPackDiskCacheEntry * _Nonnull entry2) {
+                NSTimeInterval date1 = useAccessDate ? entry1->_accessDate : entry1->_modificationDate;
+                NSTimeInterval date2 = useAccessDate ? entry2->_accessDate : entry2->_modificationDate;
+                if (date1 < date2) {
+                    return NSOrderedAscending;
+                } else if (date1 > date2) {
+                    return NSOrderedDescending;
+                }
+                return NSOrderedSame;
+            }];
+            NSMutableArray<NSString *> *keysToDelete = [NSMutableArray array];
+            uint64_t currentSize = _packedSize;
+            for (NSString *key in sortedKeys) {
+                if (currentSize <= desiredSize) {
+                    break;
+                }
+                SDPackDiskCacheEntry *entry = _entries[key];
+                currentSize -= entry->_length;
+                [keysToDelete addObject:key];
+            }
+            [self removePackedDataForKeys:keysToDelete];
+        }
+        SD_UNLOCK(_lock);
+    }
+
+    [self compact];
+}
+
+- (nullable NSString *)cachePathForKey:(NSString *)key {
+    NSParameterAssert(key);
+    return [self.fileCache cachePathForKey:key];
+}
+
+- (NSUInteger)totalSize {
+    [self waitUntilLoaded];
+    uint64_t size = 0;
+    SD_LOCK(_lock);
+    for (SDPackDiskCacheSegment *segment in _segments) {
+        size += segment->_size;
+    }
+    SD_UNLOCK(_lock);
+    return (NSUInteger)size + [self.fileCache totalSize];
+}
+
+- (NSUInteger)totalCount {
+    [self waitUntilLoaded];
+    SD_LOCK(_lock);
+    NSUInteger count = _entries.count;
+    SD_UNLOCK(_lock);
+    return count + [self.fileCache totalCount];
+}
+
+#pragma mark - Compaction
+
+- (void)compact {
+    [self waitUntilLoaded];
+    SD_LOCK(_lock);
+    NSUInteger sealedCount = _segments.count > 0 ? _segments.count - 1 : 0;
+    SD_UNLOCK(_lock);
+    // The live entries are moved to the new segments, so limit the rounds
+    for (NSUInteger i = 0; i < sealedCount; i++) {
+        SD_LOCK(_lock);
+        BOOL compacted = [self needsCompaction] && [self compactOldestSegment];
+        SD_UNLOCK(_lock);
+        if (!compacted) {
+            break;
+        }
+    }
+}
+
+- (void)scheduleCompactionIfNeeded {
+    SD_LOCK(_lock);
+    BOOL shouldSchedule = !_compactionScheduled && [self needsCompaction];
+    if (shouldSchedule) {
+        _compactionScheduled = YES;
+    }
+    SD_UNLOCK(_lock);
+    if (!shouldSchedule) {
+        return;
+    }
+    dispatch_async(_compactionQueue, ^{
+        SD_LOCK(self->_lock);
+        self->_compactionScheduled = NO;
+        SD_UNLOCK(self->_lock);
+        [self compact];
+    });
+}
+
+// Lock held
+- (BOOL)needsCompaction {
+    if (_segments.count < 2) {
+        return NO;
+    }
+    SDPackDiskCacheSegment *oldestSegment = _segments.firstObject;
+    if (oldestSegment->_liveSize == 0) {
+        return YES;
+    }
+    uint64_t size = 0;
+    uint64_t liveSize = 0;
+    for (NSUInteger i = 0; i < _segments.count - 1; i++) {
+        SDPackDiskCacheSegment *segment = _segments[i];
+        size += segment->_size;
+        liveSize += segment->_liveSize;
+    }
+    return size > 0 && (double)(size - liveSize) / size > self.compactionRatio;
+}
+
+// Lock held. Only the oldest segment is compacted, the tombstones in it are not needed anymore because there is no older record.
+- (BOOL)compactOldestSegment {
+    SDPackDiskCacheSegment *segment = _segments.firstObject;
+    NSArray<NSString *> *keys = segment->_keys.allObjects;
+    if (keys.count > 0) {
+        NSData *content = [NSData dataWithContentsOfFile:[self segmentPathForIdentifier:segment->_identifier] options:NSDataReadingMappedIfSafe error:nil];
+        if (content.length < segment->_size) {
+            return NO;
+        }
+        NSMutableData *records = [NSMutableData dataWithCapacity:(NSUInteger)segment->_liveSize];
+        uint64_t *recordOffsets = malloc(keys.count * sizeof(uint64_t));
+        if (!recordOffsets) {
+            return NO;
+        }
+        [keys enumerateObjectsUsingBlock:^(NSString * _Nonnull key, NSUInteger idx, BOOL * _Nonnull stop) {
+            SDPackDiskCacheEntry *entry = self->_entries[key];
+            NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+            NSData *data = [content subdataWithRange:NSMakeRange((NSUInteger)entry->_offset, entry->_length)];
+            recordOffsets[idx] = records.length;
+            SDPackDiskCacheAppendRecord(records, 0, keyData, data, entry->_modificationDate);
+        }];
+        uint64_t offset = 0;
+        SDPackDiskCacheSegment *writingSegment = [self appendRecords:records offset:&offset];
+        if (!writingSegment) {
+            free(recordOffsets);
+            return NO;
+        }
+        [keys enumerateObjectsUsingBlock:^(NSString * _Nonnull key, NSUInteger idx, BOOL * _Nonnull stop) {
+            SDPackDiskCacheEntry *entry = self->_entries[key];
+            // The data is after the header and key, which does not change
+            uint64_t dataOffset = offset + recordOffsets[idx] + (entry->_recordLength - entry->_length);
+            [segment->_keys removeObject:key];
+            segment->_liveSize -= entry->_recordLength;
+            entry->_segment = writingSegment;
+            entry->_offset = dataOffset;
+            [writingSegment->_keys addObject:key];
+            writingSegment->_liveSize += entry->_recordLength;
+        }];
+        free(recordOffsets);
+    }
+    [_segments removeObjectAtIndex:0];
+    unlink([self segmentPathForIdentifier:segment->_identifier].fileSystemRepresentation);
+    return YES;
+}
+
+#pragma mark - Segments
+
+- (nonnull NSString *)segmentPathForIdentifier:(uint32_t)identifier {
+    NSString *fileName = [NSString stringWithFormat:@"%08x.%@", identifier, kSDPackDiskCacheSegmentExtension];
+    return [self.segmentsPath stringByAppendingPathComponent:fileName];
+}
+
+- (nullable SDPackDiskCacheSegment *)openSegmentWithIdentifier:(uint32_t)identifier {
+    int fd = open([self segmentPathForIdentifier:identifier].fileSystemRepresentation, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return nil;
+    }
+    return [[SDPackDiskCacheSegment alloc] initWithIdentifier:identifier fileDescriptor:fd];
+}
+
+- (void)loadSegments {
+    NSArray<NSString *> *fileNames = [self.fileManager contentsOfDirectoryAtPath:self.segmentsPath error:nil];
+    NSMutableArray<NSNumber *> *identifiers = [NSMutableArray arrayWithCapacity:fileNames.count];
+    for (NSString *fileName in fileNames) {
+        if (![fileName.pathExtension isEqualToString:kSDPackDiskCacheSegmentExtension]) {
+            continue;
+        }
+        unsigned long identifier = strtoul(fileName.stringByDeletingPathExtension.UTF8String, NULL, 16);
+        [identifiers addObject:@(identifier)];
+    }
+    [identifiers sortUsingSelector:@selector(compare:)];
+
+    // Replay the records in written order, the later one wins
+    for (NSNumber *identifier in identifiers) {
+        SDPackDiskCacheSegment *segment = [self openSegmentWithIdentifier:identifier.unsignedIntValue];
+        if (!segment) {
+            continue;
+        }
+        [self replaySegment:segment];
+        [_segments addObject:segment];
+    }
+}
+
+- (void)replaySegment:(nonnull SDPackDiskCacheSegment *)segment {
+    NSData *content = [NSData dataWithContentsOfFile:[self segmentPathForIdentifier:segment->_identifier] options:NSDataReadingMappedIfSafe error:nil];
+    const uint8_t *bytes = content.bytes;
+    const uint64_t length = content.length;
+    uint64_t offset = 0;
+    while (offset + sizeof(SDPackDiskCacheRecordHeader) <= length) {
+        SDPackDiskCacheRecordHeader header;
+        memcpy(&header, bytes + offset, sizeof(header));
+        uint64_t recordLength = sizeof(header) + (uint64_t)header.keyLength + header.dataLength;
+        if (header.magic != kSDPackDiskCacheRecordMagic || offset + recordLength > length) {
+            break;
+        }
+        NSString *key = [[NSString alloc] initWithBytes:bytes + offset + sizeof(header) length:header.keyLength encoding:NSUTF8StringEncoding];
+        if (key) {
+            [self removeEntryForKey:key];
+            if (!(header.flags & kSDPackDiskCacheRecordFlagTombstone)) {
+                [self addEntryForKey:key segment:segment offset:offset + sizeof(header) + header.keyLength length:header.dataLength recordLength:(uint32_t)recordLength date:header.date];
+            }
+        }
+        offset += recordLength;
+    }
+    // Drop the torn record written during a crash, so the next record can be appended after the valid ones
+    if (offset < length) {
+        ftruncate(segment->_fd, (off_t)offset);
+    }
+    segment->_size = offset;
+}
+
+// Lock held
+- (nullable SDPackDiskCacheSegment *)appendRecords:(nonnull NSData *)records offset:(nonnull uint64_t *)offset {
+    SDPackDiskCacheSegment *segment = _segments.lastObject;
+    if (!segment || (segment->_size > 0 && segment->_size + records.length > self.maxSegmentSize)) {
+        if (![self.fileManager fileExistsAtPath:self.segmentsPath]) {
+            [self.fileManager createDirectoryAtPath:self.segmentsPath withIntermediateDirectories:YES attributes:nil error:NULL];
+            // disable iCloud backup for the whole directory
+            if (self.config.shouldDisableiCloud) {
+                // ignore iCloud backup resource value error
+                [[NSURL fileURLWithPath:self.segmentsPath isDirectory:YES] setResourceValue:@YES forKey:NSURLIsExcludedFromBackupKey error:nil];
+            }
+        }
+        uint32_t identifier = segment ? segment->_identifier + 1 : 0;
+        segment = [self openSegmentWithIdentifier:identifier];
+        if (!segment) {
+            return nil;
+        }
+        [_segments addObject:segment];
+    }
+    ssize_t written = pwrite(segment->_fd, records.bytes, records.length, (off_t)segment->_size);
+    if (written != (ssize_t)records.length) {
+        // Drop the partial record
+        if (written > 0) {
+            ftruncate(segment->_fd, (off_t)segment->_size);
+        }
+        return nil;
+    }
+    *offset = segment->_size;
+    segment->_size += records.length;
+    return segment;
+}
+
+#pragma mark - Index
+
+// Lock held
+- (void)addEntryForKey:(nonnull NSString *)key segment:(nonnull SDPackDiskCacheSegment *)segment offset:(uint64_t)offset length:(uint32_t)length recordLength:(uint32_t)recordLength date:(NSTimeInterval)date {
+    SDPackDiskCacheEntry *entry = [SDPackDiskCacheEntry new];
+    entry->_segment = segment;
+    entry->_offset = offset;
+    entry->_length = length;
+    entry->_recordLength = recordLength;
+    entry->_modificationDate = date;
+    entry->_accessDate = date;
+    _entries[key] = entry;
+    [segment->_keys addObject:key];
+    segment->_liveSize += recordLength;
+    _packedSize += length;
+}
+
+// Lock held
+- (BOOL)removeEntryForKey:(nonnull NSString *)key {
+    SDPackDiskCacheEntry *entry = _entries[key];
+    if (!entry) {
+        return NO;
+    }
+    [_entries removeObjectForKey:key];
+    SDPackDiskCacheSegment *segment = entry->_segment;
+    [segment->_keys removeObject:key];
+    segment->_liveSize -= entry->_recordLength;
+    _packedSize -= entry->_length;
+    return YES;
+}
+
+// Lock held. Write the tombstones in one batch, the entries are removed only if the tombstones are written, otherwise the next replay brings the keys back. Returns whether any entry is removed.
+- (BOOL)removePackedDataForKeys:(nonnull NSArray<NSString *> *)keys {
+    NSMutableData *records = [NSMutableData data];
+    NSMutableArray<NSString *> *removedKeys = [NSMutableArray arrayWithCapacity:keys.count];
+    NSTimeInterval date = [NSDate timeIntervalSinceReferenceDate];
+    for (NSString *key in keys) {
+        if (_entries[key]) {
+            SDPackDiskCacheAppendRecord(records, kSDPackDiskCacheRecordFlagTombstone, [key dataUsingEncoding:NSUTF8StringEncoding], nil, date);
+            [removedKeys addObject:key];
+        }
+    }
+    if (records.length == 0) {
+        return NO;
+    }
+    uint64_t offset = 0;
+    if (![self appendRecords:records offset:&offset]) {
+        return NO;
+    }
+    for (NSString *key in removedKeys) {
+        [self removeEntryForKey:key];
+    }
+    return YES;
+}
+
+@end
@@ -0,0 +1,106 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDWebImageCompat.h"
+#import "SDMemoryCache.h"
+#import "SDImageCacheConfig.h"
+
+/**
+ A memory cache built on lock-striped shards. Each shard owns a hash table and an intrusive doubly-linked LRU list, so get/set/remove are O(1) and only take the lock of the shard which the key belongs to.
+ The total cost and count are accounted exactly against `maxMemoryCost` and `maxMemoryCount` of the cache config. Unlike `NSCache`, entries are always evicted in least-recently-used order.
+ * 分片 + LRU 的内存缓存，每个分片有独立的锁，多线程访问时不会互相阻塞
+ @note On memory warning, the cache is trimmed gradually: the first warning keeps 50% of the cost, the repeated one keeps 25%, and then only the weak cache. The pressure is reset after 30 seconds.
+ @note When `shouldUseWeakMemoryCache` is enabled, the evicted entries are moved into a per-shard weak table instead of mirroring every entry. So the images which are still held by views can be recovered without a disk query, just like `SDMemoryCache`.
+ */
+@interface SDShardedMemoryCache : NSObject <SDMemoryCache>
+
+/**
+ The cache config used to create the cache. `maxMemoryCost` and `maxMemoryCount` are observed and can be changed dynamically.
+ */
+@property (nonatomic, strong, nonnull, readonly) SDImageCacheConfig *config;
+
+/**
+ The number of lock stripes, always a power of two. It's fixed after initialization.
+ */
+@property (nonatomic, assign, readonly) NSUInteger shardCount;
+
+/**
+ The admission policy, read from the config's `memoryCacheAdmissionPolicy` during initialization. It's fixed after initialization.
+ */
+@property (nonatomic, assign, readonly) SDImageCacheConfigAdmissionPolicy admissionPolicy;
+
+/**
+ The eviction policy, read from the config's `memoryCacheEvictionPolicy` during initialization. It's fixed after initialization.
+ */
+@property (nonatomic, assign, readonly) SDImageCacheConfigEvictionPolicy evictionPolicy;
+
+/**
+ The total cost of the objects currently in the cache (the weak table is not counted).
+ */
+@property (nonatomic, assign, readonly) NSUInteger totalCost;
+
+/**
+ The number of the objects currently in the cache (the weak table is not counted).
+ */
+@property (nonatomic, assign, readonly) NSUInteger totalCount;
+
+/**
+ Create a new memory cache instance with the specify cache config, using the default shard count (based on the active processor count).
+
+ @param config The cache config to be used to create the cache.
+ @return The new memory cache instance.
+ */
+- (nonnull instancetype)initWithConfig:(nonnull SDImageCacheConfig *)config;
+
+/**
+ Create a new memory cache instance with the specify cache config and shard count.
+
+ @param config The cache config to be used to create the cache.
+ @param shardCount The number of lock stripes. It will be rounded up to the power of two. Pass 0 to use the default value.
+ @return The new memory cache instance.
+ */
+- (nonnull instancetype)initWithConfig:(nonnull SDImageCacheConfig *)config shardCount:(NSUInteger)shardCount NS_DESIGNATED_INITIALIZER;
+
+/**
+ Returns a boolean value that indicates whether a given key is in cache. This does not update the LRU order, and does not check the weak table.
+
+ @param key An object identifying the value. If nil, just return NO.
+ @return Whether the key is in cache.
+ */
+- (BOOL)containsObjectForKey:(nonnull id)key;
+
+/**
+ Removes objects from the cache until the total cost is below or equal to the specified value. The entries are evicted in the order of the eviction policy, and go into the weak table when `shouldUseWeakMemoryCache` is enabled.
+
+ @param cost The total cost allowed to remain after the cache has been trimmed.
+ */
+- (void)trimToCost:(NSUInteger)cost;
+
+/**
+ Removes objects from the cache until the total count is below or equal to the specified value. The entries are evicted in the order of the eviction policy.
+
+ @param count The total count allowed to remain after the cache has been trimmed.
+ */
+- (void)trimToCount:(NSUInteger)count;
+
+/**
+ Removes objects from the cache until both the total cost and count are below or equal to the specified fraction of the current value. The entries are evicted in the order of the eviction policy.
+
+ @param fraction The fraction allowed to remain after the cache has been trimmed, between 0 and 1.
+ */
+- (void)trimToFraction:(double)fraction;
+
+/**
+ Enumerates the most recently used keys in cache, from the most recent one. This does not update the LRU order.
+
+ @param limit The maximum number of keys to enumerate. Pass 0 to enumerate all the keys.
+ @param block The block to apply to the keys, with the cost of the entry. Set `stop` to YES to stop the enumeration.
+ */
+- (void)enumerateHotKeysWithLimit:(NSUInteger)limit usingBlock:(void (NS_NOESCAPE ^ _Nonnull)(id _Nonnull key, NSUInteger cost, BOOL * _Nonnull stop))block;
+
+@end
@@ -0,0 +1,1026 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDShardedMemoryCache+Private.h"
+#import "SDImageCacheConfig.h"
+#import "UIImage+MemoryCacheCost.h"
+#import "SDInternalMacros.h"
+#import <stdatomic.h>
+
+static void * SDShardedMemoryCacheContext = &SDShardedMemoryCacheContext;
+
+// Set when any cache uses the GDSF eviction, the decode time is only recorded then
+static atomic_bool SDShardedMemoryCacheRecordsDecodeTime = false;
+
+BOOL SDImageCacheShouldRecordDecodeTime(void) {
+    return atomic_load_explicit(&SDShardedMemoryCacheRecordsDecodeTime, memory_order_relaxed);
+}
+
+static const NSUInteger kSDShardedMemoryCacheMaxShardCount = 64;
+// W-TinyLFU: the admission window takes 1% of the capacity
+static const NSUInteger kSDShardedMemoryCacheWindowPercent = 1;
+// The default sketch width per shard when there is no count limit
+static const NSUInteger kSDShardedMemoryCacheDefaultSketchWidth = 512;
+// The sketch counters are halved after `width * 10` increments, so the old popularity fades out
+static const NSUInteger kSDShardedMemoryCacheSketchSampleFactor = 10;
+static const uint8_t kSDShardedMemoryCacheSketchMaxCount = 15;
+// GDSF: the typical decode speed (bytes per second), used to estimate the decode cost when it's unknown
+static const double kSDShardedMemoryCacheEstimatedDecodeSpeed = 100 * 1024 * 1024;
+// Graduated trimming on memory pressure, keeps 50%, then 25%, then only the weak cache
+static const double kSDShardedMemoryCacheMemoryPressureFractions[] = {0.5, 0.25, 0};
+// The pressure after this interval is treated as a new one, starts from the first step again
+static const NSTimeInterval kSDShardedMemoryCacheMemoryPressureResetInterval = 30;
+// The same pressure may be reported by both the dispatch source and UIKit notification, merge them
+static const NSTimeInterval kSDShardedMemoryCacheMemoryPressureMergeInterval = 1;
+
+/// A linked node. The node is retained by the shard's hash table, the links are unretained.
+@interface SDShardedMemoryCacheNode : NSObject {
+    @package
+    __unsafe_unretained SDShardedMemoryCacheNode *_prev;
+    __unsafe_unretained SDShardedMemoryCacheNode *_next;
+    id _key;
+    id _value;
+    NSUInteger _cost;
+    NSUInteger _hash; // mixed key hash
+    uint64_t _time; // last access tick, used to compare the recency between shards
+    BOOL _inWindow; // whether the node is in the admission window list
+    NSUInteger _heapIndex; // index in the GDSF heap
+    NSUInteger _frequency; // GDSF access count
+    double _decodeCost; // GDSF benefit, the seconds spent to create the value
+    double _priority; // GDSF priority, the lowest is evicted first
+}
+@end
+
+@implementation SDShardedMemoryCacheNode
+@end
+
+/// An intrusive doubly-linked list, head is the most recently used.
+typedef struct SDShardedMemoryCacheList {
+    __unsafe_unretained SDShardedMemoryCacheNode *head;
+    __unsafe_unretained SDShardedMemoryCacheNode *tail;
+    NSUInteger cost;
+    NSUInteger count;
+} SDShardedMemoryCacheList;
+
+static inline void SDShardedMemoryCacheListInsertHead(SDShardedMemoryCacheList *list, SDShardedMemoryCacheNode *node) {
+    node->_prev = nil;
+    node->_next = list->head;
+    if (list->head) {
+        list->head->_prev = node;
+    } else {
+        list->tail = node;
+    }
+    list->head = node;
+    list->cost += node->_cost;
+    list->count += 1;
+}
+
+static inline void SDShardedMemoryCacheListRemove(SDShardedMemoryCacheList *list, SDShardedMemoryCacheNode *node) {
+    if (node->_next) node->_next->_prev = node->_prev;
+    if (node->_prev) node->_prev->_next = node->_next;
+    if (list->head == node) list->head = node->_next;
+    if (list->tail == node) list->tail = node->_prev;
+    node->_prev = nil;
+    node->_next = nil;
+    list->cost -= node->_cost;
+    list->count -= 1;
+}
+
+static inline void SDShardedMemoryCacheListBringToHead(SDShardedMemoryCacheList *list, SDShardedMemoryCacheNode *node) {
+    if (list->head == node) {
+        return;
+    }
+    if (list->tail == node) {
+        list->tail = node->_prev;
+        list->tail->_next = nil;
+    } else {
+        node->_next->_prev = node->_prev;
+        node->_prev->_next = node->_next;
+    }
+    node->_prev = nil;
+    node->_next = list->head;
+    list->head->_prev = node;
+    list->head = node;
+}
+
+/// A binary min-heap ordered by the GDSF priority, the nodes are retained by the shard's hash table.
+typedef struct SDShardedMemoryCacheHeap {
+    SDShardedMemoryCacheNode * __unsafe_unretained *nodes;
+    NSUInteger count;
+    NSUInteger capacity;
+} SDShardedMemoryCacheHeap;
+
+static inline BOOL SDShardedMemoryCacheHeapLess(SDShardedMemoryCacheNode *node1, SDShardedMemoryCacheNode *node2) {
+    if (node1->_priority != node2->_priority) {
+        return node1->_priority < node2->_priority;
+    }
+    // Same priority, evict the least recently used one
+    return node1->_time < node2->_time;
+}
+
+static inline void SDShardedMemoryCacheHeapSwap(SDShardedMemoryCacheHeap *heap, NSUInteger i, NSUInteger j) {
+    SDShardedMemoryCacheNode *node = heap->nodes[i];
+    heap->nodes[i] = heap->nodes[j];
+    heap->nodes[j] = node;
+    heap->nodes[i]->_heapIndex = i;
+    heap->nodes[j]->_heapIndex = j;
+}
+
+static inline void SDShardedMemoryCacheHeapSiftUp(SDShardedMemoryCacheHeap *heap, NSUInteger i) {
+    while (i > 0) {
+        NSUInteger parent = (i - 1) / 2;
+        if (!SDShardedMemoryCacheHeapLess(heap->nodes[i], heap->nodes[parent])) {
+            break;
+        }
+        SDShardedMemoryCacheHeapSwap(heap, i, parent);
+        i = parent;
+    }
+}
+
+static inline void SDShardedMemoryCacheHeapSiftDown(SDShardedMemoryCacheHeap *heap, NSUInteger i) {
+    while (YES) {
+        NSUInteger left = i * 2 + 1;
+        NSUInteger right = left + 1;
+        NSUInteger smallest = i;
+        if (left < heap->count && SDShardedMemoryCacheHeapLess(heap->nodes[left], heap->nodes[smallest])) {
+            smallest = left;
+        }
+        if (right < heap->count && SDShardedMemoryCacheHeapLess(heap->nodes[right], heap->nodes[smallest])) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        SDShardedMemoryCacheHeapSwap(heap, i, smallest);
+        i = smallest;
+    }
+}
+
+static inline void SDShardedMemoryCacheHeapInsert(SDShardedMemoryCacheHeap *heap, SDShardedMemoryCacheNode *node) {
+    if (heap->count == heap->capacity) {
+        heap->capacity = MAX(heap->capacity * 2, 16);
+        heap->nodes = (SDShardedMemoryCacheNode * __unsafe_unretained *)realloc(heap->nodes, heap->capacity * sizeof(SDShardedMemoryCacheNode *));
+    }
+    node->_heapIndex = heap->count;
+    heap->nodes[heap->count++] = node;
+    SDShardedMemoryCacheHeapSiftUp(heap, node->_heapIndex);
+}
+
+static inline void SDShardedMemoryCacheHeapRemove(SDShardedMemoryCacheHeap *heap, SDShardedMemoryCacheNode *node) {
+    NSUInteger i = node->_heapIndex;
+    NSUInteger last = --heap->count;
+    if (i != last) {
+        SDShardedMemoryCacheHeapSwap(heap, i, last);
+        SDShardedMemoryCacheHeapSiftDown(heap, i);
+        SDShardedMemoryCacheHeapSiftUp(heap, i);
+    }
+    heap->nodes[last] = nil;
+}
+
+// Call after the priority of the node changed
+static inline void SDShardedMemoryCacheHeapUpdate(SDShardedMemoryCacheHeap *heap, SDShardedMemoryCacheNode *node) {
+    SDShardedMemoryCacheHeapSiftDown(heap, node->_heapIndex);
+    SDShardedMemoryCacheHeapSiftUp(heap, node->_heapIndex);
+}
+
+// The lowest priority node except the `keepNode`
+static inline SDShardedMemoryCacheNode * SDShardedMemoryCacheHeapVictim(SDShardedMemoryCacheHeap *heap, SDShardedMemoryCacheNode *keepNode) {
+    if (heap->count == 0) {
+        return nil;
+    }
+    SDShardedMemoryCacheNode *node = heap->nodes[0];
+    if (node != keepNode) {
+        return node;
+    }
+    // The second lowest is one of the root's children
+    SDShardedMemoryCacheNode *left = heap->count > 1 ? heap->nodes[1] : nil;
+    SDShardedMemoryCacheNode *right = heap->count > 2 ? heap->nodes[2] : nil;
+    if (left && right) {
+        return SDShardedMemoryCacheHeapLess(right, left) ? right : left;
+    }
+    return left;
+}
+
+/// A count-min sketch with 4 rows of 4-bit saturating counters (stored in bytes for simplicity), used to estimate the access frequency of keys, including the ones not in cache.
+typedef struct SDShardedMemoryCacheSketch {
+    uint8_t *table; // 4 rows * width
+    NSUInteger widthMask;
+    NSUInteger additions;
+    NSUInteger sampleSize;
+} SDShardedMemoryCacheSketch;
+
+static inline NSUInteger SDShardedMemoryCacheSketchIndex(const SDShardedMemoryCacheSketch *sketch, NSUInteger hash, NSUInteger row) {
+    // Double hashing, the low bits of the hash are used to choose the shard, so don't use them directly. Mix into 64 bits first, `NSUInteger` is 32 bits on some platforms (arm64_32)
+    uint64_t h = (uint64_t)hash;
+    h = (h ^ (h >> 33)) * 0xff51afd7ed558ccdULL;
+    h = (h ^ (h >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    uint32_t h1 = (uint32_t)(h >> 32);
+    uint32_t h2 = (uint32_t)h | 1;
+    return row * (sketch->widthMask + 1) + ((h1 + row * h2) & sketch->widthMask);
+}
+
+static inline uint8_t SDShardedMemoryCacheSketchFrequency(const SDShardedMemoryCacheSketch *sketch, NSUInteger hash) {
+    uint8_t frequency = kSDShardedMemoryCacheSketchMaxCount;
+    for (NSUInteger row = 0; row < 4; row++) {
+        frequency = MIN(frequency, sketch->table[SDShardedMemoryCacheSketchIndex(sketch, hash, row)]);
+    }
+    return frequency;
+}
+
+static inline void SDShardedMemoryCacheSketchIncrement(SDShardedMemoryCacheSketch *sketch, NSUInteger hash) {
+    BOOL added = NO;
+    for (NSUInteger row = 0; row < 4; row++) {
+        uint8_t *counter = &sketch->table[SDShardedMemoryCacheSketchIndex(sketch, hash, row)];
+        if (*counter < kSDShardedMemoryCacheSketchMaxCount) {
+            *counter += 1;
+            added = YES;
+        }
+    }
+    if (added && ++sketch->additions >= sketch->sampleSize) {
+        // Aging, halve all the counters
+        NSUInteger length = (sketch->widthMask + 1) * 4;
+        for (NSUInteger i = 0; i < length; i++) {
+            sketch->table[i] >>= 1;
+        }
+        sketch->additions /= 2;
+    }
+}
+
+/// A lock stripe, contains a hash table and the LRU lists. All the access should be protected by `_lock`.
+@interface SDShardedMemoryCacheShard : NSObject {
+    @package
+    dispatch_semaphore_t _lock;
+    CFMutableDictionaryRef _dic;
+    SDShardedMemoryCacheList _main; // the main LRU, or the only LRU when admission is disabled
+    SDShardedMemoryCacheList _window; // W-TinyLFU admission window
+    SDShardedMemoryCacheSketch _sketch; // only available when admission is enabled
+    BOOL _usesHeap; // whether the GDSF eviction is enabled
+    SDShardedMemoryCacheHeap _heap;
+    _Atomic(double) *_inflation; // GDSF aging factor `L`, the priority of the last evicted node. Shared by all the shards, so the priorities are comparable between the shards
+    NSMapTable *_weakCache; // evicted entries, created lazily
+}
+@end
+
+@implementation SDShardedMemoryCacheShard
+
+- (instancetype)initWithSketchWidth:(NSUInteger)sketchWidth inflation:(_Atomic(double) *)inflation {
+    self = [super init];
+    if (self) {
+        _usesHeap = inflation != NULL;
+        _inflation = inflation;
+        _lock = dispatch_semaphore_create(1);
+        _dic = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+        if (sketchWidth > 0) {
+            _sketch.table = calloc(sketchWidth * 4, sizeof(uint8_t));
+            _sketch.widthMask = sketchWidth - 1;
+            _sketch.sampleSize = sketchWidth * kSDShardedMemoryCacheSketchSampleFactor;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_dic) {
+        CFRelease(_dic);
+        _dic = NULL;
+    }
+    if (_sketch.table) {
+        free(_sketch.table);
+        _sketch.table = NULL;
+    }
+    if (_heap.nodes) {
+        free(_heap.nodes);
+        _heap.nodes = NULL;
+    }
+}
+
+- (SDShardedMemoryCacheNode *)nodeForKey:(id)key {
+    return CFDictionaryGetValue(_dic, (__bridge const void *)key);
+}
+
+- (SDShardedMemoryCacheList *)listForNode:(SDShardedMemoryCacheNode *)node {
+    return node->_inWindow ? &_window : &_main;
+}
+
+- (void)insertNode:(SDShardedMemoryCacheNode *)node {
+    CFDictionarySetValue(_dic, (__bridge const void *)node->_key, (__bridge const void *)node);
+    SDShardedMemoryCacheListInsertHead([self listForNode:node], node);
+    if (_usesHeap) {
+        SDShardedMemoryCacheHeapInsert(&_heap, node);
+    }
+}
+
+- (void)updateNode:(SDShardedMemoryCacheNode *)node cost:(NSUInteger)cost {
+    SDShardedMemoryCacheList *list = [self listForNode:node];
+    list->cost = list->cost - node->_cost + cost;
+    node->_cost = cost;
+}
+
+// The returned node is retained by caller, so it can be released outside the lock.
+- (SDShardedMemoryCacheNode *)removeNode:(SDShardedMemoryCacheNode *)node {
+    SDShardedMemoryCacheNode *removed = node;
+    SDShardedMemoryCacheListRemove([self listForNode:node], node);
+    if (_usesHeap) {
+        SDShardedMemoryCacheHeapRemove(&_heap, node);
+    }
+    CFDictionaryRemoveValue(_dic, (__bridge const void *)node->_key);
+    return removed;
+}
+
+// Move the node from the admission window into the main LRU
+- (void)promoteNode:(SDShardedMemoryCacheNode *)node {
+    SDShardedMemoryCacheListRemove(&_window, node);
+    node->_inWindow = NO;
+    SDShardedMemoryCacheListInsertHead(&_main, node);
+}
+
+// Recalculate the GDSF priority `H = L + frequency * cost / size`
+- (void)updatePriorityForNode:(SDShardedMemoryCacheNode *)node {
+    double size = MAX(node->_cost, 1);
+    double decodeCost = node->_decodeCost > 0 ? node->_decodeCost : size / kSDShardedMemoryCacheEstimatedDecodeSpeed;
+    node->_priority = atomic_load_explicit(_inflation, memory_order_relaxed) + node->_frequency * decodeCost / size;
+}
+
+// Call when the node in cache is accessed or updated
+- (void)touchNode:(SDShardedMemoryCacheNode *)node {
+    SDShardedMemoryCacheListBringToHead([self listForNode:node], node);
+    if (_usesHeap) {
+        node->_frequency += 1;
+        [self updatePriorityForNode:node];
+        SDShardedMemoryCacheHeapUpdate(&_heap, node);
+    }
+}
+
+// The next node to evict from this shard
+- (SDShardedMemoryCacheNode *)victimNode {
+    if (_usesHeap) {
+        return SDShardedMemoryCacheHeapVictim(&_heap, nil);
+    }
+    return _main.tail ?: _window.tail;
+}
+
+// The key to compare the victims between the shards, the lowest is evicted first
+- (double)evictionOrderForNode:(SDShardedMemoryCacheNode *)node {
+    return _usesHeap ? node->_priority : (double)node->_time;
+}
+
+- (NSMapTable *)weakCache {
+    if (!_weakCache) {
+        _weakCache = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsStrongMemory valueOptions:NSPointerFunctionsWeakMemory capacity:0];
+    }
+    return _weakCache;
+}
+
+@end
+
+@interface SDShardedMemoryCache () {
+    SDShardedMemoryCacheShard * __strong *_shards;
+    NSUInteger _shardMask;
+    atomic_ulong _totalCost;
+    atomic_ulong _totalCount;
+    atomic_ullong _clock; // logical access clock, keeps the LRU order deterministic across shards
+    _Atomic(double) _inflation; // GDSF aging factor shared by the shards
+    dispatch_source_t _memoryPressureSource;
+    NSUInteger _memoryPressureStep; // index of `kSDShardedMemoryCacheMemoryPressureFractions`, only access on main queue
+    CFAbsoluteTime _lastMemoryPressureTime;
+    SDImageCacheMemoryBudget *_budget;
+}
+
+@property (nonatomic, strong, nonnull, readwrite) SDImageCacheConfig *config;
+@property (nonatomic, assign, readwrite) NSUInteger shardCount;
+@property (nonatomic, assign, readwrite) SDImageCacheConfigAdmissionPolicy admissionPolicy;
+@property (nonatomic, assign, readwrite) SDImageCacheConfigEvictionPolicy evictionPolicy;
+@property (nonatomic, assign) NSUInteger costLimit;
+@property (nonatomic, assign) NSUInteger countLimit;
+
+@end
+
+@implementation SDShardedMemoryCache
+
+- (void)dealloc {
+    // The budget holds the cache weakly, just remove the cost from its total
+    [_registeredBudget addCost:-(long long)atomic_load_explicit(&_totalCost, memory_order_relaxed)];
+    [_config removeObserver:self forKeyPath:NSStringFromSelector(@selector(maxMemoryCost)) context:SDShardedMemoryCacheContext];
+    [_config removeObserver:self forKeyPath:NSStringFromSelector(@selector(maxMemoryCount)) context:SDShardedMemoryCacheContext];
+#if SD_UIKIT
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+#endif
+    if (_memoryPressureSource) {
+        dispatch_source_cancel(_memoryPressureSource);
+        _memoryPressureSource = nil;
+    }
+    if (_shards) {
+        for (NSUInteger i = 0; i < _shardCount; i++) {
+            _shards[i] = nil;
+        }
+        free(_shards);
+        _shards = NULL;
+    }
+}
+
+- (instancetype)init {
+    return [self initWithConfig:[[SDImageCacheConfig alloc] init] shardCount:0];
+}
+
+- (instancetype)initWithConfig:(SDImageCacheConfig *)config {
+    return [self initWithConfig:config shardCount:0];
+}
+
+- (instancetype)initWithConfig:(SDImageCacheConfig *)config shardCount:(NSUInteger)shardCount {
+    self = [super init];
+    if (self) {
+        _config = config;
+        _admissionPolicy = config.memoryCacheAdmissionPolicy;
+        _evictionPolicy = config.memoryCacheEvictionPolicy;
+        if (shardCount == 0) {
+            // Twice of the cores is enough to make the lock contention rare
+            shardCount = NSProcessInfo.processInfo.activeProcessorCount * 2;
+        }
+        shardCount = MIN(MAX(shardCount, 1), kSDShardedMemoryCacheMaxShardCount);
+        // Round up to power of two, so we can use mask instead of modulo
+        NSUInteger roundedCount = 1;
+        while (roundedCount < shardCount) {
+            roundedCount <<= 1;
+        }
+        _shardCount = roundedCount;
+        _shardMask = roundedCount - 1;
+        NSUInteger sketchWidth = 0;
+        if ([self usesAdmission]) {
+            // Each row should have more counters than the keys the shard holds, to reduce the collisions
+            NSUInteger expectedCount = config.maxMemoryCount > 0 ? config.maxMemoryCount / roundedCount * 4 : kSDShardedMemoryCacheDefaultSketchWidth;
+            sketchWidth = 64;
+            while (sketchWidth < expectedCount) {
+                sketchWidth <<= 1;
+            }
+        }
+        _shards = (SDShardedMemoryCacheShard * __strong *)calloc(roundedCount, sizeof(SDShardedMemoryCacheShard *));
+        for (NSUInteger i = 0; i < roundedCount; i++) {
+            _shards[i] = [[SDShardedMemoryCacheShard alloc] initWithSketchWidth:sketchWidth inflation:([self usesHeap] ? &_inflation : NULL)];
+        }
+        atomic_init(&_totalCost, 0);
+        atomic_init(&_totalCount, 0);
+        atomic_init(&_clock, 0);
+        atomic_init(&_inflation, 0);
+        if ([self usesHeap]) {
+            atomic_store_explicit(&SDShardedMemoryCacheRecordsDecodeTime, true, memory_order_relaxed);
+        }
+        [self commonInit];
+    }
+    return self;
+}
+
+- (void)commonInit {
+    SDImageCacheConfig *config = self.config;
+    self.costLimit = config.maxMemoryCost;
+    self.countLimit = config.maxMemoryCount;
+    _budget = config.memoryBudget;
+    [_budget registerMemoryCache:self weight:config.memoryBudgetWeight];
+
+    [config addObserver:self forKeyPath:NSStringFromSelector(@selector(maxMemoryCost)) options:0 context:SDShardedMemoryCacheContext];
+    [config addObserver:self forKeyPath:NSStringFromSelector(@selector(maxMemoryCount)) options:0 context:SDShardedMemoryCacheContext];
+
+#if SD_UIKIT
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(didReceiveMemoryWarning:)
+                                                 name:UIApplicationDidReceiveMemoryWarningNotification
+                                               object:nil];
+    // The dispatch source provides the pressure level, which UIKit notification does not
+    _memoryPressureSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0, DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL, dispatch_get_main_queue());
+    @weakify(self);
+    dispatch_source_set_event_handler(_memoryPressureSource, ^{
+        @strongify(self);
+        if (!self) {
+            return;
+        }
+        unsigned long level = dispatch_source_get_data(self->_memoryPressureSource);
+        [self didReceiveMemoryPressure:(level & DISPATCH_MEMORYPRESSURE_CRITICAL) != 0];
+    });
+    dispatch_resume(_memoryPressureSource);
+#endif
+}
+
+#pragma mark - Shard
+
+static inline NSUInteger SDShardedMemoryCacheHash(NSUInteger hash) {
+    // `-[NSString hash]` is not well distributed in the low bits, mix it (the 64-bit finalizer of MurmurHash3)
+    uint64_t h = hash;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (NSUInteger)h;
+}
+
+- (BOOL)usesAdmission {
+    // The admission window is a LRU list, does not work with GDSF
+    return self.admissionPolicy == SDImageCacheConfigAdmissionPolicyTinyLFU && ![self usesHeap];
+}
+
+- (BOOL)usesHeap {
+    return self.evictionPolicy == SDImageCacheConfigEvictionPolicyGDSF;
+}
+
+#pragma mark - Accounting
+
+- (uint64_t)tick {
+    if (_budget) {
+        // Use the shared clock, so the budget can compare the recency between caches
+        return [_budget tick];
+    }
+    return atomic_fetch_add_explicit(&_clock, 1, memory_order_relaxed) + 1;
+}
+
+- (NSUInteger)totalCost {
+    return atomic_load_explicit(&_totalCost, memory_order_relaxed);
+}
+
+- (NSUInteger)totalCount {
+    return atomic_load_explicit(&_totalCount, memory_order_relaxed);
+}
+
+- (BOOL)isOverLimit {
+    NSUInteger costLimit = self.costLimit;
+    NSUInteger countLimit = self.countLimit;
+    return [self isOverCost:(costLimit > 0 ? costLimit : NSUIntegerMax) count:(countLimit > 0 ? countLimit : NSUIntegerMax)];
+}
+
+- (BOOL)isOverCost:(NSUInteger)cost count:(NSUInteger)count {
+    return self.totalCost > cost || self.totalCount > count;
+}
+
+// Make sure to call with the shard locked
+- (BOOL)isWindowOverBudgetInShard:(SDShardedMemoryCacheShard *)shard {
+    if (!shard->_window.tail) {
+        return NO;
+    }
+    NSUInteger costLimit = self.costLimit;
+    NSUInteger countLimit = self.countLimit;
+    if (costLimit > 0) {
+        NSUInteger budget = MAX(costLimit / _shardCount * kSDShardedMemoryCacheWindowPercent / 100, 1);
+        if (shard->_window.cost > budget) {
+            return YES;
+        }
+    }
+    if (countLimit > 0) {
+        NSUInteger budget = MAX(countLimit / _shardCount * kSDShardedMemoryCacheWindowPercent / 100, 1);
+        if (shard->_window.count > budget) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+// Make sure to call with the shard locked
+- (void)addNode:(SDShardedMemoryCacheNode *)node toShard:(SDShardedMemoryCacheShard *)shard {
+    [shard insertNode:node];
+    atomic_fetch_add_explicit(&_totalCost, node->_cost, memory_order_relaxed);
+    atomic_fetch_add_explicit(&_totalCount, 1, memory_order_relaxed);
+    [self.registeredBudget addCost:(long long)node->_cost];
+}
+
+// Make sure to call with the shard locked
+- (SDShardedMemoryCacheNode *)removeNode:(SDShardedMemoryCacheNode *)node fromShard:(SDShardedMemoryCacheShard *)shard {
+    atomic_fetch_sub_explicit(&_totalCost, node->_cost, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&_totalCount, 1, memory_order_relaxed);
+    [self.registeredBudget addCost:-(long long)node->_cost];
+    return [shard removeNode:node];
+}
+
+// Make sure to call with the shard locked. Evicted (not removed by user) entries go into the weak table if needed.
+- (SDShardedMemoryCacheNode *)evictNode:(SDShardedMemoryCacheNode *)node fromShard:(SDShardedMemoryCacheShard *)shard {
+    if (self.config.shouldUseWeakMemoryCache) {
+        [shard.weakCache setObject:node->_value forKey:node->_key];
+    }
+    if (shard->_usesHeap) {
+        // GDSF aging, the entries inserted later start from a higher priority, so the entries which are not accessed for a long time can be evicted finally
+        double inflation = atomic_load_explicit(&_inflation, memory_order_relaxed);
+        while (node->_priority > inflation && !atomic_compare_exchange_weak_explicit(&_inflation, &inflation, node->_priority, memory_order_relaxed, memory_order_relaxed)) {}
+    }
+    return [self removeNode:node fromShard:shard];
+}
+
+#pragma mark - Eviction
+
+// Evict the LRU (or lowest GDSF priority) entries of the shard until under the limits, but never the `keepNode`. Returns the evicted nodes, which should be released outside the lock.
+- (NSMutableArray<SDShardedMemoryCacheNode *> *)trimShard:(SDShardedMemoryCacheShard *)shard keepNode:(SDShardedMemoryCacheNode *)keepNode {
+    if ([self usesAdmission]) {
+        return [self trimShardWithAdmission:shard keepNode:keepNode];
+    }
+    NSMutableArray<SDShardedMemoryCacheNode *> *evictedNodes;
+    while ([self isOverLimit]) {
+        SDShardedMemoryCacheNode *node = shard->_usesHeap ? SDShardedMemoryCacheHeapVictim(&shard->_heap, keepNode) : shard->_main.tail;
+        if (!node || node == keepNode) {
+            break;
+        }
+        if (!evictedNodes) {
+            evictedNodes = [NSMutableArray array];
+        }
+        [evictedNodes addObject:[self evictNode:node fromShard:shard]];
+    }
+    return evictedNodes;
+}
+
+// W-TinyLFU. New entries go into a small LRU window. When the window is full, the window's LRU entry (candidate) leaves it, and if the cache is full, it's only admitted into the main LRU when it's more frequently accessed than the main's LRU entry (victim). So one-off scans can not flush the hot entries.
+- (NSMutableArray<SDShardedMemoryCacheNode *> *)trimShardWithAdmission:(SDShardedMemoryCacheShard *)shard keepNode:(SDShardedMemoryCacheNode *)keepNode {
+    NSMutableArray<SDShardedMemoryCacheNode *> *evictedNodes;
+    while (YES) {
+        BOOL overLimit = [self isOverLimit];
+        BOOL windowOverBudget = [self isWindowOverBudgetInShard:shard];
+        if (!overLimit && !windowOverBudget) {
+            break;
+        }
+        SDShardedMemoryCacheNode *candidate = windowOverBudget ? shard->_window.tail : nil;
+        if (!overLimit) {
+            // There is still space, admit directly
+            [shard promoteNode:candidate];
+            continue;
+        }
+        SDShardedMemoryCacheNode *node;
+        SDShardedMemoryCacheNode *victim = shard->_main.tail;
+        if (candidate && victim) {
+            uint8_t candidateFrequency = SDShardedMemoryCacheSketchFrequency(&shard->_sketch, candidate->_hash);
+            uint8_t victimFrequency = SDShardedMemoryCacheSketchFrequency(&shard->_sketch, victim->_hash);
+            // Evict the loser, the winner stays in the cache (the candidate will be promoted in the next loop if there is space)
+            node = candidateFrequency > victimFrequency ? victim : candidate;
+            if (node == keepNode) {
+                // The node just inserted or accessed should not be evicted in the same trim, evict the other one
+                node = (node == victim) ? candidate : victim;
+            }
+        } else {
+            node = [shard victimNode];
+        }
+        if (!node || node == keepNode) {
+            break;
+        }
+        if (!evictedNodes) {
+            evictedNodes = [NSMutableArray array];
+        }
+        [evictedNodes addObject:[self evictNode:node fromShard:shard]];
+    }
+    return evictedNodes;
+}
+
+- (void)trimToLimits {
+    NSUInteger costLimit = self.costLimit;
+    NSUInteger countLimit = self.countLimit;
+    [self trimToCost:(costLimit > 0 ? costLimit : NSUIntegerMax) count:(countLimit > 0 ? countLimit : NSUIntegerMax)];
+}
+
+// Trim the whole cache, the globally oldest (or lowest GDSF priority) entry among all the shards is evicted first.
+- (void)trimToCost:(NSUInteger)cost count:(NSUInteger)count {
+    while ([self isOverCost:cost count:count]) {
+        if (![self evictOneObjectIfOverCost:cost count:count]) {
+            break;
+        }
+    }
+}
+
+- (BOOL)evictOldestObject {
+    return [self evictOneObjectIfOverCost:0 count:0];
+}
+
+- (uint64_t)oldestAccessTime {
+    uint64_t oldestTime = UINT64_MAX;
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        SDShardedMemoryCacheShard *shard = _shards[i];
+        SD_LOCK(shard->_lock);
+        SDShardedMemoryCacheNode *victim = [shard victimNode];
+        if (victim) {
+            oldestTime = MIN(oldestTime, victim->_time);
+        }
+        SD_UNLOCK(shard->_lock);
+    }
+    return oldestTime;
+}
+
+// Evict the globally oldest (or lowest GDSF priority) entry if the cache is still over the limits. Returns NO if there is nothing to evict.
+- (BOOL)evictOneObjectIfOverCost:(NSUInteger)cost count:(NSUInteger)count {
+    SDShardedMemoryCacheShard *oldestShard = nil;
+    double oldestOrder = DBL_MAX;
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        SDShardedMemoryCacheShard *shard = _shards[i];
+        SD_LOCK(shard->_lock);
+        SDShardedMemoryCacheNode *victim = [shard victimNode];
+        if (victim && [shard evictionOrderForNode:victim] < oldestOrder) {
+            oldestOrder = [shard evictionOrderForNode:victim];
+            oldestShard = shard;
+        }
+        SD_UNLOCK(shard->_lock);
+    }
+    if (!oldestShard) {
+        return NO;
+    }
+    SDShardedMemoryCacheNode *evictedNode;
+    SD_LOCK(oldestShard->_lock);
+    // The victim may changed during the scan, this is fine because it's still an old one
+    SDShardedMemoryCacheNode *node = [oldestShard victimNode];
+    if (node && [self isOverCost:cost count:count]) {
+        evictedNode = [self evictNode:node fromShard:oldestShard];
+    }
+    SD_UNLOCK(oldestShard->_lock);
+    // Release outside the lock
+    evictedNode = nil;
+    return YES;
+}
+
+#pragma mark - SDMemoryCache
+
+- (id)objectForKey:(id)key {
+    if (!key) {
+        return nil;
+    }
+    NSUInteger hash = SDShardedMemoryCacheHash([key hash]);
+    SDShardedMemoryCacheShard *shard = _shards[hash & _shardMask];
+    BOOL usesAdmission = [self usesAdmission];
+    id object;
+    BOOL shouldRestore = NO;
+    SD_LOCK(shard->_lock);
+    if (usesAdmission) {
+        // Record the access even if it's a miss, this is how the popular keys get admitted
+        SDShardedMemoryCacheSketchIncrement(&shard->_sketch, hash);
+    }
+    SDShardedMemoryCacheNode *node = [shard nodeForKey:key];
+    if (node) {
+        node->_time = [self tick];
+        [shard touchNode:node];
+        object = node->_value;
+    } else if (shard->_weakCache && self.config.shouldUseWeakMemoryCache) {
+        // Check weak cache
+        object = [shard->_weakCache objectForKey:key];
+        shouldRestore = object != nil;
+    }
+    SD_UNLOCK(shard->_lock);
+    if (shouldRestore) {
+        // Sync cache
+        NSUInteger cost = 0;
+        if ([object isKindOfClass:[UIImage class]]) {
+            cost = [(UIImage *)object sd_memoryCost];
+        }
+        [self setObject:object forKey:key cost:cost];
+    }
+    return object;
+}
+
+- (BOOL)containsObjectForKey:(id)key {
+    if (!key) {
+        return NO;
+    }
+    SDShardedMemoryCacheShard *shard = _shards[SDShardedMemoryCacheHash([key hash]) & _shardMask];
+    SD_LOCK(shard->_lock);
+    BOOL contains = [shard nodeForKey:key] != nil;
+    SD_UNLOCK(shard->_lock);
+    return contains;
+}
+
+- (void)setObject:(id)object forKey:(id)key {
+    [self setObject:object forKey:key cost:0];
+}
+
+- (void)setObject:(id)object forKey:(id)key cost:(NSUInteger)cost {
+    if (!key) {
+        return;
+    }
+    if (!object) {
+        [self removeObjectForKey:key];
+        return;
+    }
+    NSUInteger hash = SDShardedMemoryCacheHash([key hash]);
+    SDShardedMemoryCacheShard *shard = _shards[hash & _shardMask];
+    BOOL usesAdmission = [self usesAdmission];
+    double decodeCost = 0;
+    if ([self usesHeap] && [object isKindOfClass:[UIImage class]]) {
+        decodeCost = [(UIImage *)object sd_decodeTime];
+    }
+    uint64_t now = [self tick];
+
+    SD_LOCK(shard->_lock);
+    if (usesAdmission) {
+        SDShardedMemoryCacheSketchIncrement(&shard->_sketch, hash);
+    }
+    SDShardedMemoryCacheNode *node = [shard nodeForKey:key];
+    id oldValue;
+    if (node) {
+        // Replace the value and fix the accounting
+        oldValue = node->_value;
+        if (cost >= node->_cost) {
+            atomic_fetch_add_explicit(&_totalCost, cost - node->_cost, memory_order_relaxed);
+        } else {
+            atomic_fetch_sub_explicit(&_totalCost, node->_cost - cost, memory_order_relaxed);
+        }
+        [self.registeredBudget addCost:(long long)cost - (long long)node->_cost];
+        [shard updateNode:node cost:cost];
+        node->_value = object;
+        node->_decodeCost = decodeCost;
+        node->_time = now;
+        [shard touchNode:node];
+    } else {
+        node = [SDShardedMemoryCacheNode new];
+        node->_key = key;
+        node->_value = object;
+        node->_cost = cost;
+        node->_hash = hash;
+        node->_time = now;
+        // New entries should pass the admission window first
+        node->_inWindow = usesAdmission;
+        node->_frequency = 1;
+        node->_decodeCost = decodeCost;
+        [shard updatePriorityForNode:node];
+        [self addNode:node toShard:shard];
+    }
+    // It's a strong entry now
+    [shard->_weakCache removeObjectForKey:key];
+    // Evict from the current shard first, which does not need to take another lock
+    NSMutableArray<SDShardedMemoryCacheNode *> *evictedNodes = [self trimShard:shard keepNode:node];
+    SD_UNLOCK(shard->_lock);
+    // Release outside the lock
+    oldValue = nil;
+    evictedNodes = nil;
+
+    if ([self isOverLimit]) {
+        // The current shard does not have enough entries, evict from others
+        [self trimToLimits];
+    }
+    // Keep the total cost of all the caches sharing the budget under its limit
+    [_budget trimIfNeeded];
+}
+
+- (void)removeObjectForKey:(id)key {
+    if (!key) {
+        return;
+    }
+    SDShardedMemoryCacheShard *shard = _shards[SDShardedMemoryCacheHash([key hash]) & _shardMask];
+    SDShardedMemoryCacheNode *removedNode;
+    SD_LOCK(shard->_lock);
+    SDShardedMemoryCacheNode *node = [shard nodeForKey:key];
+    if (node) {
+        removedNode = [self removeNode:node fromShard:shard];
+    }
+    // Manually remove should also remove weak cache
+    [shard->_weakCache removeObjectForKey:key];
+    SD_UNLOCK(shard->_lock);
+    // Release outside the lock
+    removedNode = nil;
+}
+
+- (void)removeAllObjects {
+    [self removeAllObjectsKeepingWeakCache:NO];
+}
+
+- (void)trimToCost:(NSUInteger)cost {
+    [self trimToCost:cost count:NSUIntegerMax];
+}
+
+- (void)enumerateHotKeysWithLimit:(NSUInteger)limit usingBlock:(void (NS_NOESCAPE ^)(id _Nonnull, NSUInteger, BOOL * _Nonnull))block {
+    if (!block) {
+        return;
+    }
+    if (limit == 0) {
+        limit = NSUIntegerMax;
+    }
+    // Collect the most recent entries of each shard (the list heads), then merge them by access time
+    NSMutableArray<SDShardedMemoryCacheNode *> *nodes = [NSMutableArray array];
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        SDShardedMemoryCacheShard *shard = _shards[i];
+        SD_LOCK(shard->_lock);
+        NSUInteger count = 0;
+        for (SDShardedMemoryCacheNode *node = shard->_main.head; node && count < limit; node = node->_next, count++) {
+            [nodes addObject:node];
+        }
+        count = 0;
+        for (SDShardedMemoryCacheNode *node = shard->_window.head; node && count < limit; node = node->_next, count++) {
+            [nodes addObject:node];
+        }
+        SD_UNLOCK(shard->_lock);
+    }
+    // The node fields may be changed by other threads, this is fine because it's only a hint
+    [nodes sortUsingComparator:^NSComparisonResult(SDShardedMemoryCacheNode *node1, SDShardedMemoryCacheNode *node2) {
+        if (node1->_time == node2->_time) {
+            return NSOrderedSame;
+        }
+        return node1->_time > node2->_time ? NSOrderedAscending : NSOrderedDescending;
+    }];
+    BOOL stop = NO;
+    for (NSUInteger i = 0; i < MIN(nodes.count, limit); i++) {
+        SDShardedMemoryCacheNode *node = nodes[i];
+        block(node->_key, node->_cost, &stop);
+        if (stop) {
+            break;
+        }
+    }
+}
+
+- (void)trimToCount:(NSUInteger)count {
+    [self trimToCost:NSUIntegerMax count:count];
+}
+
+- (void)trimToFraction:(double)fraction {
+    if (fraction >= 1) {
+        return;
+    }
+    fraction = MAX(fraction, 0);
+    [self trimToCost:(NSUInteger)(self.totalCost * fraction) count:(NSUInteger)(self.totalCount * fraction)];
+}
+
+- (void)removeAllObjectsKeepingWeakCache:(BOOL)keepWeakCache {
+    BOOL shouldUseWeakMemoryCache = self.config.shouldUseWeakMemoryCache;
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        SDShardedMemoryCacheShard *shard = _shards[i];
+        SD_LOCK(shard->_lock);
+        // Hold the table until unlock, release outside the lock
+        CFMutableDictionaryRef dic = shard->_dic;
+        NSUInteger count = CFDictionaryGetCount(dic);
+        if (count > 0) {
+            if (keepWeakCache && shouldUseWeakMemoryCache) {
+                for (SDShardedMemoryCacheNode *node = shard->_main.head; node; node = node->_next) {
+                    [shard.weakCache setObject:node->_value forKey:node->_key];
+                }
+                for (SDShardedMemoryCacheNode *node = shard->_window.head; node; node = node->_next) {
+                    [shard.weakCache setObject:node->_value forKey:node->_key];
+                }
+            }
+            atomic_fetch_sub_explicit(&_totalCost, shard->_main.cost + shard->_window.cost, memory_order_relaxed);
+            atomic_fetch_sub_explicit(&_totalCount, count, memory_order_relaxed);
+            [self.registeredBudget addCost:-(long long)(shard->_main.cost + shard->_window.cost)];
+            shard->_dic = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+            shard->_main = (SDShardedMemoryCacheList){0};
+            shard->_window = (SDShardedMemoryCacheList){0};
+            shard->_heap.count = 0;
+        } else {
+            dic = NULL;
+        }
+        if (!keepWeakCache) {
+            [shard->_weakCache removeAllObjects];
+        }
+        SD_UNLOCK(shard->_lock);
+        if (dic) {
+            CFRelease(dic);
+        }
+    }
+}
+
+#pragma mark - Memory Warning
+
+// Current this seems no use on macOS (macOS use virtual memory and do not clear cache when memory warning). So we only override on iOS/tvOS platform.
+#if SD_UIKIT
+- (void)didReceiveMemoryWarning:(NSNotification *)notification {
+    [self didReceiveMemoryPressure:NO];
+}
+
+// Trim gradually instead of removing all, so the visible images does not need to be decoded all together. The repeated pressure goes to the next step, the critical pressure starts from the second step.
+- (void)didReceiveMemoryPressure:(BOOL)critical {
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    NSTimeInterval interval = now - _lastMemoryPressureTime;
+    BOOL merged = _lastMemoryPressureTime > 0 && interval < kSDShardedMemoryCacheMemoryPressureMergeInterval;
+    NSUInteger step;
+    if (_lastMemoryPressureTime <= 0 || interval > kSDShardedMemoryCacheMemoryPressureResetInterval) {
+        step = 0;
+    } else if (merged) {
+        step = _memoryPressureStep;
+    } else {
+        step = _memoryPressureStep + 1;
+    }
+    if (critical) {
+        step = MAX(step, 1);
+    }
+    NSUInteger stepCount = sizeof(kSDShardedMemoryCacheMemoryPressureFractions) / sizeof(kSDShardedMemoryCacheMemoryPressureFractions[0]);
+    step = MIN(step, stepCount - 1);
+    _lastMemoryPressureTime = now;
+    if (merged && step <= _memoryPressureStep) {
+        // Already trimmed for this pressure
+        return;
+    }
+    _memoryPressureStep = step;
+    double fraction = kSDShardedMemoryCacheMemoryPressureFractions[step];
+    if (fraction > 0) {
+        [self trimToFraction:fraction];
+    } else {
+        // Only remove cache, but keep weak cache
+        [self removeAllObjectsKeepingWeakCache:YES];
+    }
+}
+#endif
+
+#pragma mark - KVO
+
+- (void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary<NSKeyValueChangeKey,id> *)change context:(void *)context {
+    if (context == SDShardedMemoryCacheContext) {
+        if ([keyPath isEqualToString:NSStringFromSelector(@selector(maxMemoryCost))]) {
+            self.costLimit = self.config.maxMemoryCost;
+        } else if ([keyPath isEqualToString:NSStringFromSelector(@selector(maxMemoryCount))]) {
+            self.countLimit = self.config.maxMemoryCount;
+        }
+        // Apply the new limits immediately
+        [self trimToLimits];
+    } else {
+        [super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
+    }
+}
+
+@end
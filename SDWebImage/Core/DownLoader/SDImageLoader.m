@@ -12,6 +12,8 @@
 #import "SDImageCoderHelper.h"
 #import "SDAnimatedImage.h"
 #import "UIImage+Metadata.h"
+#import "UIImage+MemoryCacheCost.h"
+#import "SDShardedMemoryCache+Private.h"
 #import "SDInternalMacros.h"
 #import "objc/runtime.h"
 
@@ -39,6 +41,8 @@ UIImage * _Nullable SDImageLoaderDecodeImageData(NSData * _Nonnull imageData, NS
         coderOptions = [mutableCoderOptions copy];
     }
     
+    // Measure the decode cost, used by the memory cache eviction
+    CFAbsoluteTime decodeStartTime = CFAbsoluteTimeGetCurrent();
     if (!decodeFirstFrame) {
         // check whether we should use `SDAnimatedImage`
         Class animatedImageClass = context[SDWebImageContextAnimatedImageClass];
@@ -78,6 +82,9 @@ UIImage * _Nullable SDImageLoaderDecodeImageData(NSData * _Nonnull imageData, NS
                 image = [SDImageCoderHelper decodedImageWithImage:image];
             }
         }
+        if (SDImageCacheShouldRecordDecodeTime()) {
+            image.sd_decodeTime = CFAbsoluteTimeGetCurrent() - decodeStartTime;
+        }
     }
     
     return image;
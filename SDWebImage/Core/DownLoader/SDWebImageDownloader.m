@@ -41,6 +41,9 @@ static void * SDWebImageDownloaderContext = &SDWebImageDownloaderContext;
 @property (strong, nonatomic, nullable) NSMutableDictionary<NSString *, NSString *> *HTTPHeaders;
 @property (strong, nonatomic, nonnull) dispatch_semaphore_t HTTPHeadersLock; // A lock to keep the access to `HTTPHeaders` thread-safe
 @property (strong, nonatomic, nonnull) dispatch_semaphore_t operationsLock; // A lock to keep the access to `URLOperations` thread-safe
+@property (strong, nonatomic, nonnull) NSMapTable<NSNumber *, NSOperation<SDWebImageDownloaderOperation> *> *taskOperations; // The running operations keyed by the task identifier
+@property (strong, nonatomic, nonnull) dispatch_semaphore_t taskOperationsLock; // A lock to keep the access to `taskOperations` and `observedOperations` thread-safe
+@property (strong, nonatomic, nonnull) NSHashTable<NSOperation<SDWebImageDownloaderOperation> *> *observedOperations; // The operations observed for `dataTask`, not finished yet
 
 // The session in which data tasks will run
 @property (strong, nonatomic) NSURLSession *session;
@@ -122,6 +125,9 @@ static void * SDWebImageDownloaderContext = &SDWebImageDownloaderContext;
         _HTTPHeaders = headerDictionary;
         _HTTPHeadersLock = dispatch_semaphore_create(1);
         _operationsLock = dispatch_semaphore_create(1);
+        _taskOperations = [NSMapTable strongToWeakObjectsMapTable];
+        _taskOperationsLock = dispatch_semaphore_create(1);
+        _observedOperations = [NSHashTable weakObjectsHashTable];
         NSURLSessionConfiguration *sessionConfiguration = _config.sessionConfiguration;
         if (!sessionConfiguration) {
             sessionConfiguration = [NSURLSessionConfiguration defaultSessionConfiguration];
@@ -144,6 +150,13 @@ static void * SDWebImageDownloaderContext = &SDWebImageDownloaderContext;
     
     [self.downloadQueue cancelAllOperations];
     [self.config removeObserver:self forKeyPath:NSStringFromSelector(@selector(maxConcurrentDownloads)) context:SDWebImageDownloaderContext];
+    // The completion block of the cancelled operation can not remove the observer after the downloader is gone
+    SD_LOCK(self.taskOperationsLock);
+    for (NSOperation<SDWebImageDownloaderOperation> *operation in self.observedOperations) {
+        [operation removeObserver:self forKeyPath:NSStringFromSelector(@selector(dataTask)) context:SDWebImageDownloaderContext];
+    }
+    [self.observedOperations removeAllObjects];
+    SD_UNLOCK(self.taskOperationsLock);
 }
 
 - (void)invalidateSessionAndCancel:(BOOL)cancelPendingOperations {
@@ -221,9 +234,19 @@ static void * SDWebImageDownloaderContext = &SDWebImageDownloaderContext;
             }
             return nil;
         }
+        // Register the task when the operation creates it, which is before the task is resumed, so the delegate callbacks find the operation without scanning the queue
+        BOOL observesTask = [operation respondsToSelector:@selector(dataTask)];
+        if (observesTask) {
+            SD_LOCK(self.taskOperationsLock);
+            [self.observedOperations addObject:operation];
+            SD_UNLOCK(self.taskOperationsLock);
+            [operation addObserver:self forKeyPath:NSStringFromSelector(@selector(dataTask)) options:NSKeyValueObservingOptionNew context:SDWebImageDownloaderContext];
+        }
         @weakify(self);
+        @weakify(operation);
         operation.completionBlock = ^{
             @strongify(self);
+            @strongify(operation);
             if (!self) {
                 return;
             }
@@ -231,6 +254,15 @@ static void * SDWebImageDownloaderContext = &SDWebImageDownloaderContext;
             // 完成以后从 URLOperations 中移除
             [self.URLOperations removeObjectForKey:url];
             SD_UNLOCK(self.operationsLock);
+            if (observesTask && operation) {
+                SD_LOCK(self.taskOperationsLock);
+                BOOL isObserved = [self.observedOperations containsObject:operation];
+                [self.observedOperations removeObject:operation];
+                SD_UNLOCK(self.taskOperationsLock);
+                if (isObserved) {
+                    [operation removeObserver:self forKeyPath:NSStringFromSelector(@selector(dataTask)) context:SDWebImageDownloaderContext];
+                }
+            }
         };
         self.URLOperations[url] = operation;
         // Add operation to operation queue only after all configuration done according to Apple's doc.
@@ -419,6 +451,13 @@ static void * SDWebImageDownloaderContext = &SDWebImageDownloaderContext;
     if (context == SDWebImageDownloaderContext) {
         if ([keyPath isEqualToString:NSStringFromSelector(@selector(maxConcurrentDownloads))]) {
             self.downloadQueue.maxConcurrentOperationCount = self.config.maxConcurrentDownloads;
+        } else if ([keyPath isEqualToString:NSStringFromSelector(@selector(dataTask))]) {
+            NSURLSessionTask *task = change[NSKeyValueChangeNewKey];
+            if ([task isKindOfClass:[NSURLSessionTask class]]) {
+                SD_LOCK(self.taskOperationsLock);
+                [self.taskOperations setObject:object forKey:@(task.taskIdentifier)];
+                SD_UNLOCK(self.taskOperationsLock);
+            }
         }
     } else {
         [super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
@@ -428,7 +467,17 @@ static void * SDWebImageDownloaderContext = &SDWebImageDownloaderContext;
 #pragma mark Helper methods
 
 - (NSOperation<SDWebImageDownloaderOperation> *)operationWithTask:(NSURLSessionTask *)task {
-    NSOperation<SDWebImageDownloaderOperation> *returnOperation = nil;
+    // The task is registered by observing the operation's `dataTask` when it's created
+    // 任务在 operation 创建它时注册，不需要遍历队列
+    NSNumber *taskIdentifier = @(task.taskIdentifier);
+    SD_LOCK(self.taskOperationsLock);
+    NSOperation<SDWebImageDownloaderOperation> *returnOperation = [self.taskOperations objectForKey:taskIdentifier];
+    SD_UNLOCK(self.taskOperationsLock);
+    if (returnOperation) {
+        return returnOperation;
+    }
+    // The custom operation may set its `dataTask` without KVO, so the first delegate callback of its task scans the queue once and registers the result
+    // 自定义 operation 可能不触发 KVO，这种任务只在第一次回调时遍历一次队列
     for (NSOperation<SDWebImageDownloaderOperation> *operation in self.downloadQueue.operations) {
         if ([operation respondsToSelector:@selector(dataTask)]) {
             if (operation.dataTask.taskIdentifier == task.taskIdentifier) {
@@ -437,6 +486,11 @@ static void * SDWebImageDownloaderContext = &SDWebImageDownloaderContext;
             }
         }
     }
+    if (returnOperation) {
+        SD_LOCK(self.taskOperationsLock);
+        [self.taskOperations setObject:returnOperation forKey:taskIdentifier];
+        SD_UNLOCK(self.taskOperationsLock);
+    }
     return returnOperation;
 }
 
@@ -502,6 +556,10 @@ didReceiveResponse:(NSURLResponse *)response
     if ([dataOperation respondsToSelector:@selector(URLSession:task:didCompleteWithError:)]) {
         [dataOperation URLSession:session task:task didCompleteWithError:error];
     }
+    // The task will not call back anymore
+    SD_LOCK(self.taskOperationsLock);
+    [self.taskOperations removeObjectForKey:@(task.taskIdentifier)];
+    SD_UNLOCK(self.taskOperationsLock);
 }
 
 - (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task willPerformHTTPRedirection:(NSHTTPURLResponse *)response newRequest:(NSURLRequest *)request completionHandler:(void (^)(NSURLRequest * _Nullable))completionHandler {
@@ -22,6 +22,16 @@ const float NSURLSessionTaskPriorityLow = 0.25;
 static NSString *const kProgressCallbackKey = @"progress";
 static NSString *const kCompletedCallbackKey = @"completed";
 
+// The receive buffer capacity when the expected size is unknown, it's doubled when full
+static const NSUInteger kSDWebImageDownloaderMinimumReceiveBufferCapacity = 16 * 1024;
+
+// Wrap the prefix of the buffer without copy, the buffer is retained until the snapshot is released
+static inline NSData * SDDataSnapshotWithBuffer(NSData *buffer, NSUInteger length) {
+    return (NSData *)dispatch_data_create(buffer.bytes, length, NULL, ^{
+        [buffer self];
+    });
+}
+
 typedef NSMutableDictionary<NSString *, id> SDCallbacksDictionary;
 
 @interface SDWebImageDownloaderOperation ()
@@ -33,7 +43,9 @@ typedef NSMutableDictionary<NSString *, id> SDCallbacksDictionary;
 
 @property (assign, nonatomic, getter = isExecuting) BOOL executing;
 @property (assign, nonatomic, getter = isFinished) BOOL finished;
-@property (strong, nonatomic, nullable) NSMutableData *imageData;
+@property (strong, nonatomic, nullable) NSMutableData *imageData; // the receive buffer, its length is the capacity and the first `receivedSize` bytes are received
+@property (strong, atomic, nullable) NSData *progressiveData; // the latest snapshot for progressive decoding
+@property (assign, nonatomic) NSUInteger imageDataCopiedSize; // the bytes copied when the receive buffer grows
 @property (copy, nonatomic, nullable) NSData *cachedData; // for `SDWebImageDownloaderIgnoreCachedResponse`
 @property (assign, nonatomic) NSUInteger expectedSize; // may be 0
 @property (assign, nonatomic) NSUInteger receivedSize;
@@ -370,13 +382,31 @@ didReceiveResponse:(NSURLResponse *)response
 
 // 接收数据后的处理
 - (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveData:(NSData *)data {
-    if (!self.imageData) {
-        self.imageData = [[NSMutableData alloc] initWithCapacity:self.expectedSize];
+    // 拼接数据，追加到连续的缓冲区，容量不足时按倍数扩容
+    NSUInteger receivedSize = self.receivedSize + data.length;
+    NSUInteger capacity = self.imageData.length;
+    if (receivedSize > capacity) {
+        NSUInteger newCapacity;
+        if (capacity == 0 && self.expectedSize >= receivedSize) {
+            // The expected size is known, usually no more growth
+            newCapacity = self.expectedSize;
+        } else {
+            newCapacity = MAX(MAX(capacity * 2, kSDWebImageDownloaderMinimumReceiveBufferCapacity), receivedSize);
+        }
+        // Always a new buffer, the snapshots being decoded still reference the former one
+        NSMutableData *buffer = [NSMutableData dataWithLength:newCapacity];
+        if (self.receivedSize > 0) {
+            memcpy(buffer.mutableBytes, self.imageData.bytes, self.receivedSize);
+            self.imageDataCopiedSize += self.receivedSize;
+        }
+        self.imageData = buffer;
     }
-    // 拼接数据
-    [self.imageData appendData:data];
-    
-    self.receivedSize = self.imageData.length;
+    // The bytes after the snapshots are written, the snapshots are never modified
+    uint8_t *bytes = (uint8_t *)self.imageData.mutableBytes + self.receivedSize;
+    [data enumerateByteRangesUsingBlock:^(const void * _Nonnull rangeBytes, NSRange byteRange, BOOL * _Nonnull stop) {
+        memcpy(bytes + byteRange.location, rangeBytes, byteRange.length);
+    }];
+    self.receivedSize = receivedSize;
     if (self.expectedSize == 0) {
         // 如果不知道期望图片的大下 直接返回
         // Unknown expectedSize, immediately call progressBlock and return
@@ -406,15 +436,20 @@ didReceiveResponse:(NSURLResponse *)response
     // Using data decryptor will disable the progressive decoding, since there are no support for progressive decrypt
     BOOL supportProgressive = (self.options & SDWebImageDownloaderProgressiveLoad) && !self.decryptor;
     if (supportProgressive) {
-        // Get the image data
-        NSData *imageData = [self.imageData copy];
+        // Get the image data, the snapshot is the received prefix of the buffer without copy
+        NSData *snapshot = SDDataSnapshotWithBuffer(self.imageData, self.receivedSize);
+        self.progressiveData = snapshot;
         
         // progressive decode the image in coder queue
         // 渐进解码编码器队列中的图像 进行异步解压缩操作
         dispatch_async(self.coderQueue, ^{
+            // A newer snapshot is waiting, skip this one to avoid decoding the stale data
+            if (!finished && self.progressiveData != snapshot) {
+                return;
+            }
             // 解压过程中会有很多的临时中间变量，消耗内存所以使用自动释放池 runloop到before waiting清理
             @autoreleasepool {
-                UIImage *image = SDImageLoaderDecodeProgressiveImageData(imageData, self.request.URL, finished, self, [[self class] imageOptionsFromDownloaderOptions:self.options], self.context);
+                UIImage *image = SDImageLoaderDecodeProgressiveImageData(snapshot, self.request.URL, finished, self, [[self class] imageOptionsFromDownloaderOptions:self.options], self.context);
                 if (image) {
                     // We do not keep the progressive decoding image even when `finished`=YES. Because they are for view rendering but not take full function from downloader options. And some coders implementation may not keep consistent between progressive decoding and normal decoding.
                     
@@ -476,9 +511,18 @@ didReceiveResponse:(NSURLResponse *)response
         [self done];
     } else {
         if ([self callbacksForKey:kCompletedCallbackKey].count > 0) {
-            NSData *imageData = [self.imageData copy];
+            NSData *imageData;
+            if (self.receivedSize == self.imageData.length) {
+                // The buffer is full, usually the expected size is known, use it without copy
+                imageData = self.imageData ? SDDataSnapshotWithBuffer(self.imageData, self.receivedSize) : nil;
+            } else {
+                // Do not keep the spare capacity with the image data
+                imageData = [NSData dataWithBytes:self.imageData.bytes length:self.receivedSize];
+            }
             // /下载完成，将本地的imageData置为nil，防止下次进入数据出错
             self.imageData = nil;
+            self.receivedSize = 0;
+            self.progressiveData = nil;
             // data decryptor
             if (imageData && self.decryptor) {
                 imageData = [self.decryptor decryptedDataWithData:imageData response:self.response];
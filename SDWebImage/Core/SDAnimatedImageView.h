@@ -48,6 +48,7 @@
  `0` means automatically adjust by calculating current memory usage.
  `1` means without any buffer cache, each of frames will be decoded and then be freed after rendering. (Lowest Memory and Highest CPU)
  `NSUIntegerMax` means cache all the buffer. (Lowest CPU and Highest Memory)
+ @note On memory warning, the frame buffer is trimmed gradually. The first warning keeps half of the buffered frames (the ones will be rendered soon), the repeated one only keeps the current frame.
  */
 @property (nonatomic, assign) NSUInteger maxBufferSize;
 /**
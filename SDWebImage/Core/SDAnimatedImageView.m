@@ -22,6 +22,9 @@
 static CVReturn DisplayLinkCallback(CVDisplayLinkRef displayLink, const CVTimeStamp *inNow, const CVTimeStamp *inOutputTime, CVOptionFlags flagsIn, CVOptionFlags *flagsOut, void *displayLinkContext);
 #endif
 
+// The memory warning within this interval is treated as a repeated one, and the frame buffer limit is restored after it
+static const NSTimeInterval kSDAnimatedImageViewMemoryWarningCooldown = 30;
+
 static NSUInteger SDDeviceTotalMemory() {
     return (NSUInteger)[[NSProcessInfo processInfo] physicalMemory];
 }
@@ -57,6 +60,7 @@ static NSUInteger SDDeviceFreeMemory() {
 @property (nonatomic, assign) BOOL shouldAnimate;
 @property (nonatomic, assign) BOOL isProgressive;
 @property (nonatomic, assign) NSUInteger maxBufferCount;
+@property (nonatomic, assign) CFAbsoluteTime lastMemoryWarningTime;
 @property (nonatomic, strong) NSOperationQueue *fetchQueue;
 @property (nonatomic, strong) dispatch_semaphore_t lock;
 @property (nonatomic, assign) CGFloat animatedImageScale;
@@ -352,16 +356,35 @@ static NSUInteger SDDeviceFreeMemory() {
 }
 
 - (void)didReceiveMemoryWarning:(NSNotification *)notification {
+    // Trim gradually, the first warning keeps half of the frame buffer, the repeated one (within 30 seconds) only keeps the current frame
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    BOOL repeated = self.lastMemoryWarningTime > 0 && now - self.lastMemoryWarningTime < kSDAnimatedImageViewMemoryWarningCooldown;
+    self.lastMemoryWarningTime = now;
+    // Avoid refilling the buffer immediately, the limit is recalculated after the cooldown
+    self.maxBufferCount = MAX(self.maxBufferCount / 2, 1);
+    @weakify(self);
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kSDAnimatedImageViewMemoryWarningCooldown * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        @strongify(self);
+        // Only restore after the last warning
+        if (!self || self.lastMemoryWarningTime != now) {
+            return;
+        }
+        [self calculateMaxBufferCount];
+    });
     [_fetchQueue cancelAllOperations];
     [_fetchQueue addOperationWithBlock:^{
-        NSNumber *currentFrameIndex = @(self.currentFrameIndex);
+        NSUInteger currentFrameIndex = self.currentFrameIndex;
+        NSUInteger totalFrameCount = MAX(self.totalFrameCount, 1);
         SD_LOCK(self.lock);
-        NSArray *keys = self.frameBuffer.allKeys;
-        // only keep the next frame for later rendering
-        for (NSNumber * key in keys) {
-            if (![key isEqualToNumber:currentFrameIndex]) {
-                [self.frameBuffer removeObjectForKey:key];
-            }
+        NSUInteger keepCount = repeated ? 1 : self.frameBuffer.count / 2;
+        // Keep the frames which will be rendered soon, the current frame is always the first one
+        NSArray<NSNumber *> *keys = [self.frameBuffer.allKeys sortedArrayUsingComparator:^NSComparisonResult(NSNumber *key1, NSNumber *key2) {
+            NSUInteger distance1 = (key1.unsignedIntegerValue + totalFrameCount - currentFrameIndex) % totalFrameCount;
+            NSUInteger distance2 = (key2.unsignedIntegerValue + totalFrameCount - currentFrameIndex) % totalFrameCount;
+            return [@(distance1) compare:@(distance2)];
+        }];
+        for (NSUInteger i = MAX(keepCount, 1); i < keys.count; i++) {
+            [self.frameBuffer removeObjectForKey:keys[i]];
         }
         SD_UNLOCK(self.lock);
     }];
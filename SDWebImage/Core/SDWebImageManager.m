@@ -24,6 +24,8 @@ static id<SDImageLoader> _defaultImageLoader;
 @property (strong, nonatomic, readwrite, nullable) id<SDWebImageOperation> cacheOperation;
 @property (weak, nonatomic, nullable) SDWebImageManager *manager;
 
++ (nonnull SDWebImageCombinedOperation *)finishedOperation;
+
 @end
 
 @interface SDWebImageManager ()
@@ -153,6 +155,11 @@ static id<SDImageLoader> _defaultImageLoader;
         url = nil;
     }
     
+    // The memory cache hit is answered synchronously, without the combined operation and the processed options result
+    if ([self callMemoryCacheProcessForURL:url options:options context:context completed:completedBlock]) {
+        return [SDWebImageCombinedOperation finishedOperation];
+    }
+    
     //为了在单例中区分区分每次的加载图片任务，需要创建一个 operation 表示一个加载任务
     SDWebImageCombinedOperation *operation = [SDWebImageCombinedOperation new];
     operation.manager = self;
@@ -204,6 +211,51 @@ static id<SDImageLoader> _defaultImageLoader;
 
 #pragma mark - Private
 
+// Memory cache process, returns YES if the image is found in memory cache and the completion block is called. This is the fast path for the memory cache hit, which does not allocate any object for the common case, so it should bail out to the normal process for anything needs the processed options result
+- (BOOL)callMemoryCacheProcessForURL:(nullable NSURL *)url
+                             options:(SDWebImageOptions)options
+                             context:(nullable SDWebImageContext *)context
+                           completed:(nonnull SDInternalCompletionBlock)completedBlock {
+    if (!url || self.optionsProcessor || ![self.imageCache isKindOfClass:[SDImageCache class]]) {
+        return NO;
+    }
+    // The options need the image data, the network request, or the memory image check
+    if (options & (SDWebImageFromLoaderOnly | SDWebImageRefreshCached | SDWebImageQueryMemoryData | SDWebImageDecodeFirstFrameOnly | SDWebImageMatchAnimatedImageClass)) {
+        return NO;
+    }
+    if (url.absoluteString.length == 0) {
+        return NO;
+    }
+    if (!(options & SDWebImageRetryFailed)) {
+        SD_LOCK(self.failedURLsLock);
+        BOOL isFailedUrl = [self.failedURLs containsObject:url];
+        SD_UNLOCK(self.failedURLsLock);
+        if (isFailedUrl) {
+            return NO;
+        }
+    }
+    
+    // Same as the cache key of `processedResultForURL:options:context:`
+    id<SDWebImageCacheKeyFilter> cacheKeyFilter = context[SDWebImageContextCacheKeyFilter];
+    if (!cacheKeyFilter) {
+        cacheKeyFilter = self.cacheKeyFilter;
+    }
+    NSString *key = [self cacheKeyForURL:url cacheKeyFilter:cacheKeyFilter];
+    id<SDImageTransformer> transformer = context[SDWebImageContextImageTransformer];
+    if (!transformer) {
+        transformer = self.transformer;
+    }
+    if (transformer) {
+        key = SDTransformedKeyForKey(key, transformer.transformerKey);
+    }
+    UIImage *image = [self.imageCache imageFromMemoryCacheForKey:key];
+    if (!image) {
+        return NO;
+    }
+    [self callCompletionBlockForOperation:nil completion:completedBlock image:image data:nil error:nil cacheType:SDImageCacheTypeMemory finished:YES url:url];
+    return YES;
+}
+
 // Query cache process 查找缓存的过程
 - (void)callCacheProcessForOperation:(nonnull SDWebImageCombinedOperation *)operation
                                  url:(nonnull NSURL *)url
@@ -515,8 +567,30 @@ static id<SDImageLoader> _defaultImageLoader;
 @end
 
 
+// The finished operation of the memory cache hit, which is shared, so it's never cancelled
+@interface SDWebImageFinishedCombinedOperation : SDWebImageCombinedOperation
+
+@end
+
+@implementation SDWebImageFinishedCombinedOperation
+
+- (void)cancel {
+    // Nothing to cancel
+}
+
+@end
+
 @implementation SDWebImageCombinedOperation
 
++ (SDWebImageCombinedOperation *)finishedOperation {
+    static dispatch_once_t onceToken;
+    static SDWebImageCombinedOperation *operation;
+    dispatch_once(&onceToken, ^{
+        operation = [SDWebImageFinishedCombinedOperation new];
+    });
+    return operation;
+}
+
 // 取消当前操作
 - (void)cancel {
     @synchronized(self) {
@@ -24,4 +24,11 @@
  */
 @property (assign, nonatomic) NSUInteger sd_memoryCost;
 
+/**
+ The time in seconds spent to decode the image (including the force decode), used by memory cache's cost-aware eviction. See `SDImageCacheConfigEvictionPolicyGDSF`.
+ This is recorded by `SDImageCacheDecodeImageData` and `SDImageLoaderDecodeImageData`, only after a memory cache using `SDImageCacheConfigEvictionPolicyGDSF` is created. Defaults to 0, which means unknown, the memory cache will estimate it from the memory cost.
+ @note If you decode the image by yourself, you can set the measured value before storing it into the image cache.
+ */
+@property (assign, nonatomic) NSTimeInterval sd_decodeTime;
+
 @end
@@ -43,4 +43,13 @@ FOUNDATION_STATIC_INLINE NSUInteger SDMemoryCacheCostForImage(UIImage *image) {
     objc_setAssociatedObject(self, @selector(sd_memoryCost), @(sd_memoryCost), OBJC_ASSOCIATION_RETAIN_NONATOMIC);
 }
 
+- (NSTimeInterval)sd_decodeTime {
+    NSNumber *value = objc_getAssociatedObject(self, @selector(sd_decodeTime));
+    return value.doubleValue;
+}
+
+- (void)setSd_decodeTime:(NSTimeInterval)sd_decodeTime {
+    objc_setAssociatedObject(self, @selector(sd_decodeTime), @(sd_decodeTime), OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+}
+
 @end
@@ -0,0 +1,66 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDWebImageCompat.h"
+
+#define SD_DISK_CACHE_INDEX_DIGEST_LENGTH 16
+// The extension longer than this is not added to the file name when the index is used
+#define SD_DISK_CACHE_INDEX_MAX_EXTENSION_LENGTH 22
+
+// One slot of the index, 64 bytes
+typedef struct SDDiskCacheIndexEntry {
+    uint8_t digest[SD_DISK_CACHE_INDEX_DIGEST_LENGTH]; // The hash of key, which is the file name without extension
+    uint64_t size;
+    NSTimeInterval modificationDate; // Since reference date
+    NSTimeInterval accessDate; // Since reference date
+    uint8_t used;
+    char extension[SD_DISK_CACHE_INDEX_MAX_EXTENSION_LENGTH + 1]; // NUL-terminated, empty for no extension
+} SDDiskCacheIndexEntry;
+
+// The 128-bit MurmurHash3 (x64) of the data, which is the digest of the cache file name. `SD_DISK_CACHE_INDEX_DIGEST_LENGTH` bytes are written to `digest`.
+FOUNDATION_EXPORT void SDDiskCacheMurmurHash3(const void * _Nonnull key, size_t length, uint8_t * _Nonnull digest);
+
+// A persistent hash index for the files of `SDDiskCache`, stored in a memory-mapped file. The slots use open addressing with linear probing, and backward shift deletion so no tombstone is needed.
+// The count and total size are kept in the header, so they are O(1).
+@interface SDDiskCacheIndex : NSObject
+
+// Whether the index file is newly created or reset because it's invalid. The caller should rebuild it from the files.
+@property (nonatomic, assign, readonly, getter=isCreated) BOOL created;
+
+// Whether the index is dropped because it can not grow, e.g. the disk is full. The caller should fall back to the files, the index file is rebuilt on the next launch.
+@property (nonatomic, assign, readonly, getter=isInvalidated) BOOL invalidated;
+
+@property (nonatomic, assign, readonly) NSUInteger count;
+@property (nonatomic, assign, readonly) NSUInteger totalSize;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
+
+// Open or create the index file, returns nil if the file can not be mapped.
+- (nullable instancetype)initWithPath:(nonnull NSString *)path;
+
+// Returns the index shared by all the callers with the same path in the process, opens it if needed. The `rebuildBlock` is called only when the index file is newly created or reset, before any other caller can get it.
++ (nullable instancetype)sharedIndexWithPath:(nonnull NSString *)path rebuildBlock:(nullable void (^)(SDDiskCacheIndex * _Nonnull index))rebuildBlock;
+
+// Copy the entry into `entry`, returns NO if not found.
+- (BOOL)getEntry:(nullable SDDiskCacheIndexEntry *)entry forDigest:(const uint8_t * _Nonnull)digest;
+
+// Insert or replace the entry with the same digest, returns NO if the index is invalidated.
+- (BOOL)setEntry:(const SDDiskCacheIndexEntry * _Nonnull)entry;
+
+// Update the access date, returns NO if not found.
+- (BOOL)updateAccessDate:(NSTimeInterval)date forDigest:(const uint8_t * _Nonnull)digest;
+
+// Remove the entry and copy it into `entry`, returns NO if not found.
+- (BOOL)removeEntry:(nullable SDDiskCacheIndexEntry *)entry forDigest:(const uint8_t * _Nonnull)digest;
+
+- (void)removeAllEntries;
+
+// Copy all the entries into a packed `SDDiskCacheIndexEntry` array, so the caller can sort or enumerate it without lock.
+- (nonnull NSData *)copyAllEntries;
+
+@end
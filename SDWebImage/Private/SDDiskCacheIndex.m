@@ -0,0 +1,391 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDDiskCacheIndex.h"
+#import "SDInternalMacros.h"
+#import <fcntl.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <unistd.h>
+
+static const uint32_t kSDDiskCacheIndexMagic = 0x58444953; // "SDIX"
+static const uint32_t kSDDiskCacheIndexVersion = 1;
+static const uint64_t kSDDiskCacheIndexInitialCapacity = 1024;
+static const double kSDDiskCacheIndexMaxLoadFactor = 0.75;
+
+typedef struct SDDiskCacheIndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity; // Always a power of two
+    uint64_t count;
+    uint64_t totalSize;
+    uint8_t reserved[32];
+} SDDiskCacheIndexHeader;
+
+_Static_assert(sizeof(SDDiskCacheIndexEntry) == 64, "The index slot should be 64 bytes");
+_Static_assert(sizeof(SDDiskCacheIndexHeader) == 64, "The index header should be 64 bytes");
+
+static inline size_t SDDiskCacheIndexFileSize(uint64_t capacity) {
+    return sizeof(SDDiskCacheIndexHeader) + (size_t)capacity * sizeof(SDDiskCacheIndexEntry);
+}
+
+// The digest is already a uniform hash
+static inline uint64_t SDDiskCacheIndexHomeSlot(const uint8_t *digest, uint64_t mask) {
+    uint64_t hash;
+    memcpy(&hash, digest, sizeof(hash));
+    return hash & mask;
+}
+
+@interface SDDiskCacheIndex () {
+    int _fd;
+    void *_map;
+    size_t _mapSize;
+    SDDiskCacheIndexHeader *_header;
+    SDDiskCacheIndexEntry *_entries;
+    dispatch_semaphore_t _lock;
+    BOOL _syncScheduled;
+    BOOL _invalidated;
+}
+
+@property (nonatomic, copy) NSString *path;
+
+@end
+
+@implementation SDDiskCacheIndex
+
+- (instancetype)init {
+    NSAssert(NO, @"Use `initWithPath:` with the index file path");
+    return nil;
+}
+
++ (instancetype)sharedIndexWithPath:(NSString *)path rebuildBlock:(void (^)(SDDiskCacheIndex * _Nonnull))rebuildBlock {
+    static NSMapTable<NSString *, SDDiskCacheIndex *> *indexes;
+    static dispatch_semaphore_t indexesLock;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        indexes = [NSMapTable strongToWeakObjectsMapTable];
+        indexesLock = dispatch_semaphore_create(1);
+    });
+    // The index file is renamed when it grows, so the caches on the same path should share one mapping, otherwise the others keep writing to the stale one
+    SD_LOCK(indexesLock);
+    SDDiskCacheIndex *index = [indexes objectForKey:path];
+    if (!index) {
+        index = [[self alloc] initWithPath:path];
+        if (index) {
+            if (index.isCreated && rebuildBlock) {
+                rebuildBlock(index);
+            }
+            [indexes setObject:index forKey:path];
+        }
+    }
+    SD_UNLOCK(indexesLock);
+    return index;
+}
+
+- (instancetype)initWithPath:(NSString *)path {
+    if (self = [super init]) {
+        _path = [path copy];
+        _lock = dispatch_semaphore_create(1);
+        _fd = open(path.fileSystemRepresentation, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (_fd < 0) {
+            return nil;
+        }
+        struct stat st;
+        if (fstat(_fd, &st) != 0) {
+            return nil;
+        }
+        SDDiskCacheIndexHeader header = {0};
+        BOOL valid = NO;
+        if ((size_t)st.st_size >= sizeof(header) && pread(_fd, &header, sizeof(header), 0) == sizeof(header)) {
+            valid = header.magic == kSDDiskCacheIndexMagic
+            && header.version == kSDDiskCacheIndexVersion
+            && header.capacity > 0 && (header.capacity & (header.capacity - 1)) == 0
+            && (size_t)st.st_size == SDDiskCacheIndexFileSize(header.capacity);
+        }
+        if (!valid) {
+            // The new file is zero filled, which means every slot is empty
+            if (ftruncate(_fd, 0) != 0 || ftruncate(_fd, (off_t)SDDiskCacheIndexFileSize(kSDDiskCacheIndexInitialCapacity)) != 0) {
+                return nil;
+            }
+            _created = YES;
+        }
+        if (![self mapFile]) {
+            return nil;
+        }
+        if (!valid) {
+            // The magic is written last, so a half initialized file is reset on the next launch
+            _header->version = kSDDiskCacheIndexVersion;
+            _header->capacity = kSDDiskCacheIndexInitialCapacity;
+            _header->magic = kSDDiskCacheIndexMagic;
+            msync(_map, _mapSize, MS_ASYNC);
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_map) {
+        munmap(_map, _mapSize);
+    }
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+- (BOOL)mapFile {
+    struct stat st;
+    if (fstat(_fd, &st) != 0) {
+        return NO;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (map == MAP_FAILED) {
+        return NO;
+    }
+    _map = map;
+    _mapSize = (size_t)st.st_size;
+    _header = map;
+    _entries = (SDDiskCacheIndexEntry *)((uint8_t *)map + sizeof(SDDiskCacheIndexHeader));
+    return YES;
+}
+
+#pragma mark - Public
+
+- (NSUInteger)count {
+    SD_LOCK(_lock);
+    NSUInteger count = (NSUInteger)_header->count;
+    SD_UNLOCK(_lock);
+    return count;
+}
+
+- (NSUInteger)totalSize {
+    SD_LOCK(_lock);
+    NSUInteger totalSize = (NSUInteger)_header->totalSize;
+    SD_UNLOCK(_lock);
+    return totalSize;
+}
+
+- (BOOL)isInvalidated {
+    SD_LOCK(_lock);
+    BOOL invalidated = _invalidated;
+    SD_UNLOCK(_lock);
+    return invalidated;
+}
+
+- (BOOL)getEntry:(SDDiskCacheIndexEntry *)entry forDigest:(const uint8_t *)digest {
+    SD_LOCK(_lock);
+    SDDiskCacheIndexEntry *slot = [self slotForDigest:digest];
+    if (slot && entry) {
+        *entry = *slot;
+    }
+    SD_UNLOCK(_lock);
+    return slot != NULL;
+}
+
+- (BOOL)setEntry:(const SDDiskCacheIndexEntry *)entry {
+    SD_LOCK(_lock);
+    if (_invalidated) {
+        SD_UNLOCK(_lock);
+        return NO;
+    }
+    // The replacement does not need a new slot. Otherwise a full table never ends the probe, so the index is dropped if it can not grow
+    if ((double)(_header->count + 1) > _header->capacity * kSDDiskCacheIndexMaxLoadFactor && ![self slotForDigest:entry->digest] && ![self growCapacity]) {
+        [self invalidate];
+        SD_UNLOCK(_lock);
+        return NO;
+    }
+    [self insertEntry:entry intoEntries:_entries header:_header];
+    [self scheduleSyncIfNeeded];
+    SD_UNLOCK(_lock);
+    return YES;
+}
+
+- (BOOL)updateAccessDate:(NSTimeInterval)date forDigest:(const uint8_t *)digest {
+    SD_LOCK(_lock);
+    SDDiskCacheIndexEntry *slot = [self slotForDigest:digest];
+    if (slot) {
+        slot->accessDate = date;
+    }
+    SD_UNLOCK(_lock);
+    return slot != NULL;
+}
+
+- (BOOL)removeEntry:(SDDiskCacheIndexEntry *)entry forDigest:(const uint8_t *)digest {
+    SD_LOCK(_lock);
+    SDDiskCacheIndexEntry *slot = [self slotForDigest:digest];
+    if (slot) {
+        if (entry) {
+            *entry = *slot;
+        }
+        uint64_t size = slot->size;
+        [self backwardShiftFromSlot:(uint64_t)(slot - _entries)];
+        // Update the header after the entries
+        _header->count--;
+        _header->totalSize -= size;
+        [self scheduleSyncIfNeeded];
+    }
+    SD_UNLOCK(_lock);
+    return slot != NULL;
+}
+
+- (void)removeAllEntries {
+    SD_LOCK(_lock);
+    memset(_entries, 0, (size_t)_header->capacity * sizeof(SDDiskCacheIndexEntry));
+    _header->count = 0;
+    _header->totalSize = 0;
+    [self scheduleSyncIfNeeded];
+    SD_UNLOCK(_lock);
+}
+
+- (NSData *)copyAllEntries {
+    SD_LOCK(_lock);
+    NSMutableData *data = [NSMutableData dataWithCapacity:(NSUInteger)_header->count * sizeof(SDDiskCacheIndexEntry)];
+    for (uint64_t i = 0; i < _header->capacity; i++) {
+        if (_entries[i].used) {
+            [data appendBytes:&_entries[i] length:sizeof(SDDiskCacheIndexEntry)];
+        }
+    }
+    SD_UNLOCK(_lock);
+    return [data copy];
+}
+
+#pragma mark - File
+
+// Lock held. The kernel writes back the dirty pages of the shared mapping anyway, the explicit sync only bounds what a system crash loses, so batch it instead of syncing the whole file for each change
+- (void)scheduleSyncIfNeeded {
+    if (_syncScheduled) {
+        return;
+    }
+    _syncScheduled = YES;
+    @weakify(self);
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        @strongify(self);
+        if (!self) {
+            return;
+        }
+        SD_LOCK(self->_lock);
+        self->_syncScheduled = NO;
+        msync(self->_map, self->_mapSize, MS_ASYNC);
+        SD_UNLOCK(self->_lock);
+    });
+}
+
+// Lock held. Clear the magic, so the file is reset and rebuilt on the next launch. The mapping is kept, the callers holding the index can still read it safely
+- (void)invalidate {
+    _invalidated = YES;
+    _header->magic = 0;
+    msync(_map, sizeof(SDDiskCacheIndexHeader), MS_SYNC);
+}
+
+#pragma mark - Hash table
+
+// Lock held
+- (nullable SDDiskCacheIndexEntry *)slotForDigest:(const uint8_t *)digest {
+    uint64_t mask = _header->capacity - 1;
+    uint64_t i = SDDiskCacheIndexHomeSlot(digest, mask);
+    while (_entries[i].used) {
+        if (memcmp(_entries[i].digest, digest, SD_DISK_CACHE_INDEX_DIGEST_LENGTH) == 0) {
+            return &_entries[i];
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+// Lock held. The entry is written before the header, so the header never counts an entry which is not written
+- (void)insertEntry:(const SDDiskCacheIndexEntry *)entry intoEntries:(SDDiskCacheIndexEntry *)entries header:(SDDiskCacheIndexHeader *)header {
+    uint64_t mask = header->capacity - 1;
+    uint64_t i = SDDiskCacheIndexHomeSlot(entry->digest, mask);
+    BOOL replaced = NO;
+    uint64_t replacedSize = 0;
+    while (entries[i].used) {
+        if (memcmp(entries[i].digest, entry->digest, SD_DISK_CACHE_INDEX_DIGEST_LENGTH) == 0) {
+            replaced = YES;
+            replacedSize = entries[i].size;
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    entries[i] = *entry;
+    entries[i].used = 1;
+    if (!replaced) {
+        header->count++;
+    }
+    header->totalSize = header->totalSize - replacedSize + entry->size;
+}
+
+// Lock held. Move the following entries of the probe sequence back, so the lookup does not stop at the removed slot
+- (void)backwardShiftFromSlot:(uint64_t)hole {
+    uint64_t mask = _header->capacity - 1;
+    uint64_t i = hole;
+    uint64_t j = hole;
+    while (YES) {
+        j = (j + 1) & mask;
+        if (!_entries[j].used) {
+            break;
+        }
+        uint64_t home = SDDiskCacheIndexHomeSlot(_entries[j].digest, mask);
+        // The entry can be moved to the hole only if its home slot is not in (i, j] cyclically
+        BOOL inRange = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!inRange) {
+            _entries[i] = _entries[j];
+            i = j;
+        }
+    }
+    memset(&_entries[i], 0, sizeof(SDDiskCacheIndexEntry));
+}
+
+// Lock held. Rehash into a new file with double capacity, then replace the old file atomically. Returns NO if failed, the old file is kept
+- (BOOL)growCapacity {
+    uint64_t capacity = _header->capacity * 2;
+    NSString *tempPath = [self.path stringByAppendingString:@".tmp"];
+    int fd = open(tempPath.fileSystemRepresentation, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return NO;
+    }
+    size_t size = SDDiskCacheIndexFileSize(capacity);
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        unlink(tempPath.fileSystemRepresentation);
+        return NO;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        unlink(tempPath.fileSystemRepresentation);
+        return NO;
+    }
+    SDDiskCacheIndexHeader *header = map;
+    SDDiskCacheIndexEntry *entries = (SDDiskCacheIndexEntry *)((uint8_t *)map + sizeof(SDDiskCacheIndexHeader));
+    // Fill the entries with a local header, then write the header and flush the file before it replaces the old one
+    SDDiskCacheIndexHeader newHeader = *_header;
+    newHeader.capacity = capacity;
+    newHeader.count = 0;
+    newHeader.totalSize = 0;
+    for (uint64_t i = 0; i < _header->capacity; i++) {
+        if (_entries[i].used) {
+            [self insertEntry:&_entries[i] intoEntries:entries header:&newHeader];
+        }
+    }
+    *header = newHeader;
+    if (msync(map, size, MS_SYNC) != 0 || rename(tempPath.fileSystemRepresentation, self.path.fileSystemRepresentation) != 0) {
+        munmap(map, size);
+        close(fd);
+        unlink(tempPath.fileSystemRepresentation);
+        return NO;
+    }
+    munmap(_map, _mapSize);
+    close(_fd);
+    _fd = fd;
+    _map = map;
+    _mapSize = size;
+    _header = header;
+    _entries = entries;
+    return YES;
+}
+
+@end
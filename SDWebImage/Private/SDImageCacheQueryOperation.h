@@ -0,0 +1,30 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <Foundation/Foundation.h>
+#import "SDWebImageCompat.h"
+#import "SDImageCacheDefine.h"
+
+// The in-flight disk query shared by the callers querying the same key. This is used for operation management, but not for operation queue execute
+// Each caller gets its own token operation, the query is cancelled only when all the tokens are cancelled
+@interface SDImageCacheQueryOperation : NSOperation
+
+// Attach a caller to the query, returns the token operation for the caller. Returns nil if the query is cancelled or finished, the caller should start a new query.
+- (nullable NSOperation *)addWaiterWithDoneBlock:(nullable SDImageCacheQueryCompletionBlock)doneBlock;
+
+// Call the done blocks of all the callers, the cancelled callers get nil result. No caller can be attached after this.
+- (void)doneWithImage:(nullable UIImage *)image data:(nullable NSData *)data cacheType:(SDImageCacheType)cacheType;
+
+@end
+
+// The batch query of multiple keys, which holds the tokens of the in-flight queries of its keys. Cancelling it cancels all the tokens
+@interface SDImageCacheBatchQueryOperation : NSOperation
+
+- (void)addToken:(nonnull NSOperation *)token;
+
+@end
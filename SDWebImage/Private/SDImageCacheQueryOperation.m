@@ -0,0 +1,136 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDImageCacheQueryOperation.h"
+#import "SDInternalMacros.h"
+
+@interface SDImageCacheQueryToken : NSOperation
+
+@property (nonatomic, weak, nullable) SDImageCacheQueryOperation *query;
+@property (nonatomic, copy, nullable) SDImageCacheQueryCompletionBlock doneBlock;
+
+@end
+
+@interface SDImageCacheQueryOperation ()
+
+- (void)cancelToken:(nonnull SDImageCacheQueryToken *)token;
+
+@end
+
+@implementation SDImageCacheQueryToken
+
+- (void)cancel {
+    if (self.isCancelled) {
+        return;
+    }
+    [super cancel];
+    [self.query cancelToken:self];
+}
+
+@end
+
+@implementation SDImageCacheQueryOperation
+{
+    dispatch_semaphore_t _waitersLock;
+    NSMutableArray<SDImageCacheQueryToken *> *_waiters;
+    NSUInteger _activeCount;
+    BOOL _closed;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _waitersLock = dispatch_semaphore_create(1);
+        _waiters = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (NSOperation *)addWaiterWithDoneBlock:(SDImageCacheQueryCompletionBlock)doneBlock {
+    SD_LOCK(_waitersLock);
+    if (_closed || self.isCancelled) {
+        SD_UNLOCK(_waitersLock);
+        return nil;
+    }
+    SDImageCacheQueryToken *token = [SDImageCacheQueryToken new];
+    token.query = self;
+    token.doneBlock = doneBlock;
+    [_waiters addObject:token];
+    _activeCount++;
+    SD_UNLOCK(_waitersLock);
+    return token;
+}
+
+- (void)cancelToken:(SDImageCacheQueryToken *)token {
+    SD_LOCK(_waitersLock);
+    BOOL shouldCancel = NO;
+    if (!_closed && [_waiters containsObject:token]) {
+        _activeCount = _activeCount > 0 ? _activeCount - 1 : 0;
+        shouldCancel = _activeCount == 0;
+    }
+    SD_UNLOCK(_waitersLock);
+    // One caller can not abort the others
+    if (shouldCancel) {
+        [self cancel];
+    }
+}
+
+- (void)doneWithImage:(UIImage *)image data:(NSData *)data cacheType:(SDImageCacheType)cacheType {
+    SD_LOCK(_waitersLock);
+    _closed = YES;
+    NSArray<SDImageCacheQueryToken *> *waiters = [_waiters copy];
+    [_waiters removeAllObjects];
+    SD_UNLOCK(_waitersLock);
+    for (SDImageCacheQueryToken *token in waiters) {
+        SDImageCacheQueryCompletionBlock doneBlock = token.doneBlock;
+        if (!doneBlock) {
+            continue;
+        }
+        if (token.isCancelled) {
+            doneBlock(nil, nil, SDImageCacheTypeNone);
+        } else {
+            doneBlock(image, data, cacheType);
+        }
+    }
+}
+
+@end
+
+@implementation SDImageCacheBatchQueryOperation
+{
+    dispatch_semaphore_t _tokensLock;
+    NSMutableArray<NSOperation *> *_tokens;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _tokensLock = dispatch_semaphore_create(1);
+        _tokens = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void)addToken:(NSOperation *)token {
+    SD_LOCK(_tokensLock);
+    [_tokens addObject:token];
+    SD_UNLOCK(_tokensLock);
+}
+
+- (void)cancel {
+    if (self.isCancelled) {
+        return;
+    }
+    [super cancel];
+    SD_LOCK(_tokensLock);
+    NSArray<NSOperation *> *tokens = [_tokens copy];
+    SD_UNLOCK(_tokensLock);
+    for (NSOperation *token in tokens) {
+        [token cancel];
+    }
+}
+
+@end
@@ -8,6 +8,7 @@
 
 #import <Foundation/Foundation.h>
 #import "SDWebImageCompat.h"
+#import "SDWebImageOperation.h"
 
 // This is used for operation management, but not for operation queue execute
 @interface SDImageCachesManagerOperation : NSOperation
@@ -18,4 +19,12 @@
 - (void)completeOne;
 - (void)done;
 
+// The sub operations of the caches, they are cancelled when this operation is cancelled
+- (void)setSubOperation:(nullable id<SDWebImageOperation>)subOperation atIndex:(NSUInteger)index;
+- (void)cancelSubOperationsExceptIndex:(NSUInteger)index;
+// Complete the cache at index only once, returns NO if it's already completed, or this operation is finished or cancelled
+- (BOOL)completeOneAtIndex:(NSUInteger)index;
+// Mark done only once, returns NO if it's already finished or cancelled
+- (BOOL)tryDone;
+
 @end
@@ -12,6 +12,9 @@
 @implementation SDImageCachesManagerOperation
 {
     dispatch_semaphore_t _pendingCountLock;
+    NSMutableDictionary<NSNumber *, id<SDWebImageOperation>> *_subOperations;
+    NSMutableIndexSet *_completedIndexes;
+    BOOL _doneClaimed; // Set by the winner of `tryDone` under lock, before `isFinished` changes
 }
 
 @synthesize executing = _executing;
@@ -46,9 +49,75 @@
     SD_UNLOCK(_pendingCountLock);
 }
 
+- (void)setSubOperation:(id<SDWebImageOperation>)subOperation atIndex:(NSUInteger)index {
+    if (!subOperation) {
+        return;
+    }
+    SD_LOCK(_pendingCountLock);
+    // The cache may already complete synchronously
+    BOOL shouldCancel = _cancelled || _finished || _doneClaimed;
+    if (!shouldCancel && ![_completedIndexes containsIndex:index]) {
+        if (!_subOperations) {
+            _subOperations = [NSMutableDictionary dictionary];
+        }
+        _subOperations[@(index)] = subOperation;
+    }
+    SD_UNLOCK(_pendingCountLock);
+    if (shouldCancel) {
+        [subOperation cancel];
+    }
+}
+
+- (void)cancelSubOperationsExceptIndex:(NSUInteger)index {
+    SD_LOCK(_pendingCountLock);
+    NSMutableArray<id<SDWebImageOperation>> *subOperations = [NSMutableArray arrayWithCapacity:_subOperations.count];
+    [_subOperations enumerateKeysAndObjectsUsingBlock:^(NSNumber * _Nonnull key, id<SDWebImageOperation>  _Nonnull subOperation, BOOL * _Nonnull stop) {
+        if (key.unsignedIntegerValue != index) {
+            [subOperations addObject:subOperation];
+        }
+    }];
+    [_subOperations removeAllObjects];
+    SD_UNLOCK(_pendingCountLock);
+    for (id<SDWebImageOperation> subOperation in subOperations) {
+        [subOperation cancel];
+    }
+}
+
+- (BOOL)completeOneAtIndex:(NSUInteger)index {
+    SD_LOCK(_pendingCountLock);
+    if (_cancelled || _finished || _doneClaimed || [_completedIndexes containsIndex:index]) {
+        SD_UNLOCK(_pendingCountLock);
+        return NO;
+    }
+    if (!_completedIndexes) {
+        _completedIndexes = [NSMutableIndexSet indexSet];
+    }
+    [_completedIndexes addIndex:index];
+    [_subOperations removeObjectForKey:@(index)];
+    _pendingCount = _pendingCount > 0 ? _pendingCount - 1 : 0;
+    SD_UNLOCK(_pendingCountLock);
+    return YES;
+}
+
+- (BOOL)tryDone {
+    SD_LOCK(_pendingCountLock);
+    if (_cancelled || _finished || _doneClaimed) {
+        SD_UNLOCK(_pendingCountLock);
+        return NO;
+    }
+    // Claim under lock, so only one caller wins
+    _doneClaimed = YES;
+    SD_UNLOCK(_pendingCountLock);
+    self.finished = YES;
+    self.executing = NO;
+    [self reset];
+    return YES;
+}
+
 - (void)cancel {
     self.cancelled = YES;
     [self reset];
+    [self cancelSubOperationsExceptIndex:NSNotFound];
 }
 
 - (void)done {
@@ -0,0 +1,37 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDShardedMemoryCache.h"
+#import "SDImageCacheMemoryBudget.h"
+
+// Whether the image decoding should record `sd_decodeTime`. It's only used by the GDSF eviction, so it's enabled after any memory cache using `SDImageCacheConfigEvictionPolicyGDSF` is created.
+FOUNDATION_EXPORT BOOL SDImageCacheShouldRecordDecodeTime(void);
+
+// Used by `SDImageCacheMemoryBudget` to evict across the caches
+@interface SDShardedMemoryCache ()
+
+// The access time of the next entry to be evicted, UINT64_MAX if empty. The time is from the budget's clock when the cache is registered to a budget, so it's comparable between the caches.
+- (uint64_t)oldestAccessTime;
+
+// Evict the next entry, returns NO if empty
+- (BOOL)evictOldestObject;
+
+// The budget which the cache is registered to, the cache reports the cost changes to it
+@property (atomic, strong, nullable) SDImageCacheMemoryBudget *registeredBudget;
+
+@end
+
+@interface SDImageCacheMemoryBudget ()
+
+// The shared logical access clock of the registered caches
+- (uint64_t)tick;
+
+// Apply the cost change of a registered cache to the running total
+- (void)addCost:(long long)cost;
+
+@end
@@ -491,6 +491,74 @@ static NSString *kTestImageKeyPNG = @"TestImageKey.png";
 }
 #endif
 
+- (void)test47ShardedMemoryCacheLRUEviction {
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.shouldUseWeakMemoryCache = NO;
+    config.maxMemoryCount = 3;
+    SDShardedMemoryCache *memoryCache = [[SDShardedMemoryCache alloc] initWithConfig:config shardCount:4];
+    expect(memoryCache.shardCount).equal(4);
+    NSObject *object1 = [NSObject new];
+    NSObject *object2 = [NSObject new];
+    NSObject *object3 = [NSObject new];
+    [memoryCache setObject:object1 forKey:@"1" cost:1];
+    [memoryCache setObject:object2 forKey:@"2" cost:2];
+    [memoryCache setObject:object3 forKey:@"3" cost:3];
+    expect(memoryCache.totalCount).equal(3);
+    expect(memoryCache.totalCost).equal(6);
+    // Touch "1", so "2" is the least recently used
+    expect([memoryCache objectForKey:@"1"]).equal(object1);
+    [memoryCache setObject:[NSObject new] forKey:@"4" cost:4];
+    expect([memoryCache containsObjectForKey:@"2"]).beFalsy();
+    expect([memoryCache containsObjectForKey:@"1"]).beTruthy();
+    expect(memoryCache.totalCount).equal(3);
+    expect(memoryCache.totalCost).equal(8);
+    // Replace should update the cost
+    [memoryCache setObject:object1 forKey:@"1" cost:10];
+    expect(memoryCache.totalCost).equal(17);
+    // Lower the cost limit, the oldest ("3") goes first
+    config.maxMemoryCost = 14;
+    expect([memoryCache containsObjectForKey:@"3"]).beFalsy();
+    expect(memoryCache.totalCost).equal(14);
+    [memoryCache removeObjectForKey:@"1"];
+    expect(memoryCache.totalCount).equal(1);
+    expect(memoryCache.totalCost).equal(4);
+    [memoryCache removeAllObjects];
+    expect(memoryCache.totalCount).equal(0);
+    expect(memoryCache.totalCost).equal(0);
+}
+
+- (void)test48ShardedMemoryCacheWeakCache {
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.shouldUseWeakMemoryCache = YES;
+    config.maxMemoryCount = 1;
+    SDShardedMemoryCache *memoryCache = [[SDShardedMemoryCache alloc] initWithConfig:config];
+    NSObject *object = [NSObject new];
+    [memoryCache setObject:object forKey:@"1"];
+    // Evict "1" into the weak table
+    [memoryCache setObject:[NSObject new] forKey:@"2"];
+    expect([memoryCache containsObjectForKey:@"1"]).beFalsy();
+    // Still alive, can be recovered
+    expect([memoryCache objectForKey:@"1"]).equal(object);
+    expect([memoryCache containsObjectForKey:@"1"]).beTruthy();
+    // Manually remove should also remove weak cache
+    [memoryCache removeObjectForKey:@"1"];
+    expect([memoryCache objectForKey:@"1"]).beNil();
+}
+
+- (void)test49ShardedMemoryCacheConcurrentAccess {
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.shouldUseWeakMemoryCache = NO;
+    config.maxMemoryCount = 100;
+    SDShardedMemoryCache *memoryCache = [[SDShardedMemoryCache alloc] initWithConfig:config];
+    dispatch_apply(1000, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        NSString *key = @(i % 300).stringValue;
+        [memoryCache setObject:key forKey:key cost:1];
+        [memoryCache objectForKey:@((i + 1) % 300).stringValue];
+    });
+    expect(memoryCache.totalCount).beLessThanOrEqualTo(100);
+    expect(memoryCache.totalCost).equal(memoryCache.totalCount);
+}
+
 #pragma mark - SDImageCache & SDImageCachesManager
 - (void)test50SDImageCacheQueryOp {
     XCTestExpectation *expectation = [self expectationWithDescription:@"SDImageCache query op works"];
@@ -678,8 +746,1032 @@ static NSString *kTestImageKeyPNG = @"TestImageKey.png";
     [self waitForExpectationsWithCommonTimeout];
 }
 
+- (void)test58ShardedMemoryCacheTinyLFUAdmission {
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.shouldUseWeakMemoryCache = NO;
+    config.maxMemoryCount = 100;
+    config.memoryCacheAdmissionPolicy = SDImageCacheConfigAdmissionPolicyTinyLFU;
+    SDShardedMemoryCache *tinyLFUCache = [[SDShardedMemoryCache alloc] initWithConfig:config shardCount:1];
+    expect(tinyLFUCache.admissionPolicy).equal(SDImageCacheConfigAdmissionPolicyTinyLFU);
+    config.memoryCacheAdmissionPolicy = SDImageCacheConfigAdmissionPolicyNone;
+    SDShardedMemoryCache *lruCache = [[SDShardedMemoryCache alloc] initWithConfig:config shardCount:1];
+    
+    // Replay the same trace: 1/4 of the accesses go to 50 hot keys, the others are one-off scans
+    NSUInteger (^replay)(SDShardedMemoryCache *) = ^NSUInteger(SDShardedMemoryCache *memoryCache) {
+        uint32_t seed = 1;
+        NSUInteger scanIndex = 0;
+        NSUInteger hitCount = 0;
+        for (NSUInteger i = 0; i < 20000; i++) {
+            seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+            NSString *key;
+            if (seed % 4 == 0) {
+                key = [NSString stringWithFormat:@"hot-%u", (seed >> 8) % 50];
+            } else {
+                key = [NSString stringWithFormat:@"scan-%lu", (unsigned long)scanIndex++];
+            }
+            if ([memoryCache objectForKey:key]) {
+                hitCount++;
+            } else {
+                [memoryCache setObject:key forKey:key cost:1];
+            }
+        }
+        return hitCount;
+    };
+    NSUInteger tinyLFUHitCount = replay(tinyLFUCache);
+    NSUInteger lruHitCount = replay(lruCache);
+    expect(tinyLFUCache.totalCount).beLessThanOrEqualTo(100);
+    // The hot keys should survive the scans
+    expect(tinyLFUHitCount).beGreaterThan(lruHitCount);
+}
+
+- (void)test59ShardedMemoryCacheGDSFEviction {
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.shouldUseWeakMemoryCache = NO;
+    config.maxMemoryCost = 300;
+    config.memoryCacheEvictionPolicy = SDImageCacheConfigEvictionPolicyGDSF;
+    SDShardedMemoryCache *memoryCache = [[SDShardedMemoryCache alloc] initWithConfig:config shardCount:1];
+    expect(memoryCache.evictionPolicy).equal(SDImageCacheConfigEvictionPolicyGDSF);
+    UIImage * (^createImage)(NSTimeInterval) = ^UIImage *(NSTimeInterval decodeTime) {
+        UIImage *image = [[UIImage alloc] init];
+        image.sd_decodeTime = decodeTime;
+        return image;
+    };
+    // Same memory cost, different decode time
+    [memoryCache setObject:createImage(0.04) forKey:@"expensive" cost:100];
+    [memoryCache setObject:createImage(0.001) forKey:@"cheap" cost:100];
+    [memoryCache setObject:createImage(0.01) forKey:@"normal" cost:100];
+    [memoryCache setObject:createImage(0.01) forKey:@"normal2" cost:100];
+    // The expensive one is the least recently used, but the cheap one is evicted
+    expect([memoryCache containsObjectForKey:@"cheap"]).beFalsy();
+    expect([memoryCache containsObjectForKey:@"expensive"]).beTruthy();
+    expect(memoryCache.totalCost).equal(300);
+    // Frequency counts as well, the frequently accessed one survives
+    for (NSUInteger i = 0; i < 4; i++) {
+        [memoryCache objectForKey:@"normal"];
+    }
+    [memoryCache setObject:createImage(0.01) forKey:@"normal3" cost:100];
+    [memoryCache setObject:createImage(0.01) forKey:@"normal4" cost:100];
+    expect([memoryCache containsObjectForKey:@"normal"]).beTruthy();
+    expect([memoryCache containsObjectForKey:@"normal2"]).beFalsy();
+    expect(memoryCache.totalCount).equal(3);
+}
+
+- (void)test60ShardedMemoryCacheTrim {
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.shouldUseWeakMemoryCache = NO;
+    SDShardedMemoryCache *memoryCache = [[SDShardedMemoryCache alloc] initWithConfig:config shardCount:4];
+    for (NSUInteger i = 0; i < 10; i++) {
+        NSString *key = @(i).stringValue;
+        [memoryCache setObject:key forKey:key cost:10];
+    }
+    // Touch "0", it's the most recently used now
+    expect([memoryCache objectForKey:@"0"]).notTo.beNil();
+    [memoryCache trimToCost:50];
+    expect(memoryCache.totalCost).equal(50);
+    expect([memoryCache containsObjectForKey:@"0"]).beTruthy();
+    expect([memoryCache containsObjectForKey:@"9"]).beTruthy();
+    expect([memoryCache containsObjectForKey:@"1"]).beFalsy();
+    [memoryCache trimToFraction:0.5];
+    expect(memoryCache.totalCount).equal(2);
+    expect([memoryCache containsObjectForKey:@"0"]).beTruthy();
+    [memoryCache trimToCount:1];
+    expect(memoryCache.totalCount).equal(1);
+    expect([memoryCache containsObjectForKey:@"0"]).beTruthy();
+}
+
+#if SD_UIKIT
+- (void)test61ShardedMemoryCacheGraduatedMemoryWarning {
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.shouldUseWeakMemoryCache = YES;
+    SDShardedMemoryCache *memoryCache = [[SDShardedMemoryCache alloc] initWithConfig:config];
+    NSMutableArray<NSObject *> *objects = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 8; i++) {
+        NSObject *object = [NSObject new];
+        [objects addObject:object];
+        [memoryCache setObject:object forKey:@(i).stringValue cost:10];
+    }
+    // The first warning only trims half of the cache
+    [[NSNotificationCenter defaultCenter] postNotificationName:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+    expect(memoryCache.totalCount).equal(4);
+    expect([memoryCache containsObjectForKey:@"7"]).beTruthy();
+    expect([memoryCache containsObjectForKey:@"0"]).beFalsy();
+    // The evicted ones are still available in weak cache
+    expect([memoryCache objectForKey:@"0"]).equal(objects[0]);
+}
+#endif
+
+- (void)test62ImageCacheMemoryDataTier {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Query hit the encoded data memory tier"];
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.maxMemoryDataCost = 10 * 1024 * 1024;
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"MemoryData" diskCacheDirectory:nil config:config];
+    expect(cache.memoryDataCache).notTo.beNil();
+    NSData *imageData = [NSData dataWithContentsOfFile:[self testJPEGPath]];
+    [cache storeImageDataToDisk:imageData forKey:kTestImageKeyJPEG];
+    expect([cache.memoryDataCache objectForKey:kTestImageKeyJPEG]).equal(imageData);
+    // Remove the file behind the cache, the query should not touch the disk
+    [[NSFileManager defaultManager] removeItemAtPath:[cache cachePathForKey:kTestImageKeyJPEG] error:nil];
+    expect([cache diskImageDataForKey:kTestImageKeyJPEG]).equal(imageData);
+    [cache queryCacheOperationForKey:kTestImageKeyJPEG done:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+        expect(image).notTo.beNil();
+        expect(data).equal(imageData);
+        expect(cacheType).equal(SDImageCacheTypeDisk);
+        // The disk expiration drops the encoded data as well
+        [cache deleteOldFilesWithCompletionBlock:^{
+            expect([cache.memoryDataCache objectForKey:kTestImageKeyJPEG]).beNil();
+            [cache storeImageDataToDisk:imageData forKey:kTestImageKeyJPEG];
+            [cache removeImageForKey:kTestImageKeyJPEG withCompletion:^{
+                expect([cache.memoryDataCache objectForKey:kTestImageKeyJPEG]).beNil();
+                [cache clearDiskOnCompletion:^{
+                    [expectation fulfill];
+                }];
+            }];
+        }];
+    }];
+    [self waitForExpectationsWithCommonTimeout];
+}
+
+- (void)test63ImageCachePrewarmHotKeys {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Prewarm the hot keys of last launch"];
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.memoryCacheClass = [SDShardedMemoryCache class];
+    config.memoryCachePrewarmCount = 10;
+    SDImageCache *lastCache = [[SDImageCache alloc] initWithNamespace:@"Prewarm" diskCacheDirectory:nil config:config];
+    NSArray<NSString *> *keys = @[@"PrewarmKey1", @"PrewarmKey2", @"PrewarmKey3", @"PrewarmKey4", @"PrewarmKey5", @"PrewarmKey6", @"PrewarmKey7", @"PrewarmKey8", @"PrewarmKey9", @"PrewarmKey10"];
+    NSData *imageData = [NSData dataWithContentsOfFile:[self testJPEGPath]];
+    for (NSString *key in keys) {
+        [lastCache storeImage:[self testJPEGImage] imageData:imageData forKey:key toDisk:NO completion:nil];
+        [lastCache storeImageDataToDisk:imageData forKey:key];
+    }
+    [lastCache storeImageDataToDisk:imageData forKey:@"PrewarmUIKey"];
+    // Simulate the termination
+    [lastCache saveMemoryCacheHotKeys];
+    
+    // Simulate the next launch, measure the first screen cache hit rate
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"Prewarm" diskCacheDirectory:nil config:config];
+    __block BOOL UIQueryFinished = NO;
+    [cache prewarmMemoryCacheWithCompletion:^{
+        // The prewarm runs on the low priority lane, the UI query issued at launch is not queued behind it
+        expect(UIQueryFinished).beTruthy();
+        NSUInteger hitCount = 0;
+        for (NSString *key in keys) {
+            if ([cache imageFromMemoryCacheForKey:key]) {
+                hitCount++;
+            }
+        }
+        expect((double)hitCount / keys.count).equal(1);
+        [[NSFileManager defaultManager] removeItemAtPath:[cache.diskCachePath stringByAppendingString:@".hotkeys.plist"] error:nil];
+        [cache clearDiskOnCompletion:^{
+            [expectation fulfill];
+        }];
+    }];
+    [cache queryCacheOperationForKey:@"PrewarmUIKey" done:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+        expect(image).notTo.beNil();
+        UIQueryFinished = YES;
+    }];
+    [self waitForExpectationsWithCommonTimeout];
+}
+
+- (void)test64ImageCacheMemoryBudget {
+    SDImageCacheMemoryBudget *budget = [[SDImageCacheMemoryBudget alloc] initWithTotalCostLimit:300];
+    SDImageCacheConfig *config1 = [[SDImageCacheConfig alloc] init];
+    config1.shouldUseWeakMemoryCache = NO;
+    config1.memoryBudget = budget;
+    config1.memoryBudgetWeight = 2;
+    SDImageCacheConfig *config2 = [config1 copy];
+    expect(config2.memoryBudget).equal(budget);
+    config2.memoryBudgetWeight = 1;
+    SDShardedMemoryCache *memoryCache1 = [[SDShardedMemoryCache alloc] initWithConfig:config1];
+    SDShardedMemoryCache *memoryCache2 = [[SDShardedMemoryCache alloc] initWithConfig:config2];
+    // The unused budget can be used by others
+    for (NSUInteger i = 0; i < 3; i++) {
+        [memoryCache1 setObject:@(i) forKey:@(i).stringValue cost:100];
+    }
+    expect(budget.totalCost).equal(300);
+    // Cache1 exceeds the share (200), the oldest of cache1 is evicted
+    [memoryCache2 setObject:@"a" forKey:@"a" cost:100];
+    expect(budget.totalCost).equal(300);
+    expect(memoryCache1.totalCost).equal(200);
+    expect([memoryCache1 containsObjectForKey:@"0"]).beFalsy();
+    expect(memoryCache2.totalCost).equal(100);
+    // Cache2 exceeds the share (100) now, even though cache1 has the older entries
+    [memoryCache2 setObject:@"b" forKey:@"b" cost:100];
+    expect(memoryCache1.totalCost).equal(200);
+    expect(memoryCache2.totalCost).equal(100);
+    expect([memoryCache2 containsObjectForKey:@"b"]).beTruthy();
+    // Lower the limit
+    budget.totalCostLimit = 150;
+    expect(budget.totalCost).beLessThanOrEqualTo(150);
+    expect(budget.totalCost).equal(memoryCache1.totalCost + memoryCache2.totalCost);
+    // The running total follows the registration
+    [budget unregisterMemoryCache:memoryCache2];
+    expect(budget.totalCost).equal(memoryCache1.totalCost);
+    [memoryCache2 setObject:@"c" forKey:@"c" cost:100];
+    expect(budget.totalCost).equal(memoryCache1.totalCost);
+}
+
+- (void)test65PackDiskCache {
+    NSString *cachePath = [[self userCacheDirectory] stringByAppendingPathComponent:@"PackDiskCache"];
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    SDPackDiskCache *diskCache = [[SDPackDiskCache alloc] initWithCachePath:cachePath config:config];
+    [diskCache removeAllData];
+    diskCache.maxSegmentSize = 1024;
+    NSData *smallData = [@"small" dataUsingEncoding:NSUTF8StringEncoding];
+    NSMutableData *largeData = [NSMutableData dataWithLength:diskCache.maxPackedDataLength + 1];
+    for (NSUInteger i = 0; i < 100; i++) {
+        [diskCache setData:smallData forKey:@(i).stringValue];
+    }
+    [diskCache setData:largeData forKey:@"large"];
+    expect([[NSFileManager defaultManager] fileExistsAtPath:[diskCache cachePathForKey:@"large"]]).beTruthy();
+    expect([[NSFileManager defaultManager] fileExistsAtPath:[diskCache cachePathForKey:@"0"]]).beFalsy();
+    expect([diskCache dataForKey:@"0"]).equal(smallData);
+    expect([diskCache dataForKey:@"large"]).equal(largeData);
+    expect(diskCache.totalCount).equal(101);
+
+    // Overwrite and remove, then compact the dead records
+    NSUInteger totalSize = diskCache.totalSize;
+    for (NSUInteger i = 0; i < 100; i++) {
+        if (i % 2 == 0) {
+            [diskCache removeDataForKey:@(i).stringValue];
+        }
+    }
+    [diskCache setData:largeData forKey:@"1"];
+    [diskCache compact];
+    expect(diskCache.totalSize).beLessThan(totalSize + largeData.length);
+
+    // The index is rebuilt from the segments
+    SDPackDiskCache *reopenedCache = [[SDPackDiskCache alloc] initWithCachePath:cachePath config:config];
+    expect(reopenedCache.totalCount).equal(51);
+    expect([reopenedCache containsDataForKey:@"0"]).beFalsy();
+    expect([reopenedCache dataForKey:@"1"]).equal(largeData);
+    expect([reopenedCache dataForKey:@"99"]).equal(smallData);
+    [reopenedCache removeAllData];
+    expect(reopenedCache.totalCount).equal(0);
+}
+
+- (void)test66PackDiskCacheReadsWrittenDataLikeDiskCache {
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    NSMutableData *data = [NSMutableData dataWithLength:4 * 1024];
+    arc4random_buf(data.mutableBytes, data.length);
+    NSUInteger count = 2000;
+    for (Class cacheClass in @[[SDDiskCache class], [SDPackDiskCache class]]) {
+        NSString *cachePath = [[self userCacheDirectory] stringByAppendingPathComponent:NSStringFromClass(cacheClass)];
+        id<SDDiskCache> diskCache = [[cacheClass alloc] initWithCachePath:cachePath config:config];
+        [diskCache removeAllData];
+        for (NSUInteger i = 0; i < count; i++) {
+            [diskCache setData:data forKey:[NSString stringWithFormat:@"http://example.com/avatar/%lu.jpg", (unsigned long)i]];
+        }
+        expect(diskCache.totalCount).equal(count);
+        for (NSUInteger i = 0; i < count; i++) {
+            expect([diskCache dataForKey:[NSString stringWithFormat:@"http://example.com/avatar/%lu.jpg", (unsigned long)i]]).equal(data);
+        }
+        [diskCache removeAllData];
+    }
+}
+
+- (void)test67DiskCacheIndex {
+    NSString *cachePath = [[self userCacheDirectory] stringByAppendingPathComponent:@"DiskCacheIndex"];
+    [[NSFileManager defaultManager] removeItemAtPath:cachePath error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:[cachePath stringByAppendingString:@".index"] error:nil];
+    NSData *imageData = [NSData dataWithContentsOfFile:[self testJPEGPath]];
+    // The files written before the index is enabled
+    SDDiskCache *legacyCache = [[SDDiskCache alloc] initWithCachePath:cachePath config:[[SDImageCacheConfig alloc] init]];
+    [legacyCache setData:imageData forKey:@"Legacy.jpg"];
+
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.shouldUseDiskCacheIndex = YES;
+    SDDiskCache *diskCache = [[SDDiskCache alloc] initWithCachePath:cachePath config:config];
+    expect([diskCache containsDataForKey:@"Legacy.jpg"]).beTruthy();
+    for (NSUInteger i = 0; i < 2000; i++) {
+        [diskCache setData:imageData forKey:[NSString stringWithFormat:@"%lu.jpg", (unsigned long)i]];
+    }
+    expect(diskCache.totalCount).equal(2001);
+    expect(diskCache.totalSize).equal(imageData.length * 2001);
+    expect([diskCache dataForKey:@"1999.jpg"]).equal(imageData);
+    for (NSUInteger i = 0; i < 2000; i += 2) {
+        [diskCache removeDataForKey:[NSString stringWithFormat:@"%lu.jpg", (unsigned long)i]];
+    }
+    expect([diskCache containsDataForKey:@"0.jpg"]).beFalsy();
+    expect([[NSFileManager defaultManager] fileExistsAtPath:[diskCache cachePathForKey:@"0.jpg"]]).beFalsy();
+
+    // The caches on the same path share the index, so the entries added after the index file grows are visible to both
+    SDDiskCache *sharedCache = [[SDDiskCache alloc] initWithCachePath:cachePath config:config];
+    expect(sharedCache.totalCount).equal(1001);
+    for (NSUInteger i = 2000; i < 4200; i++) {
+        [diskCache setData:imageData forKey:[NSString stringWithFormat:@"%lu.jpg", (unsigned long)i]];
+    }
+    expect(sharedCache.totalCount).equal(3201);
+    expect([sharedCache containsDataForKey:@"4199.jpg"]).beTruthy();
+    for (NSUInteger i = 2000; i < 4200; i++) {
+        [sharedCache removeDataForKey:[NSString stringWithFormat:@"%lu.jpg", (unsigned long)i]];
+    }
+    expect(diskCache.totalCount).equal(1001);
+
+    // The index is persistent
+    SDDiskCache *reopenedCache = [[SDDiskCache alloc] initWithCachePath:cachePath config:config];
+    expect(reopenedCache.totalCount).equal(1001);
+    expect([reopenedCache containsDataForKey:@"1.jpg"]).beTruthy();
+    expect([reopenedCache containsDataForKey:@"2.jpg"]).beFalsy();
+
+    // The size based expiration removes the oldest files
+    config.maxDiskSize = imageData.length * 100;
+    [reopenedCache removeExpiredData];
+    expect(reopenedCache.totalSize).beLessThan(imageData.length * 50);
+    expect([reopenedCache containsDataForKey:@"1999.jpg"]).beTruthy();
+    expect([reopenedCache containsDataForKey:@"Legacy.jpg"]).beFalsy();
+    [reopenedCache removeAllData];
+    expect(reopenedCache.totalCount).equal(0);
+}
+
+- (void)test68ImageCacheSlicedExpiration {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"The query does not wait for the whole expiration"];
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.diskCacheExpirationSliceDuration = 0.0001;
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"SlicedExpiration" diskCacheDirectory:nil config:config];
+    NSData *imageData = [NSData dataWithContentsOfFile:[self testJPEGPath]];
+    for (NSUInteger i = 0; i < 1000; i++) {
+        [cache storeImageDataToDisk:imageData forKey:@(i).stringValue];
+    }
+    cache.config.maxDiskAge = 0;
+    __block BOOL queryFinished = NO;
+    [cache deleteOldFilesWithCompletionBlock:^{
+        expect(queryFinished).beTruthy();
+        expect(cache.totalDiskCount).equal(0);
+        [expectation fulfill];
+    }];
+    [cache diskImageExistsWithKey:@"999" completion:^(BOOL isInCache) {
+        queryFinished = YES;
+    }];
+    [self waitForExpectationsWithCommonTimeout];
+}
+
+- (void)test69DiskCacheMappedReading {
+    NSString *cachePath = [[self userCacheDirectory] stringByAppendingPathComponent:@"MappedReading"];
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.diskCacheMappedReadingThreshold = 1;
+    SDDiskCache *diskCache = [[SDDiskCache alloc] initWithCachePath:cachePath config:config];
+    NSData *imageData = [NSData dataWithContentsOfFile:[self testGIFPath]];
+    [diskCache setData:imageData forKey:@"Mapped.gif"];
+    NSData *mappedData = [diskCache dataForKey:@"Mapped.gif"];
+    expect(mappedData).equal(imageData);
+    // The mapping keeps valid after eviction
+    [diskCache removeDataForKey:@"Mapped.gif"];
+    expect([diskCache containsDataForKey:@"Mapped.gif"]).beFalsy();
+    expect(mappedData).equal(imageData);
+    // The animated image holds the mapped data directly
+    SDAnimatedImage *animatedImage = [[SDAnimatedImage alloc] initWithData:mappedData];
+    expect(animatedImage).notTo.beNil();
+    expect(animatedImage.animatedImageData).beIdenticalTo(mappedData);
+    [diskCache removeAllData];
+}
+
+- (void)test70DiskCacheMurmur3FileNameMigration {
+    NSString *cachePath = [[self userCacheDirectory] stringByAppendingPathComponent:@"Murmur3FileName"];
+    [[NSFileManager defaultManager] removeItemAtPath:cachePath error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:[cachePath stringByAppendingString:@".legacy"] error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:[cachePath stringByAppendingString:@".index"] error:nil];
+    NSData *imageData = [NSData dataWithContentsOfFile:[self testJPEGPath]];
+    NSString *key = @"http://example.com/image.jpg?size=large";
+    SDDiskCache *legacyCache = [[SDDiskCache alloc] initWithCachePath:cachePath config:[[SDImageCacheConfig alloc] init]];
+    [legacyCache setData:imageData forKey:key];
+    [legacyCache setData:imageData forKey:@"Removed.jpg"];
+    [legacyCache setData:imageData forKey:@"Indexed.jpg"];
+    NSString *legacyPath = [legacyCache cachePathForKey:key];
+
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.diskCacheFileNameHashType = SDImageCacheConfigFileNameHashTypeMurmur3;
+    SDDiskCache *diskCache = [[SDDiskCache alloc] initWithCachePath:cachePath config:config];
+    NSString *filePath = [diskCache cachePathForKey:key];
+    expect(filePath).notTo.equal(legacyPath);
+    expect(filePath.lastPathComponent.stringByDeletingPathExtension.length).equal(32);
+    expect(filePath.pathExtension).equal(@"jpg");
+    // The legacy file is moved to the new file name when accessed
+    expect([diskCache dataForKey:key]).equal(imageData);
+    expect([[NSFileManager defaultManager] fileExistsAtPath:legacyPath]).beFalsy();
+    expect([[NSFileManager defaultManager] fileExistsAtPath:filePath]).beTruthy();
+    [diskCache removeDataForKey:@"Removed.jpg"];
+    expect([legacyCache containsDataForKey:@"Removed.jpg"]).beFalsy();
+    expect(diskCache.totalCount).equal(2);
+
+    // The same with the index, the legacy file names are recorded by the first cache
+    config.shouldUseDiskCacheIndex = YES;
+    SDDiskCache *indexedCache = [[SDDiskCache alloc] initWithCachePath:cachePath config:config];
+    expect([indexedCache containsDataForKey:@"Indexed.jpg"]).beTruthy();
+    expect([indexedCache dataForKey:@"Indexed.jpg"]).equal(imageData);
+    expect(indexedCache.totalCount).equal(2);
+
+    // The misses do not look for the legacy files once all of them are gone
+    [indexedCache removeExpiredData];
+    [legacyCache setData:imageData forKey:@"Late.jpg"];
+    SDDiskCache *migratedCache = [[SDDiskCache alloc] initWithCachePath:cachePath config:[config copy]];
+    expect([migratedCache containsDataForKey:@"Late.jpg"]).beFalsy();
+    expect([[NSFileManager defaultManager] fileExistsAtPath:[legacyCache cachePathForKey:@"Late.jpg"]]).beTruthy();
+    [indexedCache removeAllData];
+}
+
+- (void)test71DiskCacheFileNameHash {
+    NSString *key = @"https://example.com/images/avatar/1.jpg?width=100&height=100";
+    NSMutableArray<NSString *> *fileNames = [NSMutableArray array];
+    for (NSNumber *hashType in @[@(SDImageCacheConfigFileNameHashTypeMD5), @(SDImageCacheConfigFileNameHashTypeMurmur3)]) {
+        SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+        config.diskCacheFileNameHashType = hashType.unsignedIntegerValue;
+        SDDiskCache *diskCache = [[SDDiskCache alloc] initWithCachePath:[[self userCacheDirectory] stringByAppendingPathComponent:@"FileNameHash"] config:config];
+        NSString *fileName = [diskCache cachePathForKey:key].lastPathComponent;
+        // The same length of hex digest, and the extension is kept without the query
+        expect(fileName.stringByDeletingPathExtension.length).equal(32);
+        expect(fileName.pathExtension).equal(@"jpg");
+        expect([diskCache cachePathForKey:key].lastPathComponent).equal(fileName);
+        [fileNames addObject:fileName];
+    }
+    expect(fileNames[1]).notTo.equal(fileNames[0]);
+}
+
+- (void)test72DiskCacheDirectoryFanOut {
+    NSString *cachePath = [[self userCacheDirectory] stringByAppendingPathComponent:@"DirectoryFanOut"];
+    [[NSFileManager defaultManager] removeItemAtPath:cachePath error:nil];
+    NSData *imageData = [NSData dataWithContentsOfFile:[self testJPEGPath]];
+    // The files written in the flat layout
+    SDDiskCache *flatCache = [[SDDiskCache alloc] initWithCachePath:cachePath config:[[SDImageCacheConfig alloc] init]];
+    for (NSUInteger i = 0; i < 10; i++) {
+        [flatCache setData:imageData forKey:[NSString stringWithFormat:@"%lu.jpg", (unsigned long)i]];
+    }
+
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.shouldUseDiskCacheDirectoryFanOut = YES;
+    SDDiskCache *diskCache = [[SDDiskCache alloc] initWithCachePath:cachePath config:config];
+    NSString *filePath = [diskCache cachePathForKey:@"0.jpg"];
+    NSString *fileName = filePath.lastPathComponent;
+    NSString *subpath = [NSString stringWithFormat:@"%@/%@/%@", [fileName substringToIndex:2], [fileName substringWithRange:NSMakeRange(2, 2)], fileName];
+    expect(filePath).equal([cachePath stringByAppendingPathComponent:subpath]);
+    // The flat files are moved on the first access
+    expect([diskCache dataForKey:@"0.jpg"]).equal(imageData);
+    expect([[NSFileManager defaultManager] fileExistsAtPath:filePath]).beTruthy();
+    // The others are moved by migration
+    [diskCache moveCacheDirectoryFromPath:cachePath toPath:cachePath];
+    expect([[NSFileManager defaultManager] fileExistsAtPath:[flatCache cachePathForKey:@"9.jpg"]]).beFalsy();
+    expect([[NSFileManager defaultManager] fileExistsAtPath:[diskCache cachePathForKey:@"9.jpg"]]).beTruthy();
+    [diskCache setData:imageData forKey:@"10.jpg"];
+    // The subdirectories are not counted
+    expect(diskCache.totalCount).equal(11);
+    expect(diskCache.totalSize).equal(imageData.length * 11);
+
+    config.maxDiskAge = 0;
+    [diskCache removeExpiredData];
+    expect(diskCache.totalCount).equal(0);
+    [diskCache setData:imageData forKey:@"0.jpg"];
+    [diskCache removeAllData];
+    expect([diskCache containsDataForKey:@"0.jpg"]).beFalsy();
+    expect([[NSFileManager defaultManager] contentsOfDirectoryAtPath:cachePath error:nil].count).equal(0);
+}
+
+- (void)test73ImageCacheConcurrentDiskOperations {
+    NSData *imageData = [NSData dataWithContentsOfFile:[self testJPEGPath]];
+    NSUInteger keyCount = 200;
+    NSUInteger readCount = 4000;
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.maxConcurrentDiskOperationCount = [NSProcessInfo processInfo].activeProcessorCount * 2;
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"ConcurrentDiskOperations" diskCacheDirectory:nil config:config];
+    [cache clearDiskOnCompletion:nil];
+    dispatch_apply(keyCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        [cache storeImageDataToDisk:imageData forKey:@(i).stringValue];
+    });
+    expect(cache.totalDiskCount).equal(keyCount);
+    __block NSUInteger missCount = 0;
+    dispatch_apply(readCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        // The memory data cache is disabled by default, so each read hits the disk
+        NSData *data = [cache diskImageDataForKey:@(i % keyCount).stringValue];
+        if (!data) {
+            @synchronized (cache) {
+                missCount++;
+            }
+        }
+    });
+    expect(missCount).equal(0);
+    // The operations of one key keep the order
+    [cache removeImageForKey:@"0" withCompletion:nil];
+    expect([cache diskImageDataExistsWithKey:@"0"]).beFalsy();
+    [cache clearDiskOnCompletion:nil];
+    expect(cache.totalDiskCount).equal(0);
+}
+
+- (void)test74ImageCacheQueryDecodeNotBlockDiskQuery {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"The small image is not blocked by the large image decoding"];
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.maxConcurrentDecodeOperationCount = 2;
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"DecodeStage" diskCacheDirectory:nil config:config];
+    UIImage *testImage = [[UIImage alloc] initWithContentsOfFile:[self testJPEGPath]];
+    UIImage *largeImage = [testImage sd_resizedImageWithSize:CGSizeMake(4000, 4000) scaleMode:SDImageScaleModeFill];
+    NSData *largeData = [[SDImageCodersManager sharedManager] encodedDataWithImage:largeImage format:SDImageFormatPNG options:nil];
+    [cache storeImageDataToDisk:largeData forKey:@"Large"];
+    [cache storeImageDataToDisk:[NSData dataWithContentsOfFile:[self testJPEGPath]] forKey:@"Small"];
+    NSMutableArray<NSString *> *finishedKeys = [NSMutableArray array];
+    [cache queryCacheOperationForKey:@"Large" done:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+        expect(image).notTo.beNil();
+        [finishedKeys addObject:@"Large"];
+        expect(finishedKeys).equal(@[@"Small", @"Large"]);
+        [cache clearDiskOnCompletion:^{
+            [expectation fulfill];
+        }];
+    }];
+    [cache queryCacheOperationForKey:@"Small" done:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+        expect(image).notTo.beNil();
+        [finishedKeys addObject:@"Small"];
+    }];
+    [self waitForExpectationsWithCommonTimeout];
+}
+
+- (void)test75ImageCacheCoalesceQueriesForSameKey {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"The queries for the same key get the same image"];
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"CoalesceQueries"];
+    [cache storeImageDataToDisk:[NSData dataWithContentsOfFile:[self testJPEGPath]] forKey:kTestImageKeyJPEG];
+    __block UIImage *firstImage;
+    NSOperation *operation1 = [cache queryCacheOperationForKey:kTestImageKeyJPEG done:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+        // Cancelled
+        expect(image).beNil();
+    }];
+    [cache queryCacheOperationForKey:kTestImageKeyJPEG done:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+        expect(image).notTo.beNil();
+        expect(cacheType).equal(SDImageCacheTypeDisk);
+        firstImage = image;
+    }];
+    [cache queryCacheOperationForKey:kTestImageKeyJPEG done:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+        expect(image).beIdenticalTo(firstImage);
+        [cache clearDiskOnCompletion:^{
+            [expectation fulfill];
+        }];
+    }];
+    // One caller can not abort the others
+    [operation1 cancel];
+    [self waitForExpectationsWithCommonTimeout];
+}
+
+- (void)test76ImageCacheBatchQuery {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Batch query"];
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"BatchQuery"];
+    NSData *imageData = [NSData dataWithContentsOfFile:[self testJPEGPath]];
+    for (NSUInteger i = 0; i < 60; i++) {
+        [cache storeImageDataToDisk:imageData forKey:@(i).stringValue];
+    }
+    UIImage *memoryImage = [[UIImage alloc] initWithData:imageData];
+    [cache storeImageToMemory:memoryImage forKey:@"Memory"];
+    NSMutableArray<NSString *> *keys = [NSMutableArray arrayWithObjects:@"Memory", @"Missing", nil];
+    for (NSUInteger i = 0; i < 60; i++) {
+        [keys addObject:@(i).stringValue];
+    }
+    __block NSUInteger progressCount = 0;
+    [cache queryImagesForKeys:keys options:0 context:nil progress:^(NSString * _Nonnull key, UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+        if (progressCount == 0) {
+            // The memory hit is answered immediately
+            expect(key).equal(@"Memory");
+            expect(cacheType).equal(SDImageCacheTypeMemory);
+        } else {
+            expect(cacheType).equal(SDImageCacheTypeDisk);
+        }
+        progressCount++;
+    } completion:^(NSDictionary<NSString *,UIImage *> * _Nonnull images) {
+        expect(progressCount).equal(61);
+        expect(images.count).equal(61);
+        expect(images[@"Memory"]).beIdenticalTo(memoryImage);
+        expect(images[@"Missing"]).beNil();
+        expect([cache imageFromMemoryCacheForKey:@"59"]).beIdenticalTo(images[@"59"]);
+        [cache clearDiskOnCompletion:^{
+            [expectation fulfill];
+        }];
+    }];
+    expect(progressCount).equal(1);
+    [self waitForExpectationsWithCommonTimeout];
+}
+
+- (void)test77ImageCacheDeriveTransformedImageFromOriginal {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Derive transformed image from original"];
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.shouldDeriveTransformedImageFromOriginal = YES;
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"DeriveTransformed" diskCacheDirectory:nil config:config];
+    [cache storeImageDataToDisk:[NSData dataWithContentsOfFile:[self testJPEGPath]] forKey:kTestImageKeyJPEG];
+    SDImageFlippingTransformer *transformer = [SDImageFlippingTransformer transformerWithHorizontal:YES vertical:NO];
+    NSString *transformedKey = SDTransformedKeyForKey(kTestImageKeyJPEG, transformer.transformerKey);
+    SDWebImageContext *context = @{SDWebImageContextImageTransformer : transformer, SDWebImageContextStoreCacheType : @(SDImageCacheTypeMemory)};
+    [cache queryCacheOperationForKey:kTestImageKeyJPEG options:0 context:context done:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+        expect(image).notTo.beNil();
+        expect(data).beNil();
+        expect(cacheType).equal(SDImageCacheTypeDisk);
+        // The derived image is stored under the transformed key, by the store cache type
+        expect([cache imageFromMemoryCacheForKey:transformedKey]).beIdenticalTo(image);
+        expect([cache diskImageDataExistsWithKey:transformedKey]).beFalsy();
+        expect([cache imageFromMemoryCacheForKey:kTestImageKeyJPEG]).beNil();
+        cache.config.shouldDeriveTransformedImageFromOriginal = NO;
+        SDImageFlippingTransformer *anotherTransformer = [SDImageFlippingTransformer transformerWithHorizontal:NO vertical:YES];
+        [cache queryCacheOperationForKey:kTestImageKeyJPEG options:0 context:@{SDWebImageContextImageTransformer : anotherTransformer} done:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+            expect(image).beNil();
+            expect(cacheType).equal(SDImageCacheTypeNone);
+            [cache clearDiskOnCompletion:^{
+                [expectation fulfill];
+            }];
+        }];
+    }];
+    [self waitForExpectationsWithCommonTimeout];
+}
+
+- (void)test78ImageCacheLowPriorityQueryNotBlockQuery {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Low priority query does not block query"];
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"LowPriorityQuery"];
+    NSData *imageData = [NSData dataWithContentsOfFile:[self testJPEGPath]];
+    NSUInteger count = 100;
+    for (NSUInteger i = 0; i < count; i++) {
+        [cache storeImageDataToDisk:imageData forKey:@(i).stringValue];
+    }
+    [cache storeImageDataToDisk:imageData forKey:@"Visible"];
+    // Hold the low priority lane, so the order does not depend on the scheduling
+    NSOperationQueue *lowPriorityQueue = [cache valueForKey:@"lowPriorityQueue"];
+    lowPriorityQueue.suspended = YES;
+    // The cancelled queries call back on the background queue, count on main queue
+    __block NSUInteger lowPriorityCount = 0;
+    NSMutableArray<id<SDWebImageOperation>> *operations = [NSMutableArray array];
+    for (NSUInteger i = 0; i < count; i++) {
+        id<SDWebImageOperation> operation = [cache queryImageForKey:@(i).stringValue options:SDWebImageLowPriority context:nil completion:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                lowPriorityCount++;
+                if (lowPriorityCount == count) {
+                    [cache clearDiskOnCompletion:^{
+                        [expectation fulfill];
+                    }];
+                }
+            });
+        }];
+        [operations addObject:operation];
+    }
+    [cache queryImageForKey:@"Visible" options:0 context:nil completion:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+        expect(image).notTo.beNil();
+        // The visible query does not wait for the prefetching
+        expect(lowPriorityCount).equal(0);
+        // The queued low priority queries can be cancelled
+        for (id<SDWebImageOperation> operation in operations) {
+            [operation cancel];
+        }
+        lowPriorityQueue.suspended = NO;
+    }];
+    [self waitForExpectationsWithCommonTimeout];
+}
+
+- (void)test79SDImageCachesManagerConcurrentQueryRace {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"SDImageCachesManager concurrent query race"];
+    SDImageCachesManager *cachesManager = [[SDImageCachesManager alloc] init];
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"RaceCache"];
+    SDWebImageTestHangingCache *hangingCache = [[SDWebImageTestHangingCache alloc] init];
+    // The hanging cache has the highest priority
+    cachesManager.caches = @[cache, hangingCache];
+    cachesManager.queryOperationPolicy = SDImageCachesManagerOperationPolicyConcurrent;
+    cachesManager.queryBackfillCacheType = SDImageCacheTypeMemory;
+    [cachesManager setQueryLatencyBudget:0.2 forCache:hangingCache];
+    expect([cachesManager queryLatencyBudgetForCache:hangingCache]).equal(0.2);
+    expect([cachesManager queryLatencyBudgetForCache:cache]).equal(0);
+    
+    [cache storeImageDataToDisk:[NSData dataWithContentsOfFile:[self testJPEGPath]] forKey:kTestImageKeyJPEG];
+    [cachesManager queryImageForKey:kTestImageKeyJPEG options:0 context:nil completion:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+        // The disk cache wins, the hanging query is cancelled, and the image is backfilled
+        expect(image).notTo.beNil();
+        expect(cacheType).equal(SDImageCacheTypeDisk);
+        expect(hangingCache.lastQueryOperation.isCancelled).beTruthy();
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, kMinDelayNanosecond), dispatch_get_main_queue(), ^{
+            expect(hangingCache.lastStoredImage).beIdenticalTo(image);
+            // All the other caches miss, the hanging cache is skipped after the latency budget
+            CFAbsoluteTime begin = CFAbsoluteTimeGetCurrent();
+            [cachesManager queryImageForKey:kTestImageKeyPNG options:0 context:nil completion:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+                expect(image).beNil();
+                expect(cacheType).equal(SDImageCacheTypeNone);
+                expect(CFAbsoluteTimeGetCurrent() - begin).beGreaterThan(0.1);
+                expect(hangingCache.lastQueryOperation.isCancelled).beTruthy();
+                [cache clearDiskOnCompletion:^{
+                    [expectation fulfill];
+                }];
+            }];
+        });
+    }];
+    [self waitForExpectationsWithCommonTimeout];
+}
+
+- (void)test80SDImageCachesManagerAdaptiveQueryOrder {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"SDImageCachesManager adaptive query order"];
+    SDImageCachesManager *cachesManager = [[SDImageCachesManager alloc] init];
+    SDImageCache *warmCache = [[SDImageCache alloc] initWithNamespace:@"WarmCache"];
+    SDImageCache *coldCache = [[SDImageCache alloc] initWithNamespace:@"ColdCache"];
+    // The cold cache has the highest priority
+    cachesManager.caches = @[warmCache, coldCache];
+    cachesManager.queryOperationPolicy = SDImageCachesManagerOperationPolicySerial;
+    cachesManager.shouldAdaptQueryOrder = YES;
+    [coldCache clearDiskOnCompletion:nil];
+    [warmCache storeImageToMemory:[self testJPEGImage] forKey:kTestImageKeyJPEG];
+    expect([cachesManager queryStatisticsForCache:coldCache]).beNil();
+    
+    // Collect the statistics in the priority order, the cold cache needs 20 probes
+    NSUInteger queryCount = 21;
+    __block NSUInteger completedCount = 0;
+    __block void(^queryBlock)(void);
+    __block __weak void(^weakQueryBlock)(void);
+    queryBlock = ^{
+        [cachesManager queryImageForKey:kTestImageKeyJPEG options:0 context:nil completion:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+            expect(image).notTo.beNil();
+            completedCount++;
+            if (completedCount < queryCount) {
+                weakQueryBlock();
+                return;
+            }
+            SDImageCachesManagerQueryStatistics *coldStatistics = [cachesManager queryStatisticsForCache:coldCache];
+            SDImageCachesManagerQueryStatistics *warmStatistics = [cachesManager queryStatisticsForCache:warmCache];
+            // One sampling query probes the warm cache first
+            expect(coldStatistics.queryCount).equal(queryCount - 1);
+            expect(coldStatistics.probeCount).equal(queryCount - 1);
+            expect(coldStatistics.probeHitRate).equal(0);
+            expect(warmStatistics.hitRate).equal(1);
+            expect(warmStatistics.probeCount).equal(1);
+            expect(warmStatistics.p95Latency).beGreaterThanOrEqualTo(warmStatistics.medianLatency);
+            // The warm cache is queried first now, the cold cache is not probed
+            [cachesManager queryImageForKey:kTestImageKeyJPEG options:0 context:nil completion:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+                expect(image).notTo.beNil();
+                expect([cachesManager queryStatisticsForCache:coldCache].queryCount).equal(queryCount - 1);
+                expect([cachesManager queryStatisticsForCache:warmCache].queryCount).equal(queryCount + 1);
+                [cachesManager resetQueryStatistics];
+                expect([cachesManager queryStatisticsForCache:warmCache]).beNil();
+                [expectation fulfill];
+            }];
+        }];
+    };
+    weakQueryBlock = queryBlock;
+    queryBlock();
+    [self waitForExpectationsWithCommonTimeout];
+    queryBlock = nil;
+}
+
+- (void)test81SDImageCachesManagerPromoteAndWriteBack {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"SDImageCachesManager promote on hit and write back"];
+    SDImageCachesManager *cachesManager = [[SDImageCachesManager alloc] init];
+    SDImageCache *lowCache = [[SDImageCache alloc] initWithNamespace:@"LowTierCache"];
+    SDImageCache *highCache = [[SDImageCache alloc] initWithNamespace:@"HighTierCache"];
+    cachesManager.caches = @[lowCache, highCache];
+    cachesManager.queryOperationPolicy = SDImageCachesManagerOperationPolicySerial;
+    cachesManager.storeOperationPolicy = SDImageCachesManagerOperationPolicySerial;
+    cachesManager.queryBackfillCacheType = SDImageCacheTypeMemory;
+    cachesManager.storeWriteBackInterval = 60;
+    
+    // Write back, the highest priority cache is written now, the removed key is not written back
+    [cachesManager storeImage:[self testJPEGImage] imageData:nil forKey:kTestImageKeyJPEG cacheType:SDImageCacheTypeMemory completion:nil];
+    [cachesManager storeImage:[self testPNGImage] imageData:nil forKey:kTestImageKeyPNG cacheType:SDImageCacheTypeMemory completion:nil];
+    [cachesManager removeImageForKey:kTestImageKeyPNG cacheType:SDImageCacheTypeMemory completion:nil];
+    expect([highCache imageFromMemoryCacheForKey:kTestImageKeyJPEG]).notTo.beNil();
+    expect([lowCache imageFromMemoryCacheForKey:kTestImageKeyJPEG]).beNil();
+    [cachesManager flushWriteBackWithCompletion:^{
+        expect([lowCache imageFromMemoryCacheForKey:kTestImageKeyJPEG]).notTo.beNil();
+        expect([lowCache imageFromMemoryCacheForKey:kTestImageKeyPNG]).beNil();
+        
+        // Promote on hit, the low tier hit is written to the high tier
+        [highCache removeImageFromMemoryForKey:kTestImageKeyJPEG];
+        [highCache removeImageFromDiskForKey:kTestImageKeyJPEG];
+        [cachesManager queryImageForKey:kTestImageKeyJPEG options:0 context:nil completion:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+            expect(image).notTo.beNil();
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, kMinDelayNanosecond), dispatch_get_main_queue(), ^{
+                expect([highCache imageFromMemoryCacheForKey:kTestImageKeyJPEG]).beIdenticalTo(image);
+                // The store taken by the in-flight flush is skipped when the key is removed
+                [cachesManager storeImage:[self testPNGImage] imageData:nil forKey:kTestImageKeyPNG cacheType:SDImageCacheTypeMemory completion:nil];
+                [cachesManager flushWriteBackWithCompletion:^{
+                    expect([lowCache imageFromMemoryCacheForKey:kTestImageKeyPNG]).beNil();
+                    [expectation fulfill];
+                }];
+                [cachesManager removeImageForKey:kTestImageKeyPNG cacheType:SDImageCacheTypeMemory completion:nil];
+            });
+        }];
+    }];
+    [self waitForExpectationsWithCommonTimeout];
+}
+
+- (void)test82DiskCacheSlicedExpirationTotalSize {
+    NSString *cachePath = [[self userCacheDirectory] stringByAppendingPathComponent:@"SlicedExpirationTotalSize"];
+    [[NSFileManager defaultManager] removeItemAtPath:cachePath error:nil];
+    NSData *imageData = [NSData dataWithContentsOfFile:[self testJPEGPath]];
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    SDDiskCache *diskCache = [[SDDiskCache alloc] initWithCachePath:cachePath config:config];
+    [diskCache setData:imageData forKey:@"A.jpg"];
+    [diskCache setData:imageData forKey:@"B.jpg"];
+    NSNumber *allocatedSize;
+    [[NSURL fileURLWithPath:[diskCache cachePathForKey:@"A.jpg"]] getResourceValue:&allocatedSize forKey:NSURLTotalFileAllocatedSizeKey error:nil];
+    config.maxDiskSize = allocatedSize.unsignedIntegerValue * 5 / 2;
+    while (![diskCache removeExpiredDataWithTimeLimit:DBL_MAX]) {}
+    // Overwrites and removals do not grow the size counted by the next pass
+    for (NSUInteger i = 0; i < 10; i++) {
+        [diskCache setData:imageData forKey:@"A.jpg"];
+        [diskCache removeDataForKey:@"B.jpg"];
+        [diskCache setData:imageData forKey:@"B.jpg"];
+    }
+    while (![diskCache removeExpiredDataWithTimeLimit:0]) {}
+    expect([diskCache containsDataForKey:@"A.jpg"]).beTruthy();
+    expect([diskCache containsDataForKey:@"B.jpg"]).beTruthy();
+    [diskCache removeAllData];
+}
+
+- (void)test83DiskCacheSmallDataWritePerformance {
+    [self measureWritingSmallDataToDiskCacheClass:[SDDiskCache class]];
+}
+
+- (void)test84PackDiskCacheSmallDataWritePerformance {
+    // Compare with `test83DiskCacheSmallDataWritePerformance`, appending to one segment file avoids creating one file for each data
+    [self measureWritingSmallDataToDiskCacheClass:[SDPackDiskCache class]];
+}
+
+- (void)test85DiskCacheSmallDataReadPerformance {
+    [self measureReadingSmallDataFromDiskCacheClass:[SDDiskCache class]];
+}
+
+- (void)test86PackDiskCacheSmallDataReadPerformance {
+    // Compare with `test85DiskCacheSmallDataReadPerformance`
+    [self measureReadingSmallDataFromDiskCacheClass:[SDPackDiskCache class]];
+}
+
+- (void)test87DiskCacheSlicedExpirationKeepsRecentFiles {
+    NSString *cachePath = [[self userCacheDirectory] stringByAppendingPathComponent:@"SlicedExpirationRecentFiles"];
+    [[NSFileManager defaultManager] removeItemAtPath:cachePath error:nil];
+    NSData *imageData = [NSData dataWithContentsOfFile:[self testJPEGPath]];
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    SDDiskCache *diskCache = [[SDDiskCache alloc] initWithCachePath:cachePath config:config];
+    NSArray<NSString *> *oldKeys = @[@"A.jpg", @"B.jpg", @"C.jpg", @"D.jpg"];
+    NSArray<NSString *> *recentKeys = @[@"E.jpg", @"F.jpg"];
+    for (NSString *key in oldKeys) {
+        [diskCache setData:imageData forKey:key];
+        [[NSFileManager defaultManager] setAttributes:@{NSFileModificationDate : [NSDate dateWithTimeIntervalSinceNow:-3600]} ofItemAtPath:[diskCache cachePathForKey:key] error:nil];
+    }
+    for (NSString *key in recentKeys) {
+        [diskCache setData:imageData forKey:key];
+    }
+    NSNumber *allocatedSize;
+    [[NSURL fileURLWithPath:[diskCache cachePathForKey:@"A.jpg"]] getResourceValue:&allocatedSize forKey:NSURLTotalFileAllocatedSizeKey error:nil];
+    // Keep less than half of 5 files
+    config.maxDiskSize = allocatedSize.unsignedIntegerValue * 5;
+    // Each slice checks only one file, the recent files are still kept because the oldest files of the whole pass are removed
+    while (![diskCache removeExpiredDataWithTimeLimit:0]) {}
+    for (NSString *key in oldKeys) {
+        expect([diskCache containsDataForKey:key]).beFalsy();
+    }
+    for (NSString *key in recentKeys) {
+        expect([diskCache containsDataForKey:key]).beTruthy();
+    }
+    [diskCache removeAllData];
+}
+
+- (void)test88DiskCacheMD5FileNamePerformance {
+    [self measureFileNameHashType:SDImageCacheConfigFileNameHashTypeMD5];
+}
+
+- (void)test89DiskCacheMurmur3FileNamePerformance {
+    // Compare with `test88DiskCacheMD5FileNamePerformance`, MurmurHash3 and the extension parsing without `NSURL` are faster
+    [self measureFileNameHashType:SDImageCacheConfigFileNameHashTypeMurmur3];
+}
+
+- (void)test90ImageCacheSerialDiskReadPerformance {
+    [self measureDiskReadsWithConcurrentCount:1];
+}
+
+- (void)test91ImageCacheConcurrentDiskReadPerformance {
+    // Compare with `test90ImageCacheSerialDiskReadPerformance`, the reads of different keys run in parallel on the stripe queues
+    [self measureDiskReadsWithConcurrentCount:[NSProcessInfo processInfo].activeProcessorCount * 2];
+}
+
+- (void)test92ImageCacheBatchQueryCoalesceWithSingleQuery {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"The batch query shares the in-flight query of the same key"];
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"BatchQueryCoalesce"];
+    NSData *imageData = [NSData dataWithContentsOfFile:[self testJPEGPath]];
+    [cache storeImageDataToDisk:imageData forKey:@"0"];
+    [cache storeImageDataToDisk:imageData forKey:@"1"];
+    __block UIImage *singleImage;
+    [cache queryCacheOperationForKey:@"0" options:SDImageCacheLowPriority done:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+        expect(image).notTo.beNil();
+        singleImage = image;
+    }];
+    // The low priority batch goes through the low priority lane, and shares the query of the same options
+    [cache queryCacheOperationForKeys:@[@"0", @"1"] options:SDImageCacheLowPriority context:nil progress:nil done:^(NSDictionary<NSString *,UIImage *> * _Nonnull images) {
+        expect(images.count).equal(2);
+        // Decoded once
+        expect(images[@"0"]).beIdenticalTo(singleImage);
+        [cache clearDiskOnCompletion:^{
+            [expectation fulfill];
+        }];
+    }];
+    [self waitForExpectationsWithCommonTimeout];
+}
+
+- (void)test93SDImageCachesManagerRecordQueryStatisticsOnlyWhenAsked {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"SDImageCachesManager records the query statistics only when asked"];
+    SDImageCachesManager *cachesManager = [[SDImageCachesManager alloc] init];
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"RecordQueryStatistics"];
+    cachesManager.caches = @[cache];
+    [cache storeImageToMemory:[self testJPEGImage] forKey:kTestImageKeyJPEG];
+    [cachesManager queryImageForKey:kTestImageKeyJPEG options:0 context:nil completion:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+        expect(image).notTo.beNil();
+        // Neither the adaptive query order nor the statistics is enabled
+        expect([cachesManager queryStatisticsForCache:cache]).beNil();
+        cachesManager.shouldRecordQueryStatistics = YES;
+        [cachesManager queryImageForKey:kTestImageKeyJPEG options:0 context:nil completion:^(UIImage * _Nullable image, NSData * _Nullable data, SDImageCacheType cacheType) {
+            SDImageCachesManagerQueryStatistics *statistics = [cachesManager queryStatisticsForCache:cache];
+            expect(statistics.queryCount).equal(1);
+            expect(statistics.hitRate).equal(1);
+            expect(statistics.p95Latency).equal(statistics.medianLatency);
+            [expectation fulfill];
+        }];
+    }];
+    [self waitForExpectationsWithCommonTimeout];
+}
+
+- (void)test94SDImageCachesManagerWriteBackToTheCachesAtStoreTime {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"SDImageCachesManager writes back to the caches at store time"];
+    SDImageCachesManager *cachesManager = [[SDImageCachesManager alloc] init];
+    SDImageCache *lowCache = [[SDImageCache alloc] initWithNamespace:@"WriteBackLowTierCache"];
+    SDImageCache *highCache = [[SDImageCache alloc] initWithNamespace:@"WriteBackHighTierCache"];
+    SDImageCache *newCache = [[SDImageCache alloc] initWithNamespace:@"WriteBackNewCache"];
+    cachesManager.caches = @[lowCache, highCache];
+    cachesManager.storeOperationPolicy = SDImageCachesManagerOperationPolicySerial;
+    cachesManager.storeWriteBackInterval = 60;
+    [cachesManager storeImage:[self testJPEGImage] imageData:nil forKey:kTestImageKeyJPEG cacheType:SDImageCacheTypeMemory completion:nil];
+    // The new highest priority cache is not the one already written
+    cachesManager.caches = @[lowCache, highCache, newCache];
+    [cachesManager flushWriteBackWithCompletion:^{
+        expect([lowCache imageFromMemoryCacheForKey:kTestImageKeyJPEG]).notTo.beNil();
+        expect([highCache imageFromMemoryCacheForKey:kTestImageKeyJPEG]).notTo.beNil();
+        expect([newCache imageFromMemoryCacheForKey:kTestImageKeyJPEG]).beNil();
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithCommonTimeout];
+}
+
 #pragma mark Helper methods
 
+- (void)measureDiskReadsWithConcurrentCount:(NSUInteger)concurrentCount {
+    NSData *imageData = [NSData dataWithContentsOfFile:[self testJPEGPath]];
+    NSUInteger keyCount = 200;
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.maxConcurrentDiskOperationCount = concurrentCount;
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"ConcurrentDiskReadPerformance" diskCacheDirectory:nil config:config];
+    [cache clearDiskOnCompletion:nil];
+    for (NSUInteger i = 0; i < keyCount; i++) {
+        [cache storeImageDataToDisk:imageData forKey:@(i).stringValue];
+    }
+    [self measureBlock:^{
+        dispatch_apply(4000, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+            [cache diskImageDataForKey:@(i % keyCount).stringValue];
+        });
+    }];
+    [cache clearDiskOnCompletion:nil];
+}
+
+- (void)measureFileNameHashType:(SDImageCacheConfigFileNameHashType)hashType {
+    NSUInteger count = 10000;
+    NSMutableArray<NSString *> *keys = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [keys addObject:[NSString stringWithFormat:@"https://example.com/images/avatar/%lu.jpg?width=100&height=100", (unsigned long)i]];
+    }
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    config.diskCacheFileNameHashType = hashType;
+    SDDiskCache *diskCache = [[SDDiskCache alloc] initWithCachePath:[[self userCacheDirectory] stringByAppendingPathComponent:@"FileNameHash"] config:config];
+    [self measureBlock:^{
+        for (NSString *key in keys) {
+            @autoreleasepool {
+                [diskCache cachePathForKey:key];
+            }
+        }
+    }];
+}
+
+- (void)measureWritingSmallDataToDiskCacheClass:(Class)cacheClass {
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    NSMutableData *data = [NSMutableData dataWithLength:4 * 1024];
+    arc4random_buf(data.mutableBytes, data.length);
+    NSString *cachePath = [[self userCacheDirectory] stringByAppendingPathComponent:NSStringFromClass(cacheClass)];
+    id<SDDiskCache> diskCache = [[cacheClass alloc] initWithCachePath:cachePath config:config];
+    [self measureMetrics:@[XCTPerformanceMetric_WallClockTime] automaticallyStartMeasuring:NO forBlock:^{
+        [diskCache removeAllData];
+        [self startMeasuring];
+        for (NSUInteger i = 0; i < 1000; i++) {
+            [diskCache setData:data forKey:[NSString stringWithFormat:@"http://example.com/avatar/%lu.jpg", (unsigned long)i]];
+        }
+        [self stopMeasuring];
+    }];
+    [diskCache removeAllData];
+}
+
+- (void)measureReadingSmallDataFromDiskCacheClass:(Class)cacheClass {
+    SDImageCacheConfig *config = [[SDImageCacheConfig alloc] init];
+    NSMutableData *data = [NSMutableData dataWithLength:4 * 1024];
+    arc4random_buf(data.mutableBytes, data.length);
+    NSString *cachePath = [[self userCacheDirectory] stringByAppendingPathComponent:NSStringFromClass(cacheClass)];
+    id<SDDiskCache> diskCache = [[cacheClass alloc] initWithCachePath:cachePath config:config];
+    [diskCache removeAllData];
+    for (NSUInteger i = 0; i < 1000; i++) {
+        [diskCache setData:data forKey:[NSString stringWithFormat:@"http://example.com/avatar/%lu.jpg", (unsigned long)i]];
+    }
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 1000; i++) {
+            [diskCache dataForKey:[NSString stringWithFormat:@"http://example.com/avatar/%lu.jpg", (unsigned long)i]];
+        }
+    }];
+    [diskCache removeAllData];
+}
+
 - (UIImage *)testJPEGImage {
     static UIImage *reusableImage = nil;
     if (!reusableImage) {
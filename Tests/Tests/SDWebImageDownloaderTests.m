@@ -11,6 +11,7 @@
 #import "SDWebImageTestDownloadOperation.h"
 #import "SDWebImageTestCoder.h"
 #import "SDWebImageTestLoader.h"
+#import "SDInternalMacros.h"
 #import <compression.h>
 
 #define kPlaceholderTestURLTemplate @"https://via.placeholder.com/10000x%d.png"
@@ -24,6 +25,51 @@
 
 @interface SDWebImageDownloader ()
 @property (strong, nonatomic, nonnull) NSOperationQueue *downloadQueue;
+@property (strong, nonatomic, nonnull) NSMapTable<NSNumber *, NSOperation<SDWebImageDownloaderOperation> *> *taskOperations;
+@property (strong, nonatomic, nonnull) dispatch_semaphore_t taskOperationsLock;
+@end
+
+@interface SDWebImageDownloaderOperation ()
+@property (assign, nonatomic) NSUInteger imageDataCopiedSize;
+@end
+
+/**
+ *  A local HTTP stand-in, which responds the test PNG image in several chunks for any `sdwebimage-test` host request
+ *  The `Content-Length` header is omitted when the URL query is `unknownlength`
+ */
+@interface SDWebImageTestURLProtocol : NSURLProtocol
+@end
+
+@implementation SDWebImageTestURLProtocol
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request {
+    return [request.URL.host isEqualToString:@"sdwebimage-test"];
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request {
+    return request;
+}
+
+- (void)startLoading {
+    NSBundle *testBundle = [NSBundle bundleForClass:[self class]];
+    NSData *data = [NSData dataWithContentsOfFile:[testBundle pathForResource:@"TestImage" ofType:@"png"]];
+    NSMutableDictionary<NSString *, NSString *> *headerFields = [NSMutableDictionary dictionaryWithObject:@"image/png" forKey:@"Content-Type"];
+    if (![self.request.URL.query isEqualToString:@"unknownlength"]) {
+        headerFields[@"Content-Length"] = @(data.length).stringValue;
+    }
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:self.request.URL statusCode:200 HTTPVersion:@"HTTP/1.1" headerFields:headerFields];
+    [self.client URLProtocol:self didReceiveResponse:response cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+    NSUInteger chunkCount = 8;
+    NSUInteger chunkLength = (data.length + chunkCount - 1) / chunkCount;
+    for (NSUInteger offset = 0; offset < data.length; offset += chunkLength) {
+        NSUInteger length = MIN(chunkLength, data.length - offset);
+        [self.client URLProtocol:self didLoadData:[data subdataWithRange:NSMakeRange(offset, length)]];
+    }
+    [self.client URLProtocolDidFinishLoading:self];
+}
+
+- (void)stopLoading {}
+
 @end
 
 
@@ -685,6 +731,148 @@
     [self waitForExpectationsWithCommonTimeout];
 }
 
+- (void)test32ThatTaskOperationIsRegisteredWhenTaskCreated {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Task operation registered when task created"];
+    SDWebImageDownloaderConfig *config = [[SDWebImageDownloaderConfig alloc] init];
+    NSURLSessionConfiguration *sessionConfiguration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    sessionConfiguration.protocolClasses = @[SDWebImageTestURLProtocol.class];
+    sessionConfiguration.URLCache = nil;
+    config.sessionConfiguration = sessionConfiguration;
+    // One running task at a time, so the lookup table contains only the task of the current callback
+    config.maxConcurrentDownloads = 1;
+    SDWebImageDownloader *downloader = [[SDWebImageDownloader alloc] initWithConfig:config];
+    
+    NSUInteger count = 10;
+    __block NSUInteger finishedCount = 0;
+    __block NSUInteger failedCount = 0;
+    __block NSUInteger unregisteredCount = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        NSURL *url = [NSURL URLWithString:[NSString stringWithFormat:@"http://sdwebimage-test/%lu.png", (unsigned long)i]];
+        [downloader downloadImageWithURL:url options:SDWebImageDownloaderAvoidDecodeImage progress:^(NSInteger receivedSize, NSInteger expectedSize, NSURL * _Nullable targetURL) {
+            // The first progress is called from the response callback, the task is already registered when it's created
+            SD_LOCK(downloader.taskOperationsLock);
+            NSUInteger taskCount = downloader.taskOperations.count;
+            NSOperation<SDWebImageDownloaderOperation> *operation = downloader.taskOperations.objectEnumerator.nextObject;
+            SD_UNLOCK(downloader.taskOperationsLock);
+            if (taskCount != 1 || ![operation.request.URL isEqual:targetURL]) {
+                unregisteredCount++;
+            }
+        } completed:^(UIImage * _Nullable image, NSData * _Nullable data, NSError * _Nullable error, BOOL finished) {
+            if (!finished) {
+                return;
+            }
+            if (error || !image) {
+                failedCount++;
+            }
+            finishedCount++;
+            if (finishedCount == count) {
+                [expectation fulfill];
+            }
+        }];
+    }
+    
+    [self waitForExpectationsWithTimeout:kAsyncTestTimeout * 2 handler:nil];
+    expect(failedCount).equal(0);
+    expect(unregisteredCount).equal(0);
+    // The finished tasks are removed from the lookup table
+    SD_LOCK(downloader.taskOperationsLock);
+    NSUInteger taskCount = downloader.taskOperations.count;
+    SD_UNLOCK(downloader.taskOperationsLock);
+    expect(taskCount).equal(0);
+    [downloader invalidateSessionAndCancel:YES];
+}
+
+- (void)test33ThatChunkedReceiveBufferKeepsTheData {
+    XCTestExpectation *expectation1 = [self expectationWithDescription:@"Progressive download with known length"];
+    XCTestExpectation *expectation2 = [self expectationWithDescription:@"Download with unknown length"];
+    SDWebImageDownloaderConfig *config = [[SDWebImageDownloaderConfig alloc] init];
+    NSURLSessionConfiguration *sessionConfiguration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    sessionConfiguration.protocolClasses = @[SDWebImageTestURLProtocol.class];
+    sessionConfiguration.URLCache = nil;
+    config.sessionConfiguration = sessionConfiguration;
+    SDWebImageDownloader *downloader = [[SDWebImageDownloader alloc] initWithConfig:config];
+    NSData *PNGData = [NSData dataWithContentsOfFile:[self testPNGPath]];
+    
+    // 1. Progressive download, the snapshots are decoded before the data finished
+    __block NSUInteger progressCount = 0;
+    __block SDWebImageDownloaderOperation *operation1;
+    SDWebImageDownloadToken *token1 = [downloader downloadImageWithURL:[NSURL URLWithString:@"http://sdwebimage-test/progressive.png"] options:SDWebImageDownloaderProgressiveLoad progress:^(NSInteger receivedSize, NSInteger expectedSize, NSURL * _Nullable targetURL) {
+        expect(receivedSize).beLessThanOrEqualTo(PNGData.length);
+        expect(expectedSize).equal(PNGData.length);
+        progressCount++;
+    } completed:^(UIImage * _Nullable image, NSData * _Nullable data, NSError * _Nullable error, BOOL finished) {
+        if (!finished) {
+            return;
+        }
+        expect(error).to.beNil();
+        expect(image).notTo.beNil();
+        expect(data).equal(PNGData);
+        expect(progressCount).beGreaterThan(1);
+        // The buffer has the expected size, the received bytes are never copied again, even for the progressive snapshots
+        expect(operation1.imageDataCopiedSize).equal(0);
+        [expectation1 fulfill];
+    }];
+    operation1 = (SDWebImageDownloaderOperation *)token1.downloadOperation;
+    
+    // 2. Unknown length, the buffer starts with the minimum capacity
+    __block SDWebImageDownloaderOperation *operation2;
+    SDWebImageDownloadToken *token2 = [downloader downloadImageWithURL:[NSURL URLWithString:@"http://sdwebimage-test/unknown.png?unknownlength"] options:0 progress:^(NSInteger receivedSize, NSInteger expectedSize, NSURL * _Nullable targetURL) {
+        expect(expectedSize).equal(0);
+    } completed:^(UIImage * _Nullable image, NSData * _Nullable data, NSError * _Nullable error, BOOL finished) {
+        expect(error).to.beNil();
+        expect(image).notTo.beNil();
+        expect(data).equal(PNGData);
+        // The minimum capacity holds the test image, the chunks are appended without the growth copy
+        expect(PNGData.length).beLessThan(16 * 1024);
+        expect(operation2.imageDataCopiedSize).equal(0);
+        [expectation2 fulfill];
+    }];
+    operation2 = (SDWebImageDownloaderOperation *)token2.downloadOperation;
+    
+    [self waitForExpectationsWithCommonTimeoutUsingHandler:^(NSError * _Nullable error) {
+        [downloader invalidateSessionAndCancel:YES];
+    }];
+}
+
+- (void)test34ThatTaskOperationLookupScalesWithQueuedOperations {
+    SDWebImageDownloaderConfig *config = [[SDWebImageDownloaderConfig alloc] init];
+    NSURLSessionConfiguration *sessionConfiguration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    sessionConfiguration.protocolClasses = @[SDWebImageTestURLProtocol.class];
+    sessionConfiguration.URLCache = nil;
+    config.sessionConfiguration = sessionConfiguration;
+    config.maxConcurrentDownloads = 6;
+    SDWebImageDownloader *downloader = [[SDWebImageDownloader alloc] initWithConfig:config];
+    
+    // The delegate callbacks of each task look up its operation, with 1000 operations queued
+    NSUInteger count = 1000;
+    __block NSUInteger round = 0;
+    [self measureBlock:^{
+        XCTestExpectation *expectation = [self expectationWithDescription:@"Download with 1000 queued operations"];
+        __block NSUInteger finishedCount = 0;
+        __block NSUInteger failedCount = 0;
+        for (NSUInteger i = 0; i < count; i++) {
+            // Different URL for each round, so the downloads are not coalesced
+            NSURL *url = [NSURL URLWithString:[NSString stringWithFormat:@"http://sdwebimage-test/%lu-%lu.png", (unsigned long)round, (unsigned long)i]];
+            [downloader downloadImageWithURL:url options:SDWebImageDownloaderAvoidDecodeImage progress:nil completed:^(UIImage * _Nullable image, NSData * _Nullable data, NSError * _Nullable error, BOOL finished) {
+                if (!finished) {
+                    return;
+                }
+                if (error || !image) {
+                    failedCount++;
+                }
+                finishedCount++;
+                if (finishedCount == count) {
+                    [expectation fulfill];
+                }
+            }];
+        }
+        round++;
+        [self waitForExpectationsWithTimeout:kAsyncTestTimeout * 5 handler:nil];
+        expect(failedCount).equal(0);
+    }];
+    [downloader invalidateSessionAndCancel:YES];
+}
+
 #pragma mark - Helper
 
 - (NSString *)testPNGPath {
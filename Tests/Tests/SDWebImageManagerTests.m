@@ -8,6 +8,19 @@
 
 #import "SDTestCase.h"
 #import "SDWebImageTestTransformer.h"
+#import <pthread.h>
+
+// The allocation logger of libmalloc, which is called for each allocation when it's set. It's a private hook of libmalloc (the same one used by the malloc stack logging), so it's only used by the tests
+typedef void (SDMallocLogger)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numHotFramesToSkip);
+extern SDMallocLogger *malloc_logger;
+static const uint32_t kSDMallocLogTypeAllocate = 2;
+static NSUInteger SDMainThreadAllocationCount = 0;
+
+static void SDCountMainThreadAllocation(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numHotFramesToSkip) {
+    if ((type & kSDMallocLogTypeAllocate) && pthread_main_np()) {
+        SDMainThreadAllocationCount++;
+    }
+}
 
 @interface SDWebImageManagerTests : SDTestCase
 
@@ -247,6 +260,47 @@
     [self waitForExpectationsWithCommonTimeout];
 }
 
+- (void)test13ThatMemoryCacheHitIsSynchronousWithoutAllocation {
+    SDImageCache *cache = [[SDImageCache alloc] initWithNamespace:@"SDWebImageMemoryCacheHit"];
+    SDWebImageManager *manager = [[SDWebImageManager alloc] initWithCache:cache loader:SDWebImageDownloader.sharedDownloader];
+    NSURL *url = [NSURL URLWithString:kTestJPEGURL];
+    UIImage *testImage = [[UIImage alloc] initWithContentsOfFile:[self testJPEGPath]];
+    [cache storeImageToMemory:testImage forKey:[manager cacheKeyForURL:url]];
+    
+    __block NSUInteger completedCount = 0;
+    __block UIImage *completedImage;
+    __block SDImageCacheType completedCacheType = SDImageCacheTypeNone;
+    // Do not allocate in the completion block, the allocations are counted below
+    SDInternalCompletionBlock completedBlock = ^(UIImage * _Nullable image, NSData * _Nullable data, NSError * _Nullable error, SDImageCacheType cacheType, BOOL finished, NSURL * _Nullable imageURL) {
+        completedImage = image;
+        completedCacheType = cacheType;
+        completedCount++;
+    };
+    // The memory cache hit is answered synchronously, and shares the finished operation
+    SDWebImageCombinedOperation *operation = [manager loadImageWithURL:url options:0 progress:nil completed:completedBlock];
+    expect(completedCount).equal(1);
+    expect(completedImage).beIdenticalTo(testImage);
+    expect(completedCacheType).equal(SDImageCacheTypeMemory);
+    expect(operation).notTo.beNil();
+    expect(manager.isRunning).beFalsy();
+    [operation cancel];
+    expect([manager loadImageWithURL:url options:0 progress:nil completed:completedBlock]).beIdenticalTo(operation);
+    expect(completedCount).equal(2);
+    
+    // Allocation count regression, the combined operation, the options result and the context copy are not allocated for the memory cache hit. The loads above are the warm-up, so the loads below allocate nothing on the main thread
+    NSUInteger loadCount = 100;
+    SDMallocLogger *previousLogger = malloc_logger;
+    SDMainThreadAllocationCount = 0;
+    malloc_logger = SDCountMainThreadAllocation;
+    for (NSUInteger i = 0; i < loadCount; i++) {
+        [manager loadImageWithURL:url options:0 progress:nil completed:completedBlock];
+    }
+    malloc_logger = previousLogger;
+    NSUInteger allocationCount = SDMainThreadAllocationCount;
+    expect(completedCount).equal(2 + loadCount);
+    expect(allocationCount).equal(0);
+}
+
 - (NSString *)testJPEGPath {
     NSBundle *testBundle = [NSBundle bundleForClass:[self class]];
     return [testBundle pathForResource:@"TestImage" ofType:@"jpg"];
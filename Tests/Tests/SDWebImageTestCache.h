@@ -9,6 +9,7 @@
 
 #import <SDWebImage/SDMemoryCache.h>
 #import <SDWebImage/SDDiskCache.h>
+#import <SDWebImage/SDImageCacheDefine.h>
 
 // A really naive implementation of custom memory cache and disk cache
 
@@ -26,3 +27,12 @@
 @property (nonatomic, strong, nonnull) NSFileManager *fileManager;
 
 @end
+
+// A cache never completes the query, to test the slow cache
+
+@interface SDWebImageTestHangingCache : NSObject <SDImageCache>
+
+@property (nonatomic, strong, nullable) NSOperation *lastQueryOperation;
+@property (nonatomic, strong, nullable) UIImage *lastStoredImage;
+
+@end
@@ -105,3 +105,38 @@
 }
 
 @end
+
+@implementation SDWebImageTestHangingCache
+
+- (nullable id<SDWebImageOperation>)queryImageForKey:(nullable NSString *)key options:(SDWebImageOptions)options context:(nullable SDWebImageContext *)context completion:(nullable SDImageCacheQueryCompletionBlock)completionBlock {
+    NSOperation *operation = [NSOperation new];
+    self.lastQueryOperation = operation;
+    return operation;
+}
+
+- (void)storeImage:(nullable UIImage *)image imageData:(nullable NSData *)imageData forKey:(nullable NSString *)key cacheType:(SDImageCacheType)cacheType completion:(nullable SDWebImageNoParamsBlock)completionBlock {
+    self.lastStoredImage = image;
+    if (completionBlock) {
+        completionBlock();
+    }
+}
+
+- (void)removeImageForKey:(nullable NSString *)key cacheType:(SDImageCacheType)cacheType completion:(nullable SDWebImageNoParamsBlock)completionBlock {
+    if (completionBlock) {
+        completionBlock();
+    }
+}
+
+- (void)containsImageForKey:(nullable NSString *)key cacheType:(SDImageCacheType)cacheType completion:(nullable SDImageCacheContainsCompletionBlock)completionBlock {
+    if (completionBlock) {
+        completionBlock(SDImageCacheTypeNone);
+    }
+}
+
+- (void)clearWithCacheType:(SDImageCacheType)cacheType completion:(nullable SDWebImageNoParamsBlock)completionBlock {
+    if (completionBlock) {
+        completionBlock();
+    }
+}
+
+@end
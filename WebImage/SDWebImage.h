@@ -27,7 +27,10 @@ FOUNDATION_EXPORT const unsigned char WebImageVersionString[];
 #import <SDWebImage/SDImageCacheConfig.h>
 #import <SDWebImage/SDImageCache.h>
 #import <SDWebImage/SDMemoryCache.h>
+#import <SDWebImage/SDShardedMemoryCache.h>
+#import <SDWebImage/SDImageCacheMemoryBudget.h>
 #import <SDWebImage/SDDiskCache.h>
+#import <SDWebImage/SDPackDiskCache.h>
 #import <SDWebImage/SDImageCacheDefine.h>
 #import <SDWebImage/SDImageCachesManager.h>
 #import <SDWebImage/UIView+WebCache.h>